@@ -6,7 +6,9 @@
 
 ; Bootloader offset.
 [org 0x7c00]
-KERNEL_OFFSET equ 0x1000    ; Set a location to link the kernel
+KERNEL_OFFSET equ 0x10000   ; Set a location to link the kernel
+KERNEL_SEGMENT equ 0x1000   ; Real mode segment of the kernel location
+KERNEL_SECTORS equ 192      ; Number of kernel sectors to read
     mov   [BOOT_DRIVE], dl  ; Set boot drive.
 
     mov   bp, 0x9000
@@ -16,6 +18,7 @@ KERNEL_OFFSET equ 0x1000    ; Set a location to link the kernel
     call  print_str         ; Print boot mode.
     call  print_ln
 
+    call  detect_memory     ; Store the BIOS memory map.
     call  load_kernel       ; Read the kernel.
     call  switch_to_pm      ; 32-bit mode.
     jmp   $
@@ -26,6 +29,7 @@ KERNEL_OFFSET equ 0x1000    ; Set a location to link the kernel
 %include "boot/pikos_print_hex.asm"
 %include "boot/pikos_print32.asm"
 %include "boot/pikos_disk.asm"
+%include "boot/pikos_memory.asm"
 %include "boot/pikos_gdt.asm"
 %include "boot/pikos_switch.asm"
 
@@ -37,9 +41,11 @@ load_kernel:
     call  print_str
     call  print_ln
 
-    mov   bx, KERNEL_OFFSET  ; Read the kernel from the
-    mov   dh, 32             ; disc and store at the
-    mov   dl, [BOOT_DRIVE]   ; 32 sectors at 0x1000
+    mov   ax, KERNEL_SEGMENT ; Read the kernel from the
+    mov   es, ax             ; disc and store the
+    xor   bx, bx             ; KERNEL_SECTORS sectors
+    mov   dh, KERNEL_SECTORS ; at 0x10000
+    mov   dl, [BOOT_DRIVE]
 
     call  disk_load
     ret
@@ -51,6 +57,7 @@ BEGIN_PM:
     mov   ebx, MSG_PROT_MODE
     call  print_string_pm    ; Print 32-bit switch message
 
+    mov   ebx, MEMORY_MAP    ; Hand the memory map to the kernel
     call  KERNEL_OFFSET      ; Gives control to the kernel
     jmp   $
 
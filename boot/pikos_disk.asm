@@ -5,27 +5,46 @@
 
 ; A typical disk is accessed through 3 values: cylinder, head and sector (CHS).
 ; We can use the BIOS interrupt int 0x13 after setting al to 0x02 to access a
-; disk.
+; disk. Sectors are read one at a time so that a read never crosses a track or
+; a 64 KiB DMA boundary, which allows kernels larger than a single track.
+
+; Floppy geometry.
+SECTORS_PER_TRACK equ 18
 
 ; Load the sectors in DH from the drive in DL into the register ES:BX.
 disk_load:
     pusha               ; Push all of the registers onto the stack
-    push  dx            ; Store number of sectors to be read
-
-    mov   ah, 0x02
-    mov   al, dh        ; Read DH number of sectors
+    push  es
 
+    mov   al, dh        ; Store number of sectors to be read
     mov   cl, 0x02      ; Start reading from the sector after the boot sector
     mov   ch, 0x00      ; Select cylinder 0
     mov   dh, 0x00      ; Select head 0
 
+disk_load_sector:
+    push  ax
+    mov   ax, 0x0201    ; Read a single sector
     int   0x13          ; BIOS disk interrupt
-
     jc    disk_error    ; Show error if overflow occurred
-    pop   dx
-    cmp   al, dh
-    jne   sectors_error ; Show error if incorrect number of sectors read
+    pop   ax
+
+    mov   si, es
+    add   si, 0x20      ; Move the buffer on by 512 bytes
+    mov   es, si
+
+    inc   cl            ; Move to the next sector, wrapping onto the
+    cmp   cl, SECTORS_PER_TRACK ; next head and then the next cylinder
+    jbe   disk_load_next
+    mov   cl, 0x01
+    xor   dh, 0x01
+    jnz   disk_load_next
+    inc   ch
 
+disk_load_next:
+    dec   al
+    jnz   disk_load_sector
+
+    pop   es
     popa
     ret                 ; Restore stack state and return
 
@@ -41,12 +60,5 @@ disk_error:
     jmp   $
 
 
-; Prints out the sectors error.
-sectors_error:
-    mov   bx, SECTORS_ERROR
-    call  print_str
-
-
 ; Error string variables.
-DISK_ERROR: db "Disk read error!", 0
-SECTORS_ERROR: db "Incorrect number of sectors read!", 0
\ No newline at end of file
+DISK_ERROR: db "Disk read error!", 0
\ No newline at end of file
@@ -1,12 +1,26 @@
 ;
 ; pikos_entry.asm
-; Simply defines the calling point of main in the kernel.
+; Simply defines the calling point of main in the kernel. The boot sector
+; passes the address of the BIOS memory map in EBX, which is handed on to main.
 ;
 
 global _start
 [bits 32]
 
 _start:
+    [extern __bss_start]
+    [extern _end]
+    mov   edi, __bss_start ; The BSS is not part of the kernel binary
+    mov   ecx, _end        ; so zero it before any C code runs
+    sub   ecx, edi
+    xor   eax, eax
+    cld
+    rep   stosb
+
     [extern pikos_main]
+    push  ebx              ; Memory map from the boot sector
     call  pikos_main
-    jmp   $
\ No newline at end of file
+
+halt:
+    hlt                    ; Should main return, halt rather than spin
+    jmp   halt
\ No newline at end of file
@@ -0,0 +1,46 @@
+;
+; pikos_memory.asm
+; pikOS memory detection routine.
+;
+
+; The BIOS reports the physical memory layout through int 0x15 with EAX set to
+; 0xE820. Each call writes one 24-byte entry (64-bit base, 64-bit length,
+; 32-bit type and 32-bit ACPI attributes) to ES:DI and returns a continuation
+; value in EBX, which is zero after the last entry. The map is stored at
+; MEMORY_MAP as a 16-bit entry count followed by the entries at offset 4.
+
+MEMORY_MAP equ 0x0500       ; Location of the memory map
+MEMORY_MAP_MAX equ 64       ; Maximum number of entries stored
+SMAP equ 0x534d4150         ; 'SMAP' signature
+
+; Fill the memory map using the BIOS E820 function.
+detect_memory:
+    pusha
+    push  es
+    xor   ax, ax
+    mov   es, ax            ; Entries are written to ES:DI
+    mov   di, MEMORY_MAP + 4
+    xor   ebx, ebx          ; Start with the first entry
+    xor   si, si            ; Number of entries read
+
+detect_memory_loop:
+    mov   eax, 0xe820
+    mov   ecx, 24           ; Size of an entry
+    mov   edx, SMAP
+    int   0x15
+    jc    detect_memory_done ; Carry is set past the last entry
+    cmp   eax, SMAP
+    jne   detect_memory_done ; Function is not supported
+
+    add   di, 24
+    inc   si
+    cmp   si, MEMORY_MAP_MAX
+    jae   detect_memory_done ; No more room for entries
+    test  ebx, ebx
+    jnz   detect_memory_loop ; Zero means this was the last entry
+
+detect_memory_done:
+    mov   [MEMORY_MAP], si  ; Store the number of entries
+    pop   es
+    popa
+    ret
\ No newline at end of file
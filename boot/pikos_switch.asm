@@ -7,6 +7,9 @@
 [bits 16]
 switch_to_pm:
     cli                     ; Turn off interrupts
+    in    al, 0x92          ; Enable the A20 line via the fast A20
+    or    al, 0x2           ; register so that memory above 1 MiB
+    out   0x92, al          ; is addressable
     lgdt  [gdt_descriptor]  ; Load the GDT descriptor
     mov   eax, cr0             
     or    eax, 0x1          ; Set the control register to 1 indirectly
@@ -0,0 +1,67 @@
+; pikos_trampoline.asm
+; Real mode entry point of the application processors. A startup IPI starts a
+; processor in real mode at CS:IP = XX00:0000 for a vector XX, so the code from
+; trampoline_start to trampoline_end is copied to a page below 1 MiB by
+; start_cpu() in cpu/smp.c and every address in it is taken relative to that
+; copy. It switches to protected mode as pikos_switch.asm does, using the GDT
+; of the boot sector, then calls ap_main with the stack and per-CPU data that
+; start_cpu() left in trampoline_stack and trampoline_cpu.
+;
+
+global trampoline_start
+global trampoline_stack
+global trampoline_cpu
+global trampoline_end
+
+TRAMPOLINE_BASE equ 0x8000
+
+; Address of a trampoline label in the copy.
+%define TRAMPOLINE(label) (TRAMPOLINE_BASE + (label) - trampoline_start)
+
+[bits 16]
+trampoline_start:
+    cli                     ; Turn off interrupts
+    cld
+    xor   ax, ax            ; Address the copy from segment zero
+    mov   ds, ax
+    lgdt  [TRAMPOLINE(gdt_descriptor)]
+    mov   eax, cr0
+    or    eax, 0x1          ; Set the control register to 1 indirectly
+    mov   cr0, eax
+    jmp   CODE_SEG:TRAMPOLINE(trampoline_pm)
+
+
+; 32-bit protected mode initialisation.
+[bits 32]
+trampoline_pm:
+    mov   ax, DATA_SEG      ; Point the segments to the data
+    mov   ds, ax            ; selector of the boot GDT until
+    mov   ss, ax            ; ap_main loads the per-CPU one
+    mov   es, ax
+    mov   fs, ax
+    mov   gs, ax
+
+    mov   esp, [TRAMPOLINE(trampoline_stack)]
+    mov   ebp, esp
+    push  dword [TRAMPOLINE(trampoline_cpu)]
+
+    [extern ap_main]
+    mov   eax, ap_main      ; Absolute call, as the copy has moved
+    call  eax
+
+halt:
+    hlt                     ; Should ap_main return, halt rather than spin
+    jmp   halt
+
+; The GDT of the boot sector. The descriptor is read from the copy, and
+; points back to the table in the kernel image, which lies below 1 MiB.
+%include "boot/pikos_gdt.asm"
+
+; Left here by start_cpu() for each processor in turn.
+align 4
+trampoline_stack:
+    dd 0x0
+trampoline_cpu:
+    dd 0x0
+
+trampoline_end:
\ No newline at end of file
@@ -0,0 +1,158 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file atomic.h
+ * \brief Freestanding atomic operation definitions.
+ *
+ * The kernel is built without libatomic, so the atomic operations are single
+ * x86 instructions in inline assembly. A read-modify-write takes the lock
+ * prefix, which makes it atomic against every other processor and orders it
+ * against all other loads and stores; xchg with memory is locked implicitly.
+ * An aligned 32-bit load or store is atomic by itself, and x86 keeps stores in
+ * program order and loads in program order, so the plain load and store only
+ * need the compiler kept from moving memory accesses across them. The one
+ * reordering x86 does allow, a later load passing an earlier store, is
+ * stopped by atomic_fence().
+ *
+ * Every function is static inline, as a call would cost more than the
+ * operation itself.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include "types.h"
+
+/**
+ * \brief Keeps the compiler from moving memory accesses across this point.
+ * \param None.
+ * \returns None.
+ */
+static inline void barrier(void) { __asm__ volatile("" : : : "memory"); }
+
+/**
+ * \brief Orders every earlier load and store before every later one.
+ * \param None.
+ * \returns None.
+ */
+static inline void atomic_fence(void) {
+  __asm__ volatile("mfence" : : : "memory");
+}
+
+/**
+ * \brief Hints to the processor that it is spinning on a lock.
+ * \param None.
+ * \returns None.
+ */
+static inline void cpu_relax(void) {
+  __asm__ volatile("pause" : : : "memory");
+}
+
+/**
+ * \brief Loads a value that other processors or interrupts may store. Later
+ * memory accesses are not moved before it.
+ * \param [in] ptr The value.
+ * \returns The value loaded.
+ */
+static inline uint32 atomic_load(const volatile uint32 *ptr) {
+  const uint32 value = *ptr;
+  barrier();
+  return value;
+}
+
+/**
+ * \brief Stores a value that other processors or interrupts may load. Earlier
+ * memory accesses are not moved after it.
+ * \param [out] ptr The value.
+ * \param [in] value The value to store.
+ * \returns None.
+ */
+static inline void atomic_store(volatile uint32 *ptr, uint32 value) {
+  barrier();
+  *ptr = value;
+}
+
+/**
+ * \brief Adds to a value atomically.
+ * \param [in,out] ptr The value.
+ * \param [in] n The amount to add.
+ * \returns The value before the addition.
+ */
+static inline uint32 atomic_fetch_add(volatile uint32 *ptr, uint32 n) {
+  __asm__ volatile("lock; xaddl %0, %1"
+                   : "+r"(n), "+m"(*ptr)
+                   :
+                   : "memory", "cc");
+  return n;
+}
+
+/**
+ * \brief Increments a value atomically.
+ * \param [in,out] ptr The value.
+ * \returns None.
+ */
+static inline void atomic_inc(volatile uint32 *ptr) {
+  __asm__ volatile("lock; incl %0" : "+m"(*ptr) : : "memory", "cc");
+}
+
+/**
+ * \brief Sets bits of a value atomically.
+ * \param [in,out] ptr The value.
+ * \param [in] bits The bits to set.
+ * \returns None.
+ */
+static inline void atomic_or(volatile uint32 *ptr, uint32 bits) {
+  __asm__ volatile("lock; orl %1, %0"
+                   : "+m"(*ptr)
+                   : "r"(bits)
+                   : "memory", "cc");
+}
+
+/**
+ * \brief Clears a single bit of a value atomically.
+ * \param [in,out] ptr The value.
+ * \param [in] n The bit number, less than 32.
+ * \returns Non-zero if the bit was set.
+ */
+static inline uint32 atomic_test_and_clear(volatile uint32 *ptr, uint32 n) {
+  uint8 was = 0;
+  __asm__ volatile("lock; btrl %2, %0; setc %1"
+                   : "+m"(*ptr), "=q"(was)
+                   : "r"(n)
+                   : "memory", "cc");
+  return was;
+}
+
+/**
+ * \brief Swaps a value atomically.
+ * \param [in,out] ptr The value.
+ * \param [in] value The value to store.
+ * \returns The value before the swap.
+ */
+static inline uint32 atomic_xchg(volatile uint32 *ptr, uint32 value) {
+  __asm__ volatile("xchgl %0, %1" : "+r"(value), "+m"(*ptr) : : "memory");
+  return value;
+}
+
+/**
+ * \brief Stores a value atomically if the current one is as expected.
+ * \param [in,out] ptr The value.
+ * \param [in] expected The value the store depends on.
+ * \param [in] value The value to store.
+ * \returns The value before, equal to expected if the store was made.
+ */
+static inline uint32 atomic_cmpxchg(volatile uint32 *ptr, uint32 expected,
+                                    uint32 value) {
+  __asm__ volatile("lock; cmpxchgl %2, %1"
+                   : "+a"(expected), "+m"(*ptr)
+                   : "r"(value)
+                   : "memory", "cc");
+  return expected;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file math.c
+ * \brief Arithmetic function implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "math.h"
+
+/**
+ * \desc Long division in base 2^32: the high word is divided first, and its
+ * remainder becomes the high half of the 64-bit value given to divl for the
+ * low word. As that remainder is less than the divisor, divl cannot overflow.
+ */
+uint64 udiv64(uint64 n, uint32 d) {
+  const uint32 high = (uint32)(n >> 32);
+  uint32 low = (uint32)n;
+  uint32 rem = high % d;
+
+  __asm__("divl %2" : "+a"(low), "+d"(rem) : "rm"(d));
+  return ((uint64)(high / d) << 32) | low;
+}
\ No newline at end of file
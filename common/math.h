@@ -0,0 +1,30 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file math.h
+ * \brief Arithmetic function declarations.
+ *
+ * The kernel is built without libgcc, so dividing a 64-bit integer, which the
+ * compiler would otherwise turn into a call to __udivdi3, is done here with a
+ * pair of 32-bit divide instructions.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef MATH_H
+#define MATH_H
+
+#include "types.h"
+
+/**
+ * \brief Divides a 64-bit unsigned integer by a 32-bit one.
+ * \param [in] n The dividend.
+ * \param [in] d The divisor, which must not be zero.
+ * \returns The quotient, rounded down.
+ */
+uint64 udiv64(uint64 n, uint32 d);
+
+#endif
\ No newline at end of file
@@ -11,14 +11,687 @@
  */
 
 #include "memory.h"
+#include "../cpu/fpu.h"
+#include "../cpu/isr.h"
+#include "../cpu/timer.h"
+#include "../kernel/frame.h"
+#include "../kernel/lock.h"
+#include "printf.h"
+
+/* =============================================================================
+ * MEMORY FUNCTIONS
+ * ========================================================================== */
+
+/* Signatures of the dispatched routines */
+typedef void *(*Memcpy_Fn)(void *dest, const void *src, uint32 nbytes);
+typedef void *(*Memset_Fn)(void *dest, int32 c, uint32 nbytes);
+
+/**
+ * \brief Copies single bytes until the destination is word aligned, then whole
+ * words with rep movsd and finally the remaining bytes with rep movsb. Aligning
+ * the destination keeps the stores aligned even when the source is not.
+ * \param [out] dest The destination for the copied bytes.
+ * \param [in] src The start of the address to be copied.
+ * \param [in] nbytes The number of bytes to be copied.
+ * \returns The destination address.
+ */
+static void *memcpy_words(void *dest, const void *src, uint32 nbytes) {
+  char *d = dest;
+  const char *s = src;
+  uint32 head = (-(uint32)d) & 3;
+  uint32 words = 0;
+
+  if (head > nbytes) {
+    head = nbytes;
+  }
+  nbytes -= head;
+  words = nbytes / 4;
+  nbytes %= 4;
+
+  __asm__ volatile("rep movsb\n\t"
+                   "mov %3, %%ecx\n\t"
+                   "rep movsl\n\t"
+                   "mov %4, %%ecx\n\t"
+                   "rep movsb"
+                   : "+D"(d), "+S"(s), "+c"(head)
+                   : "r"(words), "r"(nbytes)
+                   : "memory");
+  return dest;
+}
+
+/**
+ * \brief Copies with a single rep movsb, which processors with ERMS run as
+ * wide as their caches allow, handling the alignment themselves.
+ * \param [out] dest The destination for the copied bytes.
+ * \param [in] src The start of the address to be copied.
+ * \param [in] nbytes The number of bytes to be copied.
+ * \returns The destination address.
+ */
+static void *memcpy_erms(void *dest, const void *src, uint32 nbytes) {
+  char *d = dest;
+  const char *s = src;
+
+  __asm__ volatile("rep movsb"
+                   : "+D"(d), "+S"(s), "+c"(nbytes)
+                   :
+                   : "memory");
+  return dest;
+}
+
+/**
+ * \brief Copies 32-byte blocks through XMM0 and XMM1 to a 16-byte aligned
+ * destination. The registers may belong to any context, and CR0.TS may be
+ * set, so with interrupts disabled TS is cleared, the registers are saved on
+ * the stack, used and restored, and TS is set again. They are not listed as
+ * clobbered, as explained in fpu.h.
+ * \param [out] d The destination, 16-byte aligned.
+ * \param [in] s The source.
+ * \param [in] blocks The number of blocks, at least one.
+ * \returns None.
+ */
+static void copy_sse2_blocks(char *d, const char *s, uint32 blocks) {
+  const uint32 flags = irq_save();
+  uint8 saved[32];
+  uint32 cr0 = 0;
+
+  __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+  if (cr0 & CR0_TS) {
+    __asm__ volatile("clts");
+  }
+  __asm__ volatile("movdqu %%xmm0, (%0)\n\t"
+                   "movdqu %%xmm1, 16(%0)"
+                   :
+                   : "r"(saved)
+                   : "memory");
+  __asm__ volatile("1:\n\t"
+                   "movdqu (%1), %%xmm0\n\t"
+                   "movdqu 16(%1), %%xmm1\n\t"
+                   "movdqa %%xmm0, (%0)\n\t"
+                   "movdqa %%xmm1, 16(%0)\n\t"
+                   "add $32, %0\n\t"
+                   "add $32, %1\n\t"
+                   "dec %2\n\t"
+                   "jnz 1b"
+                   : "+r"(d), "+r"(s), "+r"(blocks)
+                   :
+                   : "memory", "cc");
+  __asm__ volatile("movdqu (%0), %%xmm0\n\t"
+                   "movdqu 16(%0), %%xmm1"
+                   :
+                   : "r"(saved)
+                   : "memory");
+  if (cr0 & CR0_TS) {
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+  }
+  irq_restore(flags);
+}
+
+/**
+ * \brief Copies through the XMM registers once the destination is 16-byte
+ * aligned, the head and the tail going to memcpy_words(). The blocks go to
+ * copy_sse2_blocks() MEMCPY_SSE2_CHUNK bytes at a time, so that interrupts
+ * are enabled between chunks and a long copy only holds them off for one.
+ * \param [out] dest The destination for the copied bytes.
+ * \param [in] src The start of the address to be copied.
+ * \param [in] nbytes The number of bytes to be copied.
+ * \returns The destination address.
+ */
+static void *memcpy_sse2(void *dest, const void *src, uint32 nbytes) {
+  char *d = dest;
+  const char *s = src;
+  const uint32 head = (-(uint32)d) & 15;
+  uint32 chunk = 0;
+
+  if (nbytes < MEMCPY_SSE2_MIN) {
+    return memcpy_words(dest, src, nbytes);
+  }
+
+  memcpy_words(d, s, head);
+  d += head;
+  s += head;
+  nbytes -= head;
+
+  while (nbytes >= 32) {
+    chunk = nbytes < MEMCPY_SSE2_CHUNK ? nbytes & ~31u : MEMCPY_SSE2_CHUNK;
+    copy_sse2_blocks(d, s, chunk / 32);
+    d += chunk;
+    s += chunk;
+    nbytes -= chunk;
+  }
+
+  memcpy_words(d, s, nbytes);
+  return dest;
+}
+
+/* Bound by cpu_dispatch(), until then the copy that runs anywhere */
+static Cpu_Fn memcpy_fn = (Cpu_Fn)memcpy_words;
+
+static const Cpu_Variant memcpy_variants[] = {
+    {"erms", CPU_ERMS, (Cpu_Fn)memcpy_erms},
+    {"sse2", CPU_FXSR | CPU_SSE | CPU_SSE2, (Cpu_Fn)memcpy_sse2},
+    {"movsd", 0, (Cpu_Fn)memcpy_words},
+};
+
+Cpu_Dispatch memcpy_dispatch = {"memcpy", &memcpy_fn, memcpy_variants,
+                                sizeof(memcpy_variants) /
+                                    sizeof(memcpy_variants[0]),
+                                0};
+
+/**
+ * \desc Calls the bound implementation.
+ */
+void *memcpy(void *dest, const void *src, uint32 nbytes) {
+  return ((Memcpy_Fn)memcpy_fn)(dest, src, nbytes);
+}
+
+/**
+ * \desc Regions that do not overlap, or where the destination is below the
+ * source, are safely copied forwards by memcpy(). Otherwise the copy runs
+ * backwards with the direction flag set: the trailing bytes first, then the
+ * words, so the source is always read before it is overwritten. The direction
+ * flag is cleared again afterwards as the rest of the kernel expects.
+ */
+void *memmove(void *dest, const void *src, uint32 nbytes) {
+  char *d = (char *)dest + nbytes - 1;
+  const char *s = (const char *)src + nbytes - 1;
+  uint32 bytes = nbytes % 4;
+
+  if ((uint32)dest <= (uint32)src ||
+      (uint32)dest >= (uint32)src + nbytes) {
+    return memcpy(dest, src, nbytes);
+  }
+
+  __asm__ volatile("std\n\t"
+                   "rep movsb\n\t"
+                   "sub $3, %%edi\n\t"
+                   "sub $3, %%esi\n\t"
+                   "mov %3, %%ecx\n\t"
+                   "rep movsl\n\t"
+                   "cld"
+                   : "+D"(d), "+S"(s), "+c"(bytes)
+                   : "r"(nbytes / 4)
+                   : "memory");
+  return dest;
+}
+
+/**
+ * \brief Repeats the byte across a word so that the aligned middle of the
+ * region can be filled with rep stosd, with rep stosb for the unaligned head
+ * and the tail.
+ * \param [out] dest The start of the address range.
+ * \param [in] c The value to be written, converted to a byte.
+ * \param [in] nbytes The number of bytes to be written.
+ * \returns The destination address.
+ */
+static void *memset_words(void *dest, int32 c, uint32 nbytes) {
+  char *d = dest;
+  const uint32 fill = (uint8)c * 0x01010101u;
+  uint32 head = (-(uint32)d) & 3;
+  uint32 words = 0;
+
+  if (head > nbytes) {
+    head = nbytes;
+  }
+  nbytes -= head;
+  words = nbytes / 4;
+  nbytes %= 4;
+
+  __asm__ volatile("rep stosb\n\t"
+                   "mov %3, %%ecx\n\t"
+                   "rep stosl\n\t"
+                   "mov %4, %%ecx\n\t"
+                   "rep stosb"
+                   : "+D"(d), "+c"(head)
+                   : "a"(fill), "r"(words), "r"(nbytes)
+                   : "memory");
+  return dest;
+}
+
+/**
+ * \brief Fills with a single rep stosb, which processors with ERMS run as
+ * wide as their caches allow.
+ * \param [out] dest The start of the address range.
+ * \param [in] c The value to be written, converted to a byte.
+ * \param [in] nbytes The number of bytes to be written.
+ * \returns The destination address.
+ */
+static void *memset_erms(void *dest, int32 c, uint32 nbytes) {
+  char *d = dest;
+
+  __asm__ volatile("rep stosb"
+                   : "+D"(d), "+c"(nbytes)
+                   : "a"(c)
+                   : "memory");
+  return dest;
+}
+
+/* Bound by cpu_dispatch(), until then the fill that runs anywhere */
+static Cpu_Fn memset_fn = (Cpu_Fn)memset_words;
+
+static const Cpu_Variant memset_variants[] = {
+    {"erms", CPU_ERMS, (Cpu_Fn)memset_erms},
+    {"stosd", 0, (Cpu_Fn)memset_words},
+};
+
+Cpu_Dispatch memset_dispatch = {"memset", &memset_fn, memset_variants,
+                                sizeof(memset_variants) /
+                                    sizeof(memset_variants[0]),
+                                0};
+
+/**
+ * \desc Calls the bound implementation.
+ */
+void *memset(void *dest, int32 c, uint32 nbytes) {
+  return ((Memset_Fn)memset_fn)(dest, c, nbytes);
+}
+
+/* =============================================================================
+ * KERNEL HEAP
+ * ========================================================================== */
+
+/**
+ * Header at the start of every slab frame. Free objects are linked through
+ * their first word, starting at free.
+ */
+typedef struct Slab {
+  struct Slab *prev; /**< Previous partially used slab of the class */
+  struct Slab *next; /**< Next partially used slab of the class */
+  void *free;        /**< First free object */
+  uint16 size;       /**< Object size in bytes */
+  uint16 used;       /**< Objects handed out */
+  uint16 capacity;   /**< Objects that fit in the slab */
+  uint16 cls;        /**< Size class index */
+} Slab;
+
+/* Objects start after the header, rounded up to 16 bytes */
+#define SLAB_HEADER ((sizeof(Slab) + 15) & ~15)
+
+/**
+ * Per size class list of slabs with at least one free object, alongside the
+ * occupancy counters printed by kmalloc_stats().
+ */
+typedef struct {
+  Slab *partial; /**< Slabs with free objects */
+  uint32 slabs;  /**< Slabs owned by the class */
+  uint32 used;   /**< Objects handed out */
+} Slab_Class;
+
+static Slab_Class slab_classes[KMALLOC_CLASSES];
+static uint32 large_frames = 0;
+
+/* Guards the size classes, their slabs and the large frame count */
+static Spinlock slab_lock;
+
+/**
+ * \brief Finds the highest set bit of a non-zero word.
+ * \param [in] word The word to scan.
+ * \returns The index of the highest set bit.
+ */
+static uint32 highest_bit(uint32 word) {
+  uint32 index = 0;
+  __asm__("bsr %1, %0" : "=r"(index) : "rm"(word));
+  return index;
+}
+
+/**
+ * \brief Maps a request size to its size class.
+ * \param [in] size The number of bytes requested, at most KMALLOC_MAX.
+ * \returns The index of the smallest class that fits the request.
+ */
+static uint32 size_class(uint32 size) {
+  if (size <= KMALLOC_MIN) {
+    return 0;
+  }
+  return highest_bit(size - 1) - 3;
+}
+
+/**
+ * \brief Removes a slab from the partial list of its class.
+ * \param [in] cls The class owning the slab.
+ * \param [in] slab The slab to remove.
+ * \returns None.
+ */
+static void slab_unlink(Slab_Class *cls, Slab *slab) {
+  if (slab->prev != 0) {
+    slab->prev->next = slab->next;
+  } else {
+    cls->partial = slab->next;
+  }
+  if (slab->next != 0) {
+    slab->next->prev = slab->prev;
+  }
+  slab->prev = 0;
+  slab->next = 0;
+}
+
+/**
+ * \brief Adds a slab to the front of the partial list of its class.
+ * \param [in] cls The class owning the slab.
+ * \param [in] slab The slab to add.
+ * \returns None.
+ */
+static void slab_push(Slab_Class *cls, Slab *slab) {
+  slab->prev = 0;
+  slab->next = cls->partial;
+  if (cls->partial != 0) {
+    cls->partial->prev = slab;
+  }
+  cls->partial = slab;
+}
+
+/**
+ * \brief Takes a new frame and carves it into objects of a size class.
+ * \param [in] index The size class index.
+ * \returns The new slab, or zero if no frame is available.
+ */
+static Slab *slab_create(uint32 index) {
+  const uint32 size = KMALLOC_MIN << index;
+  Slab *slab = (Slab *)frame_alloc();
+  char *obj = 0;
+  uint32 i = 0;
+
+  if (slab == 0) {
+    return 0;
+  }
+
+  slab->size = size;
+  slab->used = 0;
+  slab->capacity = (FRAME_SIZE - SLAB_HEADER) / size;
+  slab->cls = index;
+  slab->free = (char *)slab + SLAB_HEADER;
+
+  obj = slab->free;
+  for (i = 0; i + 1 < slab->capacity; ++i, obj += size) {
+    *(void **)obj = obj + size;
+  }
+  *(void **)obj = 0;
+
+  slab_push(&slab_classes[index], slab);
+  ++slab_classes[index].slabs;
+  return slab;
+}
+
+/**
+ * \desc Requests up to KMALLOC_MAX pop the first free object of the first
+ * partially used slab in their class, creating a slab when the class has none.
+ * A slab that becomes full leaves the partial list, so the head always has a
+ * free object. Larger requests of up to a frame take a whole frame, which
+ * kfree() recognises by its page alignment as slab objects never are. Threads,
+ * exception handlers and every processor allocate, so the slab state is only
+ * touched under slab_lock with interrupts disabled.
+ */
+void *kmalloc(uint32 size) {
+  Slab_Class *cls = 0;
+  Slab *slab = 0;
+  void *obj = 0;
+  uint32 index = 0, flags = 0;
+
+  if (size == 0 || size > FRAME_SIZE) {
+    return 0;
+  }
+
+  flags = spin_lock_irqsave(&slab_lock);
+  if (size > KMALLOC_MAX) {
+    obj = (void *)frame_alloc();
+    large_frames += obj != 0;
+    spin_unlock_irqrestore(&slab_lock, flags);
+    return obj;
+  }
+
+  index = size_class(size);
+  cls = &slab_classes[index];
+  slab = cls->partial;
+  if (slab == 0 && (slab = slab_create(index)) == 0) {
+    spin_unlock_irqrestore(&slab_lock, flags);
+    return 0;
+  }
+
+  obj = slab->free;
+  slab->free = *(void **)obj;
+  ++slab->used;
+  ++cls->used;
+
+  if (slab->free == 0) {
+    slab_unlink(cls, slab);
+  }
+  spin_unlock_irqrestore(&slab_lock, flags);
+  return obj;
+}
+
+/**
+ * \desc The owning slab is found by rounding the pointer down to its frame.
+ * The object is pushed onto the free list of the slab, and a slab that was
+ * full rejoins the partial list. A slab left empty is returned to the frame
+ * allocator, unless it is the only slab of its class, to avoid taking and
+ * releasing a frame on every allocation of an otherwise idle class. As in
+ * kmalloc(), this is done under slab_lock.
+ */
+void kfree(void *ptr) {
+  Slab *slab = (Slab *)((uint32)ptr & ~(FRAME_SIZE - 1));
+  Slab_Class *cls = 0;
+  uint32 flags = 0;
+
+  if (ptr == 0) {
+    return;
+  }
+
+  flags = spin_lock_irqsave(&slab_lock);
+  if ((void *)slab == ptr) {
+    frame_free((uint32)ptr);
+    --large_frames;
+    spin_unlock_irqrestore(&slab_lock, flags);
+    return;
+  }
+
+  cls = &slab_classes[slab->cls];
+  if (slab->free == 0) {
+    slab_push(cls, slab);
+  }
+
+  *(void **)ptr = slab->free;
+  slab->free = ptr;
+  --slab->used;
+  --cls->used;
+
+  if (slab->used == 0 && cls->slabs > 1) {
+    slab_unlink(cls, slab);
+    --cls->slabs;
+    frame_free((uint32)slab);
+  }
+  spin_unlock_irqrestore(&slab_lock, flags);
+}
+
+/**
+ * \desc Prints one line per size class with the number of slabs and the
+ * objects in use out of those available, then the number of whole frames.
+ */
+void kmalloc_stats(void) {
+  uint32 i = 0;
+
+  for (i = 0; i < KMALLOC_CLASSES; ++i) {
+    const uint32 size = KMALLOC_MIN << i;
+    kprintf("   %u B: slabs %u, objects %u/%u\n", size, slab_classes[i].slabs,
+            slab_classes[i].used,
+            slab_classes[i].slabs * ((FRAME_SIZE - SLAB_HEADER) / size));
+  }
+  kprintf("   Large: frames %u\n", large_frames);
+}
+
+/**
+ * \desc Runs two passes of KMALLOC_TEST_COUNT allocations: one of 32-byte
+ * objects and one cycling through every size class. Each object is tagged
+ * with its index and checked before being freed, which catches overlapping
+ * objects, and the frame count must be back where it started afterwards.
+ */
+void kmalloc_self_test(void) {
+  static uint32 *objs[KMALLOC_TEST_COUNT];
+  const uint32 frames_before = frame_free_count();
+  uint32 cycles[4] = {0};
+  uint32 pass = 0, i = 0, ok = 1;
+  uint64 start = 0;
+
+  for (pass = 0; pass < 2; ++pass) {
+    start = rdtsc();
+    for (i = 0; i < KMALLOC_TEST_COUNT; ++i) {
+      objs[i] = kmalloc(pass == 0 ? 32 : KMALLOC_MIN << (i % KMALLOC_CLASSES));
+    }
+    cycles[pass * 2] = (uint32)(rdtsc() - start);
+
+    for (i = 0; i < KMALLOC_TEST_COUNT; ++i) {
+      if (objs[i] == 0) {
+        ok = 0;
+        break;
+      }
+      *objs[i] = i;
+    }
+    for (i = 0; ok && i < KMALLOC_TEST_COUNT; ++i) {
+      ok = *objs[i] == i;
+    }
+
+    start = rdtsc();
+    for (i = 0; i < KMALLOC_TEST_COUNT; ++i) {
+      kfree(objs[i]);
+    }
+    cycles[pass * 2 + 1] = (uint32)(rdtsc() - start);
+  }
+
+  /* Each class may keep one empty slab */
+  if (frame_free_count() + KMALLOC_CLASSES < frames_before) {
+    ok = 0;
+  }
+
+  kprintf("Slab allocator: 32 B alloc %u, free %u; mixed alloc %u, free %u "
+          "cycles, %s\n",
+          cycles[0] / KMALLOC_TEST_COUNT, cycles[1] / KMALLOC_TEST_COUNT,
+          cycles[2] / KMALLOC_TEST_COUNT, cycles[3] / KMALLOC_TEST_COUNT,
+          ok ? "OK" : "FAILED");
+}
+
+/* =============================================================================
+ * BENCHMARKS
+ * ========================================================================== */
+
+/**
+ * \brief Prints a number of bytes per cycle to two decimal places.
+ * \param [in] bytes The number of bytes processed.
+ * \param [in] cycles The number of cycles taken.
+ * \returns None.
+ */
+static void print_rate(uint32 bytes, uint32 cycles) {
+  const uint32 rate = cycles ? bytes * 100 / cycles : 0;
+  kprintf("%u.%02u", rate / 100, rate % 100);
+}
 
 /**
- * \desc Loops over a number of bytes specified, copying the memory from the
- * source address plus offset to the destination plus offset.
+ * \brief Times repeated calls of one memory routine.
+ * \param [in] op 0 for memcpy(), 1 for memmove() and 2 for memset().
+ * \param [in] dest The destination buffer.
+ * \param [in] src The source buffer.
+ * \param [in] size The number of bytes per call.
+ * \returns The number of cycles taken by MEMORY_BENCH_REPEAT calls.
  */
-void memcpy(const char *source, char *dest, const uint32 nbytes) {
+static uint32 time_routine(uint32 op, char *dest, const char *src,
+                           uint32 size) {
+  const uint64 start = rdtsc();
   uint32 i = 0;
-  for (i = 0; i < nbytes; ++i) {
-    *(dest + i) = *(source + i);
+
+  for (i = 0; i < MEMORY_BENCH_REPEAT; ++i) {
+    if (op == 0) {
+      memcpy(dest, src, size);
+    } else if (op == 1) {
+      memmove(dest, src, size);
+    } else {
+      memset(dest, i, size);
+    }
+  }
+  return (uint32)(rdtsc() - start);
+}
+
+/**
+ * \brief Checks every memcpy() implementation the processor supports, not
+ * only the bound one, over sizes below, at and above MEMCPY_SSE2_MIN, one of
+ * them no multiple of 16 so that the SSE2 copy has a tail, each aligned and
+ * misaligned. The whole copied range is compared with the source, and the
+ * bytes either side of it must be left zero.
+ * \param [out] dest The destination buffer, a page frame.
+ * \param [in] src The source buffer, a page frame.
+ * \returns Non-zero if every copy was right.
+ */
+static uint32 check_copies(char *dest, const char *src) {
+  static const uint32 sizes[] = {1, 16, 256, 1000, 3840};
+  uint32 v = 0, i = 0, shift = 0, j = 0, ok = 1;
+
+  for (v = 0; v < memcpy_dispatch.count; ++v) {
+    const Cpu_Variant *variant = &memcpy_dispatch.variants[v];
+    if (!cpu_has(variant->features)) {
+      continue;
+    }
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+      for (shift = 0; shift < 2; ++shift) {
+        char *d = dest + 16 + shift;
+        const char *s = src + 3 * shift;
+
+        memset(dest, 0, FRAME_SIZE);
+        if (((Memcpy_Fn)variant->fn)(d, s, sizes[i]) != d) {
+          ok = 0;
+        }
+        for (j = 0; j < sizes[i]; ++j) {
+          ok = ok && d[j] == s[j];
+        }
+        ok = ok && d[-1] == 0 && d[sizes[i]] == 0;
+      }
+    }
+  }
+  return ok;
+}
+
+/**
+ * \desc Each routine is timed over a small copy, a medium copy and a whole
+ * screen of text, first with both buffers word aligned and then with the
+ * destination one byte and the source three bytes past a word boundary. The
+ * buffers are two page frames. It runs once cpu_dispatch() has bound the
+ * routines, so that the bound ones are timed, and every supported memcpy()
+ * is then checked by check_copies().
+ */
+void memory_benchmark(void) {
+  static const uint32 sizes[] = {16, 256, 3840};
+  static const char *names[] = {"memcpy ", ", memmove ", ", memset "};
+  char *dest = (char *)frame_alloc();
+  char *src = (char *)frame_alloc();
+  uint32 i = 0, op = 0, ok = 0;
+
+  if (dest == 0 || src == 0) {
+    frame_free((uint32)dest);
+    frame_free((uint32)src);
+    kprintf("Memory routines: no frames\n");
+    return;
+  }
+
+  for (i = 0; i < FRAME_SIZE; ++i) {
+    src[i] = (char)(i * 7);
   }
+
+  kprintf("Memory routines (B/cycle, aligned/misaligned):\n");
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    const uint32 bytes = sizes[i] * MEMORY_BENCH_REPEAT;
+    kprintf("   %u B: ", sizes[i]);
+
+    for (op = 0; op < 3; ++op) {
+      kprintf("%s", names[op]);
+      print_rate(bytes, time_routine(op, dest, src, sizes[i]));
+      kprintf("/");
+      print_rate(bytes, time_routine(op, dest + 1, src + 3, sizes[i]));
+    }
+    kprintf("\n");
+  }
+
+  ok = check_copies(dest, src);
+  memcpy(src, "0123456789", 10);
+  memmove(src + 2, src, 8);
+  ok = ok && strcmp(memset(dest, 0, 16), "") == 0 &&
+       memcpy(dest, src, 10) == dest && strcmp(dest, "0101234567") == 0;
+  kprintf("   %s\n", ok ? "OK" : "FAILED");
+
+  frame_free((uint32)dest);
+  frame_free((uint32)src);
 }
\ No newline at end of file
@@ -6,7 +6,25 @@
  * \file utils.h
  * \brief Memory function declarations.
  *
- * ...
+ * Alongside the raw memory routines, this file declares the kernel heap. Small
+ * allocations are served from slabs: each slab is one 4 KiB page frame holding
+ * a header followed by equally sized objects, with one list of partially used
+ * slabs per power-of-two size class from KMALLOC_MIN to KMALLOC_MAX. Free
+ * objects are chained through their own first word, so objects carry no
+ * header and kfree() finds the slab by rounding the pointer down to its frame.
+ * Requests above KMALLOC_MAX and up to a frame are given a whole frame.
+ *
+ * memcpy() and memset() are dispatched: with ERMS (enhanced rep movsb and
+ * stosb) a single rep movsb or rep stosb, which such processors run at their
+ * full width whatever the alignment; without it but with SSE2, copies of at
+ * least MEMCPY_SSE2_MIN bytes are moved 32 bytes at a time through XMM0 and
+ * XMM1; otherwise, and before binding, the aligned rep movsd and rep stosd
+ * loops. The SSE2 copy may run in an interrupt handler or with the registers
+ * belonging to another context, so it saves the two registers it uses and
+ * restores them, and CR0.TS, with interrupts disabled in between. That costs
+ * too much for short copies, hence the minimum. Long copies are split into
+ * chunks of MEMCPY_SSE2_CHUNK bytes, each saving and restoring on its own, so
+ * that interrupts are only held off for one chunk at a time.
  *
  * \author Anthony Mercer
  *
@@ -16,14 +34,95 @@
 #define MEMORY_H
 
 #include "types.h"
+#include "../cpu/cpuid.h"
+
+/* Number of calls per timing in memory_benchmark() */
+#define MEMORY_BENCH_REPEAT 64
+
+/* Shortest copy the SSE2 memcpy() moves through the XMM registers */
+#define MEMCPY_SSE2_MIN 512
+
+/* Most bytes the SSE2 memcpy() copies with interrupts disabled, 32-aligned */
+#define MEMCPY_SSE2_CHUNK 4096
+
+/* The implementations memcpy() and memset() are bound to by cpu_dispatch() */
+extern Cpu_Dispatch memcpy_dispatch;
+extern Cpu_Dispatch memset_dispatch;
+
+/**
+ * \brief Copies memory from one address range to another, through the
+ * implementation bound by cpu_dispatch().
+ * \param [out] dest The destination for the copied bytes.
+ * \param [in] src The start of the address to be copied.
+ * \param [in] nbytes The number of bytes to be copied.
+ * \returns The destination address.
+ */
+void *memcpy(void *dest, const void *src, uint32 nbytes);
 
 /**
- * \brief Copies memory from one address range to another.
- * \param [in] source The start of the address to be copied.
- * \param [in] dest The destination for the copied bytes.
+ * \brief Copies memory between address ranges which may overlap.
+ * \param [out] dest The destination for the copied bytes.
+ * \param [in] src The start of the address to be copied.
  * \param [in] nbytes The number of bytes to be copied.
+ * \returns The destination address.
+ */
+void *memmove(void *dest, const void *src, uint32 nbytes);
+
+/**
+ * \brief Fills an address range with a byte, through the implementation
+ * bound by cpu_dispatch().
+ * \param [out] dest The start of the address range.
+ * \param [in] c The value to be written, converted to a byte.
+ * \param [in] nbytes The number of bytes to be written.
+ * \returns The destination address.
+ */
+void *memset(void *dest, int32 c, uint32 nbytes);
+
+/**
+ * \brief Times memcpy(), memmove() and memset() over several sizes and
+ * alignments, printing the bytes processed per cycle.
+ * \param None.
+ * \returns None.
+ */
+void memory_benchmark(void);
+
+/* Smallest and largest slab object sizes */
+#define KMALLOC_MIN 16
+#define KMALLOC_MAX 2048
+
+/* Number of power-of-two size classes between KMALLOC_MIN and KMALLOC_MAX */
+#define KMALLOC_CLASSES 8
+
+/* Number of objects allocated by the boot-time benchmark */
+#define KMALLOC_TEST_COUNT 512
+
+/**
+ * \brief Allocates memory from the kernel heap.
+ * \param [in] size The number of bytes required, at most one frame.
+ * \returns The address of the memory, or zero if none is available.
+ */
+void *kmalloc(uint32 size);
+
+/**
+ * \brief Returns memory from kmalloc() to the kernel heap.
+ * \param [in] ptr The address returned by kmalloc(), or zero.
+ * \returns None.
+ */
+void kfree(void *ptr);
+
+/**
+ * \brief Prints the slab occupancy of every size class.
+ * \param None.
+ * \returns None.
+ */
+void kmalloc_stats(void);
+
+/**
+ * \brief Allocates and frees batches of objects, checking the results and
+ * printing the number of cycles taken per object.
+ * \param None.
  * \returns None.
  */
-void memcpy(const char *source, char *dest, const uint32 nbytes);
+void kmalloc_self_test(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,263 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file printf.c
+ * \brief Formatted printing implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "printf.h"
+#include "string.h"
+
+/* Registered sinks, unused entries zero */
+static Print_Sink sinks[KPRINTF_SINKS] = {0};
+
+/**
+ * The state of one formatting: the buffer written to and the length of the
+ * whole output, which goes on counting once the buffer is full.
+ */
+typedef struct {
+  String_Buffer sb; /**< The buffer */
+  uint32 total;     /**< Characters output, written or not */
+} Format;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Outputs a character repeatedly.
+ * \param [in,out] out The formatting.
+ * \param [in] c The character.
+ * \param [in] count The times to output it.
+ * \returns None.
+ */
+static void put_repeat(Format *out, char c, uint32 count) {
+  for (; count > 0; --count) {
+    strbuf_app(&out->sb, c);
+    ++out->total;
+  }
+}
+
+/**
+ * \brief Outputs a string.
+ * \param [in,out] out The formatting.
+ * \param [in] str The string.
+ * \param [in] len Its length.
+ * \returns None.
+ */
+static void put_string(Format *out, const char *str, uint32 len) {
+  uint32 i = 0;
+
+  for (i = 0; i < len; ++i) {
+    strbuf_app(&out->sb, str[i]);
+  }
+  out->total += len;
+}
+
+/**
+ * \brief Outputs a field padded to a width. Zero padding goes between the
+ * prefix and the body, so that it follows a minus sign or 0x, and is only
+ * used when justifying right.
+ * \param [in,out] out The formatting.
+ * \param [in] prefix The sign or 0x, possibly empty.
+ * \param [in] body The digits or text.
+ * \param [in] len The length of body.
+ * \param [in] width The minimum width of the field.
+ * \param [in] left Non-zero to justify left, padding with spaces after.
+ * \param [in] zero Non-zero to pad with zeros rather than spaces.
+ * \returns None.
+ */
+static void put_field(Format *out, const char *prefix, const char *body,
+                      uint32 len, uint32 width, uint32 left, uint32 zero) {
+  const uint32 prefix_len = strlen(prefix);
+  const uint32 pad = width > prefix_len + len ? width - prefix_len - len : 0;
+
+  if (!left && !zero) {
+    put_repeat(out, ' ', pad);
+  }
+  put_string(out, prefix, prefix_len);
+  if (!left && zero) {
+    put_repeat(out, '0', pad);
+  }
+  put_string(out, body, len);
+  if (left) {
+    put_repeat(out, ' ', pad);
+  }
+}
+
+/**
+ * \brief Converts a number to digits, from the least significant, at the end
+ * of a buffer, so that no reversal is needed.
+ * \param [in] n The number.
+ * \param [in] base 10 or 16.
+ * \param [in] min_digits The fewest digits, leading zeros filling the rest.
+ * \param [out] end One past the end of the digits to be written.
+ * \returns The first digit.
+ */
+static char *to_digits(uint32 n, uint32 base, uint32 min_digits, char *end) {
+  char *digit = end;
+
+  do {
+    *--digit = hexdigit(n % base);
+    n /= base;
+  } while (n > 0 || (uint32)(end - digit) < min_digits);
+  return digit;
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc Characters other than % are output as they are. For a conversion the
+ * flags and width are read first, then the conversion character picks the
+ * argument. An unknown conversion is output as it was written. A buffer of
+ * size zero is given a one byte stand-in, so that only the count is kept.
+ */
+uint32 kvsnprintf(char *buf, uint32 size, const char *fmt, kva_list args) {
+  char digits[12];
+  char *const end = digits + sizeof(digits);
+  char none = '\0';
+  Format out;
+  uint32 i = 0;
+
+  strbuf_init(&out.sb, size ? buf : &none, size ? size : 1);
+  out.total = 0;
+
+  while (fmt[i] != '\0') {
+    uint32 left = 0, zero = 0, width = 0, start = i;
+    const char *str = 0;
+    char c = '\0';
+
+    if (fmt[i] != '%') {
+      put_string(&out, &fmt[i++], 1);
+      continue;
+    }
+
+    for (++i; fmt[i] == '-' || fmt[i] == '0'; ++i) {
+      left |= fmt[i] == '-';
+      zero |= fmt[i] == '0';
+    }
+    for (; fmt[i] >= '0' && fmt[i] <= '9'; ++i) {
+      width = width * 10 + (uint32)(fmt[i] - '0');
+    }
+
+    switch (fmt[i]) {
+    case 'd': {
+      const int32 n = kva_arg(args, int32);
+      str = to_digits(n < 0 ? 0u - (uint32)n : (uint32)n, 10, 1, end);
+      put_field(&out, n < 0 ? "-" : "", str, end - str, width, left, zero);
+      break;
+    }
+    case 'u':
+      str = to_digits(kva_arg(args, uint32), 10, 1, end);
+      put_field(&out, "", str, end - str, width, left, zero);
+      break;
+    case 'x':
+      str = to_digits(kva_arg(args, uint32), 16, 1, end);
+      put_field(&out, "", str, end - str, width, left, zero);
+      break;
+    case 'p':
+      str = to_digits((uint32)kva_arg(args, void *), 16, 8, end);
+      put_field(&out, "0x", str, end - str, width, left, zero);
+      break;
+    case 's':
+      str = kva_arg(args, const char *);
+      str = str ? str : "(null)";
+      put_field(&out, "", str, strlen(str), width, left, 0);
+      break;
+    case 'c':
+      c = (char)kva_arg(args, int32);
+      put_field(&out, "", &c, 1, width, left, 0);
+      break;
+    case '%':
+      put_string(&out, "%", 1);
+      break;
+    default:
+      if (fmt[i] == '\0') {
+        put_string(&out, &fmt[start], i - start);
+        continue;
+      }
+      put_string(&out, &fmt[start], i + 1 - start);
+      break;
+    }
+    ++i;
+  }
+
+  return out.total;
+}
+
+/**
+ * \desc Gathers the arguments for kvsnprintf().
+ */
+uint32 ksnprintf(char *buf, uint32 size, const char *fmt, ...) {
+  kva_list args;
+  uint32 len = 0;
+
+  kva_start(args, fmt);
+  len = kvsnprintf(buf, size, fmt, args);
+  kva_end(args);
+  return len;
+}
+
+/**
+ * \desc The output is formatted onto the stack, truncated at KPRINTF_BUFFER -
+ * 1 characters, and then passed whole to each sink in the order registered.
+ */
+uint32 kprintf(const char *fmt, ...) {
+  char buf[KPRINTF_BUFFER];
+  kva_list args;
+  uint32 len = 0, i = 0;
+
+  kva_start(args, fmt);
+  len = kvsnprintf(buf, sizeof(buf), fmt, args);
+  kva_end(args);
+
+  if (len >= sizeof(buf)) {
+    len = sizeof(buf) - 1;
+  }
+  for (i = 0; i < KPRINTF_SINKS; ++i) {
+    if (sinks[i] != 0) {
+      sinks[i](buf, len);
+    }
+  }
+  return len;
+}
+
+/**
+ * \desc The sink takes the first free entry, unless it already has one.
+ */
+uint32 kprintf_add_sink(Print_Sink sink) {
+  uint32 i = 0;
+
+  for (i = 0; i < KPRINTF_SINKS; ++i) {
+    if (sinks[i] == sink) {
+      return 1;
+    }
+  }
+  for (i = 0; i < KPRINTF_SINKS; ++i) {
+    if (sinks[i] == 0) {
+      sinks[i] = sink;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * \desc The entry of the sink is freed, if it has one.
+ */
+void kprintf_remove_sink(Print_Sink sink) {
+  uint32 i = 0;
+
+  for (i = 0; i < KPRINTF_SINKS; ++i) {
+    if (sinks[i] == sink) {
+      sinks[i] = 0;
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file printf.h
+ * \brief Formatted printing declarations.
+ *
+ * ksnprintf() formats into a buffer in a single pass over the format string,
+ * each conversion written straight into the buffer through a string buffer.
+ * The conversions are %d, %u, %x, %s, %c, %p and %%, each optionally preceded
+ * by a minus flag to justify left, a zero flag to pad numbers with zeros
+ * rather than spaces, and a minimum field width. %p gives 0x and eight hex
+ * digits, while %x gives no prefix and no leading zeros.
+ *
+ * kprintf() formats onto the stack and then hands the whole result to every
+ * registered sink in one call, so a line is written to each output in one
+ * batch rather than piece by piece. Sinks are registered at boot; the screen
+ * sink prints, which mirrors to the serial port, the serial sink writes only
+ * to the serial port and the trace sink records the text in the trace buffer.
+ *
+ * The variable arguments use the compiler built-ins directly, as the kernel is
+ * built without the standard headers, and the compiler checks the arguments
+ * of each call against its format string as it would for printf().
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef PRINTF_H
+#define PRINTF_H
+
+#include "types.h"
+
+/* Variable arguments, from the compiler */
+typedef __builtin_va_list kva_list;
+#define kva_start(args, last) __builtin_va_start(args, last)
+#define kva_arg(args, type) __builtin_va_arg(args, type)
+#define kva_end(args) __builtin_va_end(args)
+
+/* Longest output of a single kprintf(), the null included */
+#define KPRINTF_BUFFER 256
+
+/* Sinks that can be registered at once */
+#define KPRINTF_SINKS 4
+
+/* Function pointer definition for sinks, given the text and its length; the
+ * text is also null terminated */
+typedef void (*Print_Sink)(const char *str, uint32 len);
+
+/**
+ * \brief Formats into a buffer, truncating to fit.
+ * \param [out] buf The buffer, always null terminated unless size is zero.
+ * \param [in] size The size of buf.
+ * \param [in] fmt The format string.
+ * \param [in] args The arguments of the conversions.
+ * \returns The length of the whole output, which was truncated if this is not
+ * below size.
+ */
+uint32 kvsnprintf(char *buf, uint32 size, const char *fmt, kva_list args);
+
+/**
+ * \brief Formats into a buffer, truncating to fit.
+ * \param [out] buf The buffer, always null terminated unless size is zero.
+ * \param [in] size The size of buf.
+ * \param [in] fmt The format string, followed by the arguments.
+ * \returns The length of the whole output, which was truncated if this is not
+ * below size.
+ */
+uint32 ksnprintf(char *buf, uint32 size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * \brief Formats and writes the result to every registered sink.
+ * \param [in] fmt The format string, followed by the arguments.
+ * \returns The number of characters written, at most KPRINTF_BUFFER - 1.
+ */
+uint32 kprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * \brief Registers a sink to receive the output of kprintf().
+ * \param [in] sink The sink.
+ * \returns Non-zero if it was registered or already was.
+ */
+uint32 kprintf_add_sink(Print_Sink sink);
+
+/**
+ * \brief Stops a sink receiving the output of kprintf().
+ * \param [in] sink The sink.
+ * \returns None.
+ */
+void kprintf_remove_sink(Print_Sink sink);
+
+#endif
\ No newline at end of file
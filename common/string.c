@@ -12,79 +12,46 @@
 
 #include "string.h"
 
+/* Longest strings of itostr() and xtostr(), the null included */
+#define ITOSTR_LEN 12
+#define XTOSTR_LEN 11
+
+/* Digits of the hexadecimal conversions */
+static const char hex_digits[] = "0123456789abcdef";
+
 /* =============================================================================
  * STRING FUNCTIONS
  * ========================================================================== */
 
 /**
- * \desc Receives an signed integer and converts it to a string of ASCII
- * characters including minus symbol. The output is written to memory starting
- * at the received pointer and ends with null termination. The string is in
- * reverse order to must be flipped. Firstly the sign of n is found, and if is
- * negative, makes n positive. The sign is saved for later to append the minus
- * symbol. The remainder of n and 10 is the number required, and is so added to
- * ASCII 0. This occurs whilst the current character is numeric.
+ * \desc Converts the number in a string buffer over str, sized for the most
+ * negative number and its minus sign.
  */
 void itostr(int32 n, char *str) {
-  uint32 i = 0;
-  int32 sign = n;
+  String_Buffer sb;
 
-  n = (sign < 0) ? -n : n;
-
-  do {
-    str[i++] = n % 10 + '0';
-  } while ((n /= 10) > 0);
-
-  if (sign < 0) {
-    str[i++] = '-';
-  }
-  str[i] = '\0';
-
-  strrev(str);
+  strbuf_init(&sb, str, ITOSTR_LEN);
+  strbuf_itostr(&sb, n);
 }
 
 /**
- * \desc Receives an signed integer and converts it to a string of ASCII
- * characters including minus symbol. The output is written to memory starting
- * at the received pointer and ends with null termination. The string is in
- * reverse order to must be flipped. Firstly the sign of n is found, and if is
- * negative, makes n positive. The sign is saved for later to append the minus
- * symbol. The remainder of n and 10 is the number required, and is so added to
- * ASCII 0. This occurs whilst the current character is numeric. The leading
- * zeroes of the hex value are not output.
+ * \desc Appends the number through a string buffer over str, which starts at
+ * the present end of str and has room for the prefix and eight digits.
  */
 void xtostr(int32 n, char *str) {
-  uint32 tmp = 0;
-  uint32 i = 0;
-  char zeros = 0;
-  strapp(str, '0');
-  strapp(str, 'x');
-  if (n < 0x10) {
-    strapp(str, '0');
-  }
-
-  for (i = 28; i > 0; i -= 4) {
-    tmp = (n >> i) & 0xF;
-    if (tmp == 0 && zeros == 0) {
-      continue;
-    }
+  String_Buffer sb;
 
-    zeros = 1;
-    if (tmp >= 0xA) {
-      strapp(str, tmp - 0xA + 'a');
-    } else {
-      strapp(str, tmp + '0');
-    }
-  }
-
-  tmp = n & 0xF;
-  if (tmp >= 0xA) {
-    strapp(str, tmp - 0xA + 'a');
-  } else {
-    strapp(str, tmp + '0');
-  }
+  sb.data = str;
+  sb.len = strlen(str);
+  sb.cap = sb.len + XTOSTR_LEN;
+  strbuf_xtostr(&sb, (uint32)n);
 }
 
+/**
+ * \desc Indexes a table of the sixteen digits.
+ */
+char hexdigit(uint32 n) { return hex_digits[n & 0xF]; }
+
 /**
  * /desc Iterate through the string from beginning to end and end to beginning
  * simutaneously swapping str[0] with str[n], str[1] with str[n - 1] etc. Note
@@ -125,16 +92,16 @@ void strapp(char *str, const char n) {
 }
 
 /**
- * \desc Loops through the characters in string to be concatenated (s2) and
- * appends each character to the modified string (s1).
+ * \desc Finds the end of the modified string (s1) once, then copies the
+ * characters of the string to be concatenated (s2) there, null included.
  */
 void strcat(char *s1, const char *s2) {
   uint32 i = 0;
-  const uint32 len2 = strlen(s2);
+  const uint32 len1 = strlen(s1);
 
-  for (i = 0; i < len2; ++i) {
-    strapp(s1, s2[i]);
-  }
+  do {
+    s1[len1 + i] = s2[i];
+  } while (s2[i++] != '\0');
 }
 
 /**
@@ -169,4 +136,107 @@ int8 strcmp(const char *str1, const char *str2) {
  */
 void strclr(char *str) {
   str[0] = '\0';
+}
+
+/* =============================================================================
+ * STRING BUFFER FUNCTIONS
+ * ========================================================================== */
+
+/**
+ * \desc Records the memory and its size and sets the first character to the
+ * null terminator.
+ */
+void strbuf_init(String_Buffer *sb, char *data, uint32 cap) {
+  sb->data = data;
+  sb->len = 0;
+  sb->cap = cap;
+  data[0] = '\0';
+}
+
+/**
+ * \desc The character goes where the null terminator was, and the terminator
+ * after it, provided there is room for both.
+ */
+uint32 strbuf_app(String_Buffer *sb, const char c) {
+  if (sb->len + 1 >= sb->cap) {
+    return 0;
+  }
+
+  sb->data[sb->len++] = c;
+  sb->data[sb->len] = '\0';
+  return 1;
+}
+
+/**
+ * \desc Appends the characters of str one at a time until its null
+ * terminator or the buffer is full.
+ */
+uint32 strbuf_cat(String_Buffer *sb, const char *str) {
+  uint32 i = 0;
+
+  while (str[i] != '\0' && strbuf_app(sb, str[i])) {
+    ++i;
+  }
+  return i;
+}
+
+/**
+ * \desc Moves the null terminator back over the last character.
+ */
+uint32 strbuf_bs(String_Buffer *sb) {
+  if (sb->len == 0) {
+    return 0;
+  }
+
+  sb->data[--sb->len] = '\0';
+  return 1;
+}
+
+/**
+ * \desc Sets the length to zero and the first character to the null
+ * terminator.
+ */
+void strbuf_clr(String_Buffer *sb) {
+  sb->len = 0;
+  sb->data[0] = '\0';
+}
+
+/**
+ * \desc The digits are found from the least significant, so they are kept
+ * on the stack and appended in reverse, after the minus sign. The magnitude is
+ * unsigned so that the most negative number, which has no positive, works.
+ */
+uint32 strbuf_itostr(String_Buffer *sb, int32 n) {
+  char digits[ITOSTR_LEN];
+  uint32 magnitude = (n < 0) ? 0u - (uint32)n : (uint32)n;
+  uint32 count = 0, ok = 1;
+
+  do {
+    digits[count++] = magnitude % 10 + '0';
+  } while ((magnitude /= 10) > 0);
+
+  if (n < 0) {
+    ok = strbuf_app(sb, '-');
+  }
+  while (count > 0) {
+    ok = strbuf_app(sb, digits[--count]) && ok;
+  }
+  return ok;
+}
+
+/**
+ * \desc Leading zero digits are skipped, apart from the last two, and the
+ * rest are appended from the most significant.
+ */
+uint32 strbuf_xtostr(String_Buffer *sb, uint32 n) {
+  int32 shift = 28;
+  uint32 ok = strbuf_cat(sb, "0x") == 2;
+
+  while (shift > 4 && (n >> shift) == 0) {
+    shift -= 4;
+  }
+  for (; shift >= 0; shift -= 4) {
+    ok = strbuf_app(sb, hex_digits[(n >> shift) & 0xF]) && ok;
+  }
+  return ok;
 }
\ No newline at end of file
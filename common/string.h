@@ -17,6 +17,17 @@
 
 #include "types.h"
 
+/**
+ * A bounded string that keeps its length, so that appending and removing a
+ * character cost the same however long the string is. The characters are
+ * always null terminated, so data can be passed wherever a string is taken.
+ */
+typedef struct {
+  char *data; /**< The characters, null terminated */
+  uint32 len; /**< Characters held, the null excluded */
+  uint32 cap; /**< Size of data, the null included */
+} String_Buffer;
+
 /**
  * \brief Converts an signed integer to ASCII representation.
  * \param [in] n The number to be converted.
@@ -33,6 +44,13 @@ void itostr(int32 n, char *str);
  */
 void xtostr(int32 n, char *str);
 
+/**
+ * \brief Gets the hexadecimal digit of a number's lowest four bits.
+ * \param [in] n The number.
+ * \returns The digit, in lower case.
+ */
+char hexdigit(uint32 n);
+
 /**
  * \brief Reverses a whole string.
  * \param [in] The string to be reversed.
@@ -86,4 +104,60 @@ int8 strcmp(const char *s1, const char *s2);
  */
 void strclr(char *str);
 
+/**
+ * \brief Sets up a string buffer over memory, holding the empty string.
+ * \param [out] sb The string buffer.
+ * \param [in] data The memory for the characters.
+ * \param [in] cap The size of data, at least one for the null.
+ * \returns None.
+ */
+void strbuf_init(String_Buffer *sb, char *data, uint32 cap);
+
+/**
+ * \brief Appends a character to a string buffer.
+ * \param [in,out] sb The string buffer.
+ * \param [in] c The character to be appended.
+ * \returns Non-zero if there was room for it.
+ */
+uint32 strbuf_app(String_Buffer *sb, const char c);
+
+/**
+ * \brief Appends as much of a string to a string buffer as there is room for.
+ * \param [in,out] sb The string buffer.
+ * \param [in] str The string to be appended.
+ * \returns The number of characters appended.
+ */
+uint32 strbuf_cat(String_Buffer *sb, const char *str);
+
+/**
+ * \brief Removes the last character of a string buffer.
+ * \param [in,out] sb The string buffer.
+ * \returns Non-zero if there was a character to remove.
+ */
+uint32 strbuf_bs(String_Buffer *sb);
+
+/**
+ * \brief Empties a string buffer.
+ * \param [out] sb The string buffer.
+ * \returns None.
+ */
+void strbuf_clr(String_Buffer *sb);
+
+/**
+ * \brief Appends a signed integer in decimal to a string buffer.
+ * \param [in,out] sb The string buffer.
+ * \param [in] n The number to be converted.
+ * \returns Non-zero if there was room for every digit.
+ */
+uint32 strbuf_itostr(String_Buffer *sb, int32 n);
+
+/**
+ * \brief Appends a number in hexadecimal, with a 0x prefix and at least two
+ * digits, to a string buffer.
+ * \param [in,out] sb The string buffer.
+ * \param [in] n The number to be converted.
+ * \returns Non-zero if there was room for every digit.
+ */
+uint32 strbuf_xtostr(String_Buffer *sb, uint32 n);
+
 #endif
\ No newline at end of file
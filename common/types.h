@@ -7,7 +7,7 @@
  * \brief Typedefs and common constants.
  *
  * The fundamental integer types are redefined here for brevity. They include
- * signed and unsigned integers from 8-bits to 32-bits. This file also defines
+ * signed and unsigned integers from 8-bits to 64-bits. This file also defines
  * common constants and macros that are used throughout the operating system.
  *
  * \author Anthony Mercer
@@ -23,6 +23,8 @@ typedef unsigned short uint16;
 typedef signed short int16;
 typedef unsigned int uint32;
 typedef signed int int32;
+typedef unsigned long long uint64;
+typedef signed long long int64;
 
 /* Macros to get the lower/upper bits from integer types. */
 #define lo8(addr) (uint8)((addr)&0xFF)
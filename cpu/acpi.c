@@ -0,0 +1,127 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file acpi.c
+ * \brief ACPI table discovery implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "acpi.h"
+
+static const Acpi_Header *rsdt = 0;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Adds up a range of bytes.
+ * \param [in] ptr The first byte.
+ * \param [in] length The number of bytes.
+ * \returns The sum modulo 256, zero for a valid ACPI structure.
+ */
+static uint8 checksum(const void *ptr, uint32 length) {
+  const uint8 *bytes = (const uint8 *)ptr;
+  uint8 sum = 0;
+  uint32 i = 0;
+
+  for (i = 0; i < length; ++i) {
+    sum += bytes[i];
+  }
+  return sum;
+}
+
+/**
+ * \brief Compares a fixed number of characters.
+ * \param [in] a The first string.
+ * \param [in] b The second string.
+ * \param [in] n The number of characters.
+ * \returns Non-zero if the characters match.
+ */
+static uint32 matches(const char *a, const char *b, uint32 n) {
+  uint32 i = 0;
+
+  for (i = 0; i < n; ++i) {
+    if (a[i] != b[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * \brief Scans a range on 16-byte boundaries for a valid RSDP.
+ * \param [in] start The first address.
+ * \param [in] end One past the last address.
+ * \returns The RSDP, or zero if it is not in the range.
+ */
+static const Acpi_Rsdp *find_rsdp(uint32 start, uint32 end) {
+  uint32 addr = 0;
+
+  for (addr = start; addr + sizeof(Acpi_Rsdp) <= end; addr += 16) {
+    const Acpi_Rsdp *rsdp = (const Acpi_Rsdp *)addr;
+    if (matches(rsdp->signature, "RSD PTR ", 8) &&
+        checksum(rsdp, sizeof(Acpi_Rsdp)) == 0) {
+      return rsdp;
+    }
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc The RSDT is used for every revision: later revisions add the 64-bit
+ * XSDT, but keep the RSDT for tables below 4 GiB, which is all the kernel can
+ * reach anyway.
+ */
+uint32 init_acpi(void) {
+  const uint32 ebda = (uint32)*(const uint16 *)EBDA_SEGMENT_PTR << 4;
+  const Acpi_Rsdp *rsdp = 0;
+
+  if (ebda != 0) {
+    rsdp = find_rsdp(ebda, ebda + 1024);
+  }
+  if (rsdp == 0) {
+    rsdp = find_rsdp(BIOS_AREA_START, BIOS_AREA_END);
+  }
+  if (rsdp == 0) {
+    return 0;
+  }
+
+  rsdt = (const Acpi_Header *)rsdp->rsdt;
+  if (!matches(rsdt->signature, "RSDT", 4) ||
+      checksum(rsdt, rsdt->length) != 0) {
+    rsdt = 0;
+  }
+  return rsdt != 0;
+}
+
+/**
+ * \desc The RSDT entries follow its header as 32-bit physical addresses.
+ */
+const Acpi_Header *acpi_find_table(const char *signature) {
+  const uint32 *entries = 0;
+  uint32 i = 0, count = 0;
+
+  if (rsdt == 0) {
+    return 0;
+  }
+
+  entries = (const uint32 *)(rsdt + 1);
+  count = (rsdt->length - sizeof(Acpi_Header)) / 4;
+  for (i = 0; i < count; ++i) {
+    const Acpi_Header *table = (const Acpi_Header *)entries[i];
+    if (matches(table->signature, signature, 4) &&
+        checksum(table, table->length) == 0) {
+      return table;
+    }
+  }
+  return 0;
+}
\ No newline at end of file
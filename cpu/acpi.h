@@ -0,0 +1,73 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file acpi.h
+ * \brief ACPI table discovery declarations.
+ *
+ * The firmware describes the machine through ACPI tables. The root system
+ * description pointer (RSDP) is found by scanning the first KiB of the
+ * extended BIOS data area and the BIOS area from 0xE0000 to 0xFFFFF for its
+ * signature on 16-byte boundaries. It points to the root system description
+ * table (RSDT), which lists the 32-bit physical addresses of every other
+ * table. The kernel runs without paging, so the tables are read in place.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "../common/types.h"
+
+/* Where the real mode segment of the extended BIOS data area is kept */
+#define EBDA_SEGMENT_PTR 0x40E
+
+/* BIOS read-only memory area searched for the RSDP */
+#define BIOS_AREA_START 0xE0000
+#define BIOS_AREA_END 0x100000
+
+/**
+ * The root system description pointer. This structure must be packed.
+ */
+typedef struct {
+  char signature[8]; /**< "RSD PTR " */
+  uint8 checksum;    /**< Makes the first 20 bytes sum to zero */
+  char oem_id[6];    /**< Firmware vendor */
+  uint8 revision;    /**< Zero for ACPI 1.0, two for later versions */
+  uint32 rsdt;       /**< Physical address of the RSDT */
+} __attribute__((packed)) Acpi_Rsdp;
+
+/**
+ * The header shared by every system description table. This structure must be
+ * packed.
+ */
+typedef struct {
+  char signature[4];       /**< Table identifier, e.g. "APIC" */
+  uint32 length;           /**< Size of the table including this header */
+  uint8 revision;          /**< Table revision */
+  uint8 checksum;          /**< Makes the whole table sum to zero */
+  char oem_id[6];          /**< Firmware vendor */
+  char oem_table_id[8];    /**< Vendor table identifier */
+  uint32 oem_revision;     /**< Vendor table revision */
+  uint32 creator_id;       /**< Table compiler vendor */
+  uint32 creator_revision; /**< Table compiler revision */
+} __attribute__((packed)) Acpi_Header;
+
+/**
+ * \brief Finds the RSDP and checks the RSDT it points to.
+ * \param None.
+ * \returns Non-zero if the ACPI tables were found.
+ */
+uint32 init_acpi(void);
+
+/**
+ * \brief Finds a table listed in the RSDT.
+ * \param [in] signature The four character table signature.
+ * \returns The table, or zero if it is not present or its checksum fails.
+ */
+const Acpi_Header *acpi_find_table(const char *signature);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,386 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file apic.c
+ * \brief Local APIC and I/O APIC implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "apic.h"
+#include "../common/atomic.h"
+#include "../common/math.h"
+#include "../common/printf.h"
+#include "acpi.h"
+#include "cpuid.h"
+#include "isr.h"
+#include "ports.h"
+#include "timer.h"
+
+/* 8259 PIC data ports, written with the interrupt mask */
+#define PIC1_DATA 0x21
+#define PIC2_DATA 0xA1
+
+/**
+ * The MADT header, followed by its variable length entries. This structure
+ * must be packed.
+ */
+typedef struct {
+  Acpi_Header header; /**< Standard table header, signature "APIC" */
+  uint32 lapic;       /**< Physical address of the local APICs */
+  uint32 flags;       /**< Bit 0 set if 8259 PICs are also present */
+} __attribute__((packed)) Madt;
+
+static volatile uint32 *lapic = 0;
+static volatile uint32 *ioapic = 0;
+static uint32 ioapic_gsi_base = 0;
+static uint32 active = 0;
+
+static uint32 cpu_ids[MAX_CPUS];
+static uint32 cpu_count = 0;
+
+/* Global system interrupt and MPS flags of each ISA interrupt */
+static uint32 isa_gsi[ISA_IRQS];
+static uint16 isa_flags[ISA_IRQS];
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Reads a model-specific register.
+ * \param [in] msr The register number.
+ * \returns The value of the register.
+ */
+static uint64 rdmsr(uint32 msr) {
+  uint64 value = 0;
+  __asm__ volatile("rdmsr" : "=A"(value) : "c"(msr));
+  return value;
+}
+
+/**
+ * \brief Writes a model-specific register.
+ * \param [in] msr The register number.
+ * \param [in] value The value to write.
+ * \returns None.
+ */
+static void wrmsr(uint32 msr, uint64 value) {
+  __asm__ volatile("wrmsr" : : "c"(msr), "A"(value));
+}
+
+/**
+ * \brief Reads a local APIC register.
+ * \param [in] reg The register offset.
+ * \returns The value of the register.
+ */
+static uint32 lapic_read(uint32 reg) { return lapic[reg / 4]; }
+
+/**
+ * \brief Writes a local APIC register.
+ * \param [in] reg The register offset.
+ * \param [in] value The value to write.
+ * \returns None.
+ */
+static void lapic_write(uint32 reg, uint32 value) { lapic[reg / 4] = value; }
+
+/**
+ * \brief Reads an I/O APIC register through the index and data window.
+ * \param [in] reg The register index.
+ * \returns The value of the register.
+ */
+static uint32 ioapic_read(uint32 reg) {
+  ioapic[IOAPIC_INDEX / 4] = reg;
+  return ioapic[IOAPIC_DATA / 4];
+}
+
+/**
+ * \brief Writes an I/O APIC register through the index and data window.
+ * \param [in] reg The register index.
+ * \param [in] value The value to write.
+ * \returns None.
+ */
+static void ioapic_write(uint32 reg, uint32 value) {
+  ioapic[IOAPIC_INDEX / 4] = reg;
+  ioapic[IOAPIC_DATA / 4] = value;
+}
+
+/**
+ * \brief Gets the number of redirection entries of the I/O APIC.
+ * \param None.
+ * \returns The entry count.
+ */
+static uint32 ioapic_entries(void) {
+  return ((ioapic_read(IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+}
+
+/**
+ * \brief Records the processors, the first I/O APIC and the ISA overrides
+ * listed in the MADT. Each entry starts with its type and length.
+ * \param [in] madt The MADT.
+ * \returns None.
+ */
+static void parse_madt(const Madt *madt) {
+  const uint8 *entry = (const uint8 *)(madt + 1);
+  const uint8 *end = (const uint8 *)madt + madt->header.length;
+  uint32 i = 0;
+
+  lapic = (volatile uint32 *)madt->lapic;
+  for (i = 0; i < ISA_IRQS; ++i) {
+    isa_gsi[i] = i;
+    isa_flags[i] = 0;
+  }
+
+  while (entry + 2 <= end && entry[1] >= 2) {
+    switch (entry[0]) {
+      case MADT_LAPIC:
+        if ((*(const uint32 *)(entry + 4) & 1) && cpu_count < MAX_CPUS) {
+          cpu_ids[cpu_count++] = entry[3];
+        }
+        break;
+      case MADT_IOAPIC:
+        if (ioapic == 0) {
+          ioapic = (volatile uint32 *)*(const uint32 *)(entry + 4);
+          ioapic_gsi_base = *(const uint32 *)(entry + 8);
+        }
+        break;
+      case MADT_OVERRIDE:
+        if (entry[2] == 0 && entry[3] < ISA_IRQS) {
+          isa_gsi[entry[3]] = *(const uint32 *)(entry + 4);
+          isa_flags[entry[3]] = *(const uint16 *)(entry + 8);
+        }
+        break;
+      case MADT_LAPIC_ADDRESS:
+        lapic = (volatile uint32 *)*(const uint32 *)(entry + 4);
+        break;
+      default:
+        break;
+    }
+    entry += entry[1];
+  }
+}
+
+/**
+ * \brief Routes the ISA interrupts through the I/O APIC to the vectors they
+ * had on the PICs, delivered to this processor. Every other redirection entry
+ * is masked. The cascade interrupt is not a real line, and the global system
+ * interrupt it would use may be taken by an override.
+ * \param None.
+ * \returns None.
+ */
+static void route_isa_irqs(void) {
+  const uint32 count = ioapic_entries();
+  const uint32 dest = lapic_id() << 24;
+  uint32 i = 0;
+
+  for (i = 0; i < count; ++i) {
+    ioapic_write(IOAPIC_REDIRECT + 2 * i, IOAPIC_MASKED);
+    ioapic_write(IOAPIC_REDIRECT + 2 * i + 1, 0);
+  }
+
+  for (i = 0; i < ISA_IRQS; ++i) {
+    const uint32 pin = isa_gsi[i] - ioapic_gsi_base;
+    uint32 low = IRQ0 + i;
+
+    if (i == ISA_CASCADE || isa_gsi[i] < ioapic_gsi_base || pin >= count) {
+      continue;
+    }
+    if ((isa_flags[i] & MPS_POLARITY_LOW) == MPS_POLARITY_LOW) {
+      low |= IOAPIC_ACTIVE_LOW;
+    }
+    if ((isa_flags[i] & MPS_TRIGGER_LEVEL) == MPS_TRIGGER_LEVEL) {
+      low |= IOAPIC_LEVEL;
+    }
+    ioapic_write(IOAPIC_REDIRECT + 2 * pin + 1, dest);
+    ioapic_write(IOAPIC_REDIRECT + 2 * pin, low);
+  }
+}
+
+/**
+ * \brief Takes the benchmark interrupt repeatedly.
+ * \param None.
+ * \returns The cycles per interrupt.
+ */
+static uint32 time_interrupts(void) {
+  const uint64 start = rdtsc();
+  uint32 i = 0;
+
+  for (i = 0; i < IRQ_BENCH_ROUNDS; ++i) {
+    __asm__ volatile("int %0" : : "i"(IRQ_BENCH) : "memory");
+  }
+  return (uint32)udiv64(rdtsc() - start, IRQ_BENCH_ROUNDS);
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc Runs with interrupts disabled, after the PICs have been remapped, so
+ * that anything they still raise arrives on vectors 32 to 47 rather than on
+ * the exceptions. Both PICs are masked before the local APIC is enabled in
+ * its base MSR and through the spurious interrupt vector register.
+ */
+void init_apic(void) {
+  const Madt *madt = 0;
+
+  cpu_ids[0] = 0;
+  cpu_count = 0;
+
+  if (!cpu_has(CPU_APIC) || !init_acpi()) {
+    return;
+  }
+
+  madt = (const Madt *)acpi_find_table("APIC");
+  if (madt == 0) {
+    return;
+  }
+  parse_madt(madt);
+  if (ioapic == 0 || lapic == 0) {
+    return;
+  }
+
+  port_byte_out(PIC1_DATA, 0xFF);
+  port_byte_out(PIC2_DATA, 0xFF);
+
+  lapic_enable();
+  route_isa_irqs();
+  active = 1;
+}
+
+/**
+ * \desc Enables the APIC in its base MSR first, which each processor has its
+ * own copy of, then through the spurious interrupt vector register.
+ */
+void lapic_enable(void) {
+  wrmsr(APIC_BASE_MSR, rdmsr(APIC_BASE_MSR) | APIC_BASE_ENABLE);
+  lapic_write(LAPIC_TPR, 0);
+  lapic_write(LAPIC_SVR, LAPIC_ENABLE | SPURIOUS_VECTOR);
+}
+
+/**
+ * \desc Set by init_apic() once the I/O APIC routes the ISA interrupts.
+ */
+uint32 apic_active(void) { return active; }
+
+/**
+ * \desc Any value may be written, and the write needs no read back.
+ */
+void lapic_eoi(void) { lapic_write(LAPIC_EOI, 0); }
+
+/**
+ * \desc The ID is in the top byte of the register.
+ */
+uint32 lapic_id(void) { return lapic ? lapic_read(LAPIC_ID) >> 24 : 0; }
+
+/**
+ * \desc The destination is written first, as writing the low half sends the
+ * interrupt. The delivery status bit stays set until the destination has
+ * accepted it.
+ */
+void lapic_send_ipi(uint32 apic_id, uint32 command) {
+  lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+  lapic_write(LAPIC_ICR_LOW, command);
+  while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+    cpu_relax();
+  }
+}
+
+/**
+ * \desc The divider is set to one so the timer counts at the bus clock. The
+ * fence keeps a following write to the deadline MSR from being ordered before
+ * the switch to TSC-deadline mode.
+ */
+void lapic_timer_setup(uint32 lvt) {
+  lapic_write(LAPIC_TIMER_INITIAL, 0);
+  lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_DIVIDE_1);
+  lapic_write(LAPIC_LVT_TIMER, lvt);
+  __asm__ volatile("mfence" : : : "memory");
+}
+
+/**
+ * \desc Writing the initial count restarts the countdown.
+ */
+void lapic_timer_oneshot(uint32 count) {
+  lapic_write(LAPIC_TIMER_INITIAL, count);
+}
+
+/**
+ * \desc A deadline already passed fires at once.
+ */
+void lapic_timer_deadline(uint64 tsc) { wrmsr(TSC_DEADLINE_MSR, tsc); }
+
+/**
+ * \desc Reads the count down from the last initial count.
+ */
+uint32 lapic_timer_count(void) { return lapic_read(LAPIC_TIMER_CURRENT); }
+
+/**
+ * \desc The mode is one of the features read by init_cpuid().
+ */
+uint32 tsc_deadline_supported(void) {
+  return active && cpu_has(CPU_TSC_DEADLINE);
+}
+
+/**
+ * \desc Without a MADT only the running processor is known.
+ */
+uint32 apic_cpu_count(void) { return cpu_count ? cpu_count : 1; }
+
+/**
+ * \desc Returns the ID recorded by parse_madt().
+ */
+uint32 apic_cpu_id(uint32 n) { return cpu_ids[n]; }
+
+/**
+ * \desc Each routed ISA interrupt is shown with its global system interrupt
+ * when an override moves it.
+ */
+void apic_stats(void) {
+  uint32 i = 0;
+
+  if (!active) {
+    kprintf("   Interrupts through the 8259 PICs, no APIC found\n");
+    return;
+  }
+
+  kprintf("   Local APIC %p ID %u version 0x%x, %u CPUs\n", (void *)lapic,
+          lapic_id(), lapic_read(LAPIC_VERSION) & 0xFF, apic_cpu_count());
+  kprintf("   I/O APIC %p GSI base %u, %u entries\n", (void *)ioapic,
+          ioapic_gsi_base, ioapic_entries());
+
+  for (i = 0; i < ISA_IRQS; ++i) {
+    if (isa_gsi[i] != i) {
+      kprintf("   IRQ%u -> GSI %u\n", i, isa_gsi[i]);
+    }
+  }
+}
+
+/**
+ * \desc Takes a software interrupt on the last PIC vector through irq_common,
+ * with interrupts disabled so that no hardware interrupt is acknowledged
+ * the wrong way. The PIC pass sends both EOI writes, as irq_handler() would
+ * for an interrupt from the secondary PIC; with the APICs in use the PICs are
+ * masked and have nothing in service, so the writes only cost time.
+ */
+void interrupt_benchmark(void) {
+  const uint32 flags = irq_save();
+  const uint32 was = active;
+  uint32 pic = 0, apic = 0;
+
+  active = 0;
+  pic = time_interrupts();
+  if (was) {
+    active = 1;
+    apic = time_interrupts();
+  }
+  irq_restore(flags);
+
+  kprintf("   Interrupt round trip: PIC EOI %u", pic);
+  if (was) {
+    kprintf(" cycles, LAPIC EOI %u", apic);
+  }
+  kprintf(" cycles\n");
+}
\ No newline at end of file
@@ -0,0 +1,244 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file apic.h
+ * \brief Local APIC and I/O APIC declarations.
+ *
+ * Where the processor has a local APIC (CPUID leaf 1, EDX bit 9) and the ACPI
+ * multiple APIC description table (MADT) describes an I/O APIC, the two 8259
+ * PICs are masked and the ISA interrupts are routed through the I/O APIC
+ * instead, keeping the vectors 32 to 47 they had on the PICs. The MADT also
+ * gives the interrupt source overrides, e.g. the PIT on global system
+ * interrupt 2 rather than 0. An interrupt is then acknowledged with a single
+ * write to the memory-mapped EOI register of the local APIC, rather than one
+ * or two port writes to the PICs. Without an APIC, the PICs are left as they
+ * are.
+ *
+ * The local APIC registers are 32 bits wide, 16-byte aligned, at these
+ * offsets from its base (0xFEE00000 by default):
+ *
+ * 0x020 : Local APIC ID (bits 24 to 31).
+ * 0x030 : Local APIC version.
+ * 0x080 : Task priority, zero to accept every interrupt.
+ * 0x0B0 : End of interrupt, written with zero.
+ * 0x0F0 : Spurious interrupt vector, bit 8 software-enables the APIC.
+ * 0x300 : Interrupt command, low half: vector, delivery mode and status.
+ * 0x310 : Interrupt command, high half: destination APIC ID (bits 24 to 31).
+ * 0x320 : Local vector table entry of the timer: vector, mask and mode.
+ * 0x380 : Timer initial count, counting down from it starts on writing.
+ * 0x390 : Timer current count.
+ * 0x3E0 : Timer divide configuration.
+ *
+ * Each processor has its own local APIC timer, so it can run the clock
+ * events of that processor without the port I/O of the PIT. In one-shot mode
+ * it counts down from the initial count at the bus clock over the divider.
+ * In TSC-deadline mode (CPUID leaf 1, ECX bit 24) it fires once the
+ * time-stamp counter reaches the value written to the IA32_TSC_DEADLINE MSR.
+ *
+ * Writing the low half of the interrupt command register sends an
+ * inter-processor interrupt (IPI) to the local APIC named in the high half.
+ * An INIT IPI followed by two startup IPIs is how the application processors
+ * are started, see smp.h.
+ *
+ * The I/O APIC is reached through an index register at its base and a data
+ * window 16 bytes above it. Each redirection entry takes two registers from
+ * 0x10, holding the vector, the polarity and trigger mode, a mask bit and the
+ * destination APIC ID.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef APIC_H
+#define APIC_H
+
+#include "../common/types.h"
+
+/* Local APIC register offsets */
+#define LAPIC_ID 0x20
+#define LAPIC_VERSION 0x30
+#define LAPIC_TPR 0x80
+#define LAPIC_EOI 0xB0
+#define LAPIC_SVR 0xF0
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+/* Local vector table bits: masked, and the timer modes */
+#define LAPIC_MASKED 0x10000
+#define LAPIC_TIMER_ONESHOT 0x00000
+#define LAPIC_TIMER_TSC_DEADLINE 0x40000
+
+/* Interrupt command bits: delivery modes, level assert and delivery status */
+#define LAPIC_ICR_FIXED 0x000
+#define LAPIC_ICR_INIT 0x500
+#define LAPIC_ICR_STARTUP 0x600
+#define LAPIC_ICR_PENDING 0x1000
+#define LAPIC_ICR_ASSERT 0x4000
+
+/* Timer divide configuration value for dividing by one */
+#define LAPIC_DIVIDE_1 0xB
+
+/* Model-specific register the TSC-deadline mode compares against */
+#define TSC_DEADLINE_MSR 0x6E0
+
+/* Spurious interrupt vector register: software enable */
+#define LAPIC_ENABLE 0x100
+
+/* Model-specific register holding the local APIC base, and its enable bit */
+#define APIC_BASE_MSR 0x1B
+#define APIC_BASE_ENABLE 0x800
+
+/* I/O APIC registers, reached through the index and data window */
+#define IOAPIC_INDEX 0x00
+#define IOAPIC_DATA 0x10
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDIRECT 0x10
+
+/* Redirection entry bits */
+#define IOAPIC_ACTIVE_LOW 0x2000
+#define IOAPIC_LEVEL 0x8000
+#define IOAPIC_MASKED 0x10000
+
+/* Vector the local APIC uses for spurious interrupts, needing no EOI */
+#define SPURIOUS_VECTOR 0xFF
+
+/* MADT entry types */
+#define MADT_LAPIC 0
+#define MADT_IOAPIC 1
+#define MADT_OVERRIDE 2
+#define MADT_LAPIC_ADDRESS 5
+
+/* MPS interrupt flags of an override: polarity and trigger mode */
+#define MPS_POLARITY_LOW 0x3
+#define MPS_TRIGGER_LEVEL 0xC
+
+/* ISA interrupts routed through the I/O APIC, and the cascade left out */
+#define ISA_IRQS 16
+#define ISA_CASCADE 2
+
+/* Most processors recorded from the MADT */
+#define MAX_CPUS 16
+
+/* Vector taken by the interrupt benchmarks, the last PIC interrupt, and the
+ * software interrupts taken per pass */
+#define IRQ_BENCH IRQ15
+#define IRQ_BENCH_ROUNDS 10000
+
+/* Spurious interrupt handler (implemented in interrupt.asm) */
+extern void irq_spurious();
+
+/**
+ * \brief Switches from the PICs to the APICs where they are present.
+ * \param None.
+ * \returns None.
+ */
+void init_apic(void);
+
+/**
+ * \brief Software-enables the local APIC of the running processor, accepting
+ * every interrupt priority.
+ * \param None.
+ * \returns None.
+ */
+void lapic_enable(void);
+
+/**
+ * \brief Checks whether interrupts come through the APICs.
+ * \param None.
+ * \returns Non-zero if the APICs are in use, zero for the PICs.
+ */
+uint32 apic_active(void);
+
+/**
+ * \brief Acknowledges the interrupt in service at the local APIC.
+ * \param None.
+ * \returns None.
+ */
+void lapic_eoi(void);
+
+/**
+ * \brief Gets the ID of the local APIC of the running processor.
+ * \param None.
+ * \returns The local APIC ID.
+ */
+uint32 lapic_id(void);
+
+/**
+ * \brief Sends an inter-processor interrupt and waits for its delivery.
+ * \param [in] apic_id The local APIC ID of the destination processor.
+ * \param [in] command The vector, delivery mode and level of the interrupt.
+ * \returns None.
+ */
+void lapic_send_ipi(uint32 apic_id, uint32 command);
+
+/**
+ * \brief Sets the divider and the local vector table entry of the local APIC
+ * timer, leaving it stopped.
+ * \param [in] lvt The vector and mode, or LAPIC_MASKED.
+ * \returns None.
+ */
+void lapic_timer_setup(uint32 lvt);
+
+/**
+ * \brief Starts a one-shot countdown of the local APIC timer.
+ * \param [in] count The initial count, zero to stop the timer.
+ * \returns None.
+ */
+void lapic_timer_oneshot(uint32 count);
+
+/**
+ * \brief Arms the local APIC timer in TSC-deadline mode.
+ * \param [in] tsc The time-stamp counter value to fire at, zero to stop.
+ * \returns None.
+ */
+void lapic_timer_deadline(uint64 tsc);
+
+/**
+ * \brief Reads the current count of the local APIC timer.
+ * \param None.
+ * \returns The current count.
+ */
+uint32 lapic_timer_count(void);
+
+/**
+ * \brief Checks whether the local APIC timer has TSC-deadline mode.
+ * \param None.
+ * \returns Non-zero if the APICs are in use and the mode is supported.
+ */
+uint32 tsc_deadline_supported(void);
+
+/**
+ * \brief Gets the number of enabled processors listed in the MADT.
+ * \param None.
+ * \returns The processor count, at least one.
+ */
+uint32 apic_cpu_count(void);
+
+/**
+ * \brief Gets the local APIC ID of a processor listed in the MADT.
+ * \param [in] n The processor index, less than apic_cpu_count().
+ * \returns The local APIC ID.
+ */
+uint32 apic_cpu_id(uint32 n);
+
+/**
+ * \brief Prints the interrupt path, the APICs found and the ISA routing.
+ * \param None.
+ * \returns None.
+ */
+void apic_stats(void);
+
+/**
+ * \brief Times an interrupt round trip with each kind of EOI.
+ * \param None.
+ * \returns None.
+ */
+void interrupt_benchmark(void);
+
+#endif
\ No newline at end of file
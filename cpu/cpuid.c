@@ -0,0 +1,221 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file cpuid.c
+ * \brief Processor feature detection and dispatch implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "cpuid.h"
+#include "../common/memory.h"
+#include "../common/printf.h"
+
+/**
+ * Where CPUID reports one feature: the register of a leaf and its bit.
+ */
+typedef struct {
+  uint32 leaf;      /**< The leaf */
+  uint32 reg;       /**< 0 to 3 for EAX, EBX, ECX and EDX */
+  uint32 bit;       /**< The bit in that register */
+  uint32 feature;   /**< The CPU_ bit it sets */
+  const char *name; /**< Name shown by cpu_info_print() */
+} Cpu_Probe;
+
+static const Cpu_Probe probes[] = {
+    {CPUID_FEATURES, 3, 0x1, CPU_FPU, "fpu"},
+    {CPUID_FEATURES, 3, 0x8, CPU_PSE, "pse"},
+    {CPUID_FEATURES, 3, 0x10, CPU_TSC, "tsc"},
+    {CPUID_FEATURES, 3, 0x20, CPU_MSR, "msr"},
+    {CPUID_FEATURES, 3, 0x200, CPU_APIC, "apic"},
+    {CPUID_FEATURES, 3, 0x1000000, CPU_FXSR, "fxsr"},
+    {CPUID_FEATURES, 3, 0x2000000, CPU_SSE, "sse"},
+    {CPUID_FEATURES, 3, 0x4000000, CPU_SSE2, "sse2"},
+    {CPUID_FEATURES, 2, 0x1, CPU_SSE3, "sse3"},
+    {CPUID_FEATURES, 2, 0x200, CPU_SSSE3, "ssse3"},
+    {CPUID_FEATURES, 2, 0x80000, CPU_SSE4_1, "sse4.1"},
+    {CPUID_FEATURES, 2, 0x100000, CPU_SSE4_2, "sse4.2"},
+    {CPUID_FEATURES, 2, 0x200000, CPU_X2APIC, "x2apic"},
+    {CPUID_FEATURES, 2, 0x800000, CPU_POPCNT, "popcnt"},
+    {CPUID_FEATURES, 2, 0x1000000, CPU_TSC_DEADLINE, "tsc-deadline"},
+    {CPUID_FEATURES, 2, 0x80000000, CPU_HYPERVISOR, "hypervisor"},
+    {CPUID_EXTENDED_FEATURES, 1, 0x200, CPU_ERMS, "erms"},
+    {CPUID_POWER, 3, 0x100, CPU_INVARIANT_TSC, "invariant-tsc"},
+};
+
+/* Every dispatched routine */
+static Cpu_Dispatch *const dispatches[] = {&memcpy_dispatch, &memset_dispatch};
+
+static Cpu_Info info;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Gets whether the processor has a leaf.
+ * \param [in] leaf The leaf.
+ * \returns Non-zero if it is no higher than the highest of its range.
+ */
+static uint32 has_leaf(uint32 leaf) {
+  return leaf >= CPUID_EXTENDED ? leaf <= info.max_ext : leaf <= info.max_leaf;
+}
+
+/**
+ * \brief Reads the brand string, which spans three leaves, and drops the
+ * spaces some processors pad its front with.
+ * \param None.
+ * \returns None.
+ */
+static void read_brand(void) {
+  uint32 regs[12] = {0};
+  const char *start = (const char *)regs;
+  uint32 i = 0;
+
+  if (!has_leaf(CPUID_BRAND + 2)) {
+    return;
+  }
+  for (i = 0; i < 3; ++i) {
+    cpuid(CPUID_BRAND + i, 0, &regs[i * 4]);
+  }
+  while (*start == ' ') {
+    ++start;
+  }
+  for (i = 0; start[i] != '\0' && start + i < (const char *)(regs + 12); ++i) {
+    info.brand[i] = start[i];
+  }
+  info.brand[i] = '\0';
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc ECX selects the subleaf of the leaves that have them and is ignored
+ * by the rest.
+ */
+void cpuid(uint32 leaf, uint32 subleaf, uint32 regs[4]) {
+  __asm__ volatile("cpuid"
+                   : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]),
+                     "=d"(regs[3])
+                   : "a"(leaf), "c"(subleaf));
+}
+
+/**
+ * \desc Leaf 0 gives the highest standard leaf and the vendor, in EBX, EDX
+ * and ECX in that order, and leaf 0x80000000 the highest extended leaf. A
+ * processor without the extended range returns something below it there.
+ * Leaf 1 EAX holds the signature: the extended family is only added to
+ * family 15 and the extended model only used by families 6 and 15. Each
+ * feature is then read from its leaf, each leaf being executed once.
+ */
+void init_cpuid(void) {
+  uint32 regs[4] = {0}, last[4] = {0};
+  uint32 i = 0, leaf = ~0u;
+
+  cpuid(CPUID_VENDOR, 0, regs);
+  info.max_leaf = regs[0];
+  memcpy(&info.vendor[0], &regs[1], 4);
+  memcpy(&info.vendor[4], &regs[3], 4);
+  memcpy(&info.vendor[8], &regs[2], 4);
+  info.vendor[12] = '\0';
+
+  cpuid(CPUID_EXTENDED, 0, regs);
+  info.max_ext = regs[0] >= CPUID_EXTENDED ? regs[0] : 0;
+
+  if (has_leaf(CPUID_FEATURES)) {
+    cpuid(CPUID_FEATURES, 0, regs);
+    info.family = (regs[0] >> 8) & 0xF;
+    info.model = (regs[0] >> 4) & 0xF;
+    info.stepping = regs[0] & 0xF;
+    if (info.family == 6 || info.family == 15) {
+      info.model |= ((regs[0] >> 16) & 0xF) << 4;
+    }
+    if (info.family == 15) {
+      info.family += (regs[0] >> 20) & 0xFF;
+    }
+  }
+
+  info.features = 0;
+  for (i = 0; i < sizeof(probes) / sizeof(probes[0]); ++i) {
+    if (!has_leaf(probes[i].leaf)) {
+      continue;
+    }
+    if (probes[i].leaf != leaf) {
+      leaf = probes[i].leaf;
+      cpuid(leaf, 0, last);
+    }
+    if (last[probes[i].reg] & probes[i].bit) {
+      info.features |= probes[i].feature;
+    }
+  }
+
+  read_brand();
+}
+
+/**
+ * \desc Tests the mask kept by init_cpuid().
+ */
+uint32 cpu_has(uint32 features) {
+  return (info.features & features) == features;
+}
+
+/**
+ * \desc Returns the information kept by init_cpuid().
+ */
+const Cpu_Info *cpu_info(void) { return &info; }
+
+/**
+ * \desc Each routine takes the first of its implementations whose features
+ * are all present. The last needs none, so one is always found.
+ */
+void cpu_dispatch(void) {
+  uint32 i = 0, j = 0;
+
+  for (i = 0; i < sizeof(dispatches) / sizeof(dispatches[0]); ++i) {
+    Cpu_Dispatch *d = dispatches[i];
+    j = 0;
+    while (j + 1 < d->count && !cpu_has(d->variants[j].features)) {
+      ++j;
+    }
+    d->bound = &d->variants[j];
+    *d->slot = d->bound->fn;
+  }
+}
+
+/**
+ * \desc The features are listed by name, those missing left out, followed by
+ * one line per dispatched routine naming its implementations, the bound one
+ * marked.
+ */
+void cpu_info_print(void) {
+  uint32 i = 0, j = 0;
+
+  kprintf("   %s, family %u, model %u, stepping %u\n", info.vendor,
+          info.family, info.model, info.stepping);
+  if (info.brand[0] != '\0') {
+    kprintf("   %s\n", info.brand);
+  }
+
+  kprintf("   Features:");
+  for (i = 0; i < sizeof(probes) / sizeof(probes[0]); ++i) {
+    if (info.features & probes[i].feature) {
+      kprintf(" %s", probes[i].name);
+    }
+  }
+  kprintf("\n");
+
+  for (i = 0; i < sizeof(dispatches) / sizeof(dispatches[0]); ++i) {
+    const Cpu_Dispatch *d = dispatches[i];
+    kprintf("   %-7s", d->name);
+    for (j = 0; j < d->count; ++j) {
+      kprintf(" %s%s%s", &d->variants[j] == d->bound ? "[" : "",
+              d->variants[j].name, &d->variants[j] == d->bound ? "]" : "");
+    }
+    kprintf("%s", d->bound ? "\n" : " (not bound)\n");
+  }
+}
\ No newline at end of file
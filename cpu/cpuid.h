@@ -0,0 +1,148 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file cpuid.h
+ * \brief Processor feature detection and dispatch declarations.
+ *
+ * init_cpuid() runs CPUID once at boot, before anything asks about the
+ * processor, and keeps the vendor, the brand string, the family, model and
+ * stepping and a mask of the features the kernel cares about. The features
+ * come from the standard leaf 1, the structured extended leaf 7 for ERMS and
+ * the extended leaf 0x80000007 for an invariant TSC, each leaf only read when
+ * the processor reports it. cpu_has() is then a test of the mask.
+ *
+ * Routines with several implementations are dispatched through a function
+ * pointer. Each such routine describes its implementations in a table, best
+ * first, with the features each needs; the last needs none. cpu_dispatch()
+ * binds every pointer once to the first implementation the processor
+ * supports, so that a call costs one indirect jump and never a feature test.
+ * Until then the pointers hold the last implementation, which runs anywhere.
+ * Binding waits until every processor is up, as an implementation using SSE
+ * needs it enabled by init_fpu() on each of them.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef CPUID_H
+#define CPUID_H
+
+#include "../common/types.h"
+
+/* Features recorded by init_cpuid() */
+#define CPU_FPU 0x1
+#define CPU_PSE 0x2
+#define CPU_TSC 0x4
+#define CPU_MSR 0x8
+#define CPU_APIC 0x10
+#define CPU_FXSR 0x20
+#define CPU_SSE 0x40
+#define CPU_SSE2 0x80
+#define CPU_SSE3 0x100
+#define CPU_SSSE3 0x200
+#define CPU_SSE4_1 0x400
+#define CPU_SSE4_2 0x800
+#define CPU_X2APIC 0x1000
+#define CPU_POPCNT 0x2000
+#define CPU_TSC_DEADLINE 0x4000
+#define CPU_HYPERVISOR 0x8000
+#define CPU_ERMS 0x10000
+#define CPU_INVARIANT_TSC 0x20000
+
+/* Leaves read by init_cpuid() */
+#define CPUID_VENDOR 0
+#define CPUID_FEATURES 1
+#define CPUID_EXTENDED_FEATURES 7
+#define CPUID_EXTENDED 0x80000000
+#define CPUID_BRAND 0x80000002
+#define CPUID_POWER 0x80000007
+
+/**
+ * What init_cpuid() found out about the processor. The APs are taken to
+ * match the BSP, on which it runs.
+ */
+typedef struct {
+  char vendor[13]; /**< Vendor string, as GenuineIntel */
+  char brand[49];  /**< Brand string, empty if not reported */
+  uint32 family;   /**< Family, the extended family added */
+  uint32 model;    /**< Model, the extended model included */
+  uint32 stepping; /**< Stepping */
+  uint32 max_leaf; /**< Highest standard leaf */
+  uint32 max_ext;  /**< Highest extended leaf, or zero */
+  uint32 features; /**< CPU_ bits */
+} Cpu_Info;
+
+/* A function pointer of any type, cast back to its own type when called */
+typedef void (*Cpu_Fn)(void);
+
+/**
+ * One implementation of a dispatched routine.
+ */
+typedef struct {
+  const char *name; /**< Name shown by cpu_info_print() */
+  uint32 features;  /**< CPU_ bits it needs */
+  Cpu_Fn fn;        /**< The implementation */
+} Cpu_Variant;
+
+/**
+ * A dispatched routine: the pointer its callers go through and the
+ * implementations it may be bound to.
+ */
+typedef struct {
+  const char *name;            /**< The routine */
+  Cpu_Fn *slot;                /**< The pointer to bind */
+  const Cpu_Variant *variants; /**< Best first, the last needing nothing */
+  uint32 count;                /**< Entries of variants */
+  const Cpu_Variant *bound;    /**< The one chosen, zero before binding */
+} Cpu_Dispatch;
+
+/**
+ * \brief Executes CPUID.
+ * \param [in] leaf The leaf, in EAX.
+ * \param [in] subleaf The subleaf, in ECX.
+ * \param [out] regs EAX, EBX, ECX and EDX in that order.
+ * \returns None.
+ */
+void cpuid(uint32 leaf, uint32 subleaf, uint32 regs[4]);
+
+/**
+ * \brief Reads the identity and features of the processor. Must run before
+ * cpu_has() is used.
+ * \param None.
+ * \returns None.
+ */
+void init_cpuid(void);
+
+/**
+ * \brief Gets whether the processor has every one of a set of features.
+ * \param [in] features The CPU_ bits.
+ * \returns Non-zero if it has them all.
+ */
+uint32 cpu_has(uint32 features);
+
+/**
+ * \brief Gets what init_cpuid() found out.
+ * \param None.
+ * \returns The processor information.
+ */
+const Cpu_Info *cpu_info(void);
+
+/**
+ * \brief Binds every dispatched routine to its best supported implementation.
+ * Called once, after every processor has enabled its FPU and SSE.
+ * \param None.
+ * \returns None.
+ */
+void cpu_dispatch(void);
+
+/**
+ * \brief Prints the processor identity, its features and the implementation
+ * bound to each dispatched routine.
+ * \param None.
+ * \returns None.
+ */
+void cpu_info_print(void);
+
+#endif
\ No newline at end of file
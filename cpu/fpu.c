@@ -0,0 +1,276 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file fpu.c
+ * \brief FPU and SSE state management implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "fpu.h"
+#include "cpuid.h"
+#include "isr.h"
+#include "smp.h"
+#include "../common/atomic.h"
+#include "../common/memory.h"
+#include "../common/printf.h"
+#include "../kernel/thread.h"
+
+/* Set once the BSP has enabled the FPU and SSE */
+static volatile uint32 enabled = 0;
+
+/* Counters of the #NM handler */
+static volatile uint32 traps = 0;
+static volatile uint32 saves = 0;
+static volatile uint32 restores = 0;
+static volatile uint32 states = 0;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Reads CR0.
+ * \param None.
+ * \returns The register.
+ */
+static uint32 read_cr0(void) {
+  uint32 value = 0;
+  __asm__ volatile("mov %%cr0, %0" : "=r"(value));
+  return value;
+}
+
+/**
+ * \brief Writes CR0.
+ * \param [in] value The register.
+ * \returns None.
+ */
+static void write_cr0(uint32 value) {
+  __asm__ volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+/**
+ * \brief Reads CR4.
+ * \param None.
+ * \returns The register.
+ */
+static uint32 read_cr4(void) {
+  uint32 value = 0;
+  __asm__ volatile("mov %%cr4, %0" : "=r"(value));
+  return value;
+}
+
+/**
+ * \brief Writes CR4.
+ * \param [in] value The register.
+ * \returns None.
+ */
+static void write_cr4(uint32 value) {
+  __asm__ volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+/**
+ * \brief Finds the state of the running context: the thread on the BSP, the
+ * processor on an AP.
+ * \param [in] cpu The per-CPU data of the running processor.
+ * \returns The state, allocated with the context.
+ */
+static Fpu_State *context_state(Cpu *cpu) {
+  Thread *thread = thread_current();
+
+  if (cpu->index == 0 && thread != 0) {
+    return thread->fpu;
+  }
+  return cpu->fpu_state;
+}
+
+/**
+ * \brief The #NM handler, run with interrupts disabled. TS is cleared so
+ * that the faulting instruction runs when it is retried. Unless the running
+ * context still owns the registers, the owner's are saved and the running
+ * context's loaded. Every context has its state from its creation, so
+ * nothing is allocated here.
+ * \param [in] regs Not used.
+ * \returns None.
+ */
+static void fpu_trap(Registers const *regs) {
+  Cpu *cpu = cpu_current();
+  Fpu_State *state = context_state(cpu);
+
+  (void)regs;
+  __asm__ volatile("clts");
+  cpu->fpu_live = 1;
+  atomic_inc(&traps);
+
+  if (cpu->fpu_owner == state) {
+    return;
+  }
+
+  if (cpu->fpu_owner != 0) {
+    __asm__ volatile("fxsave %0" : "=m"(*cpu->fpu_owner));
+    atomic_inc(&saves);
+  }
+  __asm__ volatile("fxrstor %0" : : "m"(*state));
+  atomic_inc(&restores);
+  cpu->fpu_owner = state;
+}
+
+/**
+ * \brief Entry point of the self-test threads. Loads a pattern into XMM0
+ * and checks it after every yield, the other thread loading its own in
+ * between. XMM0 is not listed as clobbered, as explained in fpu.h.
+ * \param [in,out] data The pattern, replaced by the failed checks.
+ * \returns None.
+ */
+static void sse_worker(void *data) {
+  uint32 *result = (uint32 *)data;
+  const uint32 in[4] = {*result, ~*result, *result ^ 0x5A5A5A5A, *result + 1};
+  uint32 out[4] = {0};
+  uint32 i = 0, j = 0, failures = 0;
+
+  __asm__ volatile("movups %0, %%xmm0" : : "m"(in));
+  for (i = 0; i < FPU_TEST_ROUNDS; ++i) {
+    thread_yield();
+    __asm__ volatile("movups %%xmm0, %0" : "=m"(out));
+    for (j = 0; j < 4; ++j) {
+      failures += out[j] != in[j];
+    }
+  }
+  *result = failures;
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc Without FXSAVE and SSE the control registers are left alone. The
+ * FPU is reset with TS clear, then TS is set so that the first use traps and
+ * loads the state of the context. The handler is installed by the BSP, whose
+ * registers are set up before any AP starts.
+ */
+void init_fpu(void) {
+  Cpu *cpu = cpu_current();
+
+  if (!cpu_has(CPU_FXSR | CPU_SSE)) {
+    return;
+  }
+
+  write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+  write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+  __asm__ volatile("fninit");
+  write_cr0(read_cr0() | CR0_TS);
+  cpu->fpu_owner = 0;
+  cpu->fpu_live = 0;
+
+  if (cpu->index == 0) {
+    reg_interrupt_handler(FPU_VECTOR, fpu_trap);
+    enabled = 1;
+  }
+}
+
+/**
+ * \desc Returns the flag set by init_fpu() on the BSP.
+ */
+uint32 fpu_enabled(void) { return enabled; }
+
+/**
+ * \desc TS is only set when the registers were used since it was last set,
+ * so a switch between threads that do not use them writes nothing.
+ */
+void fpu_switch(void) {
+  Cpu *cpu = 0;
+
+  if (!enabled) {
+    return;
+  }
+  cpu = cpu_current();
+  if (cpu->fpu_live) {
+    cpu->fpu_live = 0;
+    write_cr0(read_cr0() | CR0_TS);
+  }
+}
+
+/**
+ * \desc Every register is empty or zero but the FPU control word and MXCSR,
+ * whose reset values mask every exception.
+ */
+void fpu_init_state(Fpu_State *state) {
+  memset(state, 0, sizeof(Fpu_State));
+  *(uint16 *)&state->data[FXSAVE_FCW] = FCW_DEFAULT;
+  *(uint32 *)&state->data[FXSAVE_MXCSR] = MXCSR_DEFAULT;
+}
+
+/**
+ * \desc The state comes from kmalloc(), which aligns it to 16 bytes.
+ */
+Fpu_State *fpu_alloc(void) {
+  Fpu_State *state = (Fpu_State *)kmalloc(sizeof(Fpu_State));
+
+  if (state != 0) {
+    fpu_init_state(state);
+    atomic_inc(&states);
+  }
+  return state;
+}
+
+/**
+ * \desc A processor whose registers belong to the state forgets the owner,
+ * so the next trap there saves nothing.
+ */
+void fpu_release(Fpu_State *state) {
+  uint32 flags = 0, i = 0;
+
+  if (state == 0) {
+    return;
+  }
+
+  flags = irq_save();
+  for (i = 0; i < smp_cpu_count(); ++i) {
+    Cpu *cpu = smp_cpu(i);
+    if (cpu->fpu_owner == state) {
+      cpu->fpu_owner = 0;
+    }
+  }
+  irq_restore(flags);
+  kfree(state);
+}
+
+/**
+ * \desc Two threads of equal priority yield to each other in turn while the
+ * kernel thread waits for them, so that each switch moves the registers
+ * between them through the #NM handler.
+ */
+void fpu_self_test(void) {
+  uint32 results[2] = {0x01234567, 0x89ABCDEF};
+  Thread *first = 0, *second = 0;
+
+  if (!enabled) {
+    kprintf("   No FXSAVE and SSE, the FPU is left disabled\n");
+    return;
+  }
+
+  first = thread_create("sse0", sse_worker, &results[0],
+                        THREAD_PRIORITY_DEFAULT);
+  second = thread_create("sse1", sse_worker, &results[1],
+                         THREAD_PRIORITY_DEFAULT);
+  if (first == 0 || second == 0) {
+    kprintf("   Out of memory\n");
+  }
+  if (first != 0) {
+    thread_join(first);
+  }
+  if (second != 0) {
+    thread_join(second);
+  }
+
+  if (first != 0 && second != 0) {
+    kprintf("   SSE state across %u yields: %s\n", 2 * FPU_TEST_ROUNDS,
+            results[0] == 0 && results[1] == 0 ? "kept" : "CORRUPTED");
+  }
+  kprintf("   #NM traps %u, saves %u, restores %u, states %u\n", traps, saves,
+          restores, states);
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file fpu.h
+ * \brief FPU and SSE state management declarations.
+ *
+ * The boot code leaves the FPU as the BIOS set it and SSE disabled, so any
+ * SSE instruction would fault. init_fpu() enables both on each processor that
+ * has FXSAVE and SSE: CR0.EM is cleared so that the instructions run, CR0.MP
+ * and CR0.NE make WAIT and the FPU errors behave as on any modern processor,
+ * and CR4.OSFXSR and CR4.OSXMMEXCPT tell the processor that the kernel saves
+ * the SSE registers and handles SIMD exceptions.
+ *
+ * The state of the FPU and SSE registers, 512 bytes, is switched lazily. A
+ * thread switch only sets CR0.TS, and only if the registers were used since
+ * the last one, so switches between threads that never use them cost a
+ * single test. The first FPU or SSE instruction after a switch then raises
+ * the device-not-available exception (#NM, vector 7), whose handler clears
+ * TS, saves the registers with FXSAVE to the context that owns them and loads
+ * those of the running context with FXRSTOR. When the running context still
+ * owns the registers, as when no other used them in between, nothing is
+ * copied at all. A context's state is allocated with the context and holds
+ * the reset values of the registers until first used, so the handler never
+ * allocates and a first use is loaded like any other.
+ *
+ * The contexts are the threads on the BSP, which is where they run, and the
+ * processor itself on each AP. Interrupts do not switch the state, so
+ * interrupt handlers must not use the FPU or SSE, which the kernel, built
+ * without SSE code generation and with no floating point, never does, except
+ * in the SSE2 memcpy(), which saves and restores the registers it uses.
+ *
+ * For the same reason the compiler never keeps anything in the XMM
+ * registers, so asm that uses them need not list them as clobbered, and for
+ * this target cannot: without SSE code generation the compiler does not know
+ * them by name.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef FPU_H
+#define FPU_H
+
+#include "../common/types.h"
+
+/* The device-not-available exception */
+#define FPU_VECTOR 7
+
+/* Control register bits */
+#define CR0_MP 0x2
+#define CR0_EM 0x4
+#define CR0_TS 0x8
+#define CR0_NE 0x20
+#define CR4_OSFXSR 0x200
+#define CR4_OSXMMEXCPT 0x400
+
+/* MXCSR after reset: every SIMD exception masked, round to nearest */
+#define MXCSR_DEFAULT 0x1F80
+
+/* FPU control word after FNINIT: every exception masked, 64-bit precision */
+#define FCW_DEFAULT 0x037F
+
+/* Offsets of the control word and of MXCSR in the FXSAVE image */
+#define FXSAVE_FCW 0
+#define FXSAVE_MXCSR 24
+
+/* Yields taken by each thread of the self-test */
+#define FPU_TEST_ROUNDS 1000
+
+/**
+ * The FXSAVE image of the FPU and SSE registers, which must be 16-byte
+ * aligned; kmalloc() gives that alignment.
+ */
+typedef struct {
+  uint8 data[512]; /**< The image */
+} __attribute__((aligned(16))) Fpu_State;
+
+/**
+ * \brief Enables the FPU and SSE on the running processor, if it has them,
+ * and installs the #NM handler. Needs the per-CPU data.
+ * \param None.
+ * \returns None.
+ */
+void init_fpu(void);
+
+/**
+ * \brief Gets whether the FPU and SSE were enabled.
+ * \param None.
+ * \returns Non-zero if they were.
+ */
+uint32 fpu_enabled(void);
+
+/**
+ * \brief Called by the scheduler on a thread switch, with interrupts
+ * disabled, to make the next use of the registers trap.
+ * \param None.
+ * \returns None.
+ */
+void fpu_switch(void);
+
+/**
+ * \brief Sets a state to the values the registers have after FNINIT and a
+ * reset of MXCSR.
+ * \param [out] state The state.
+ * \returns None.
+ */
+void fpu_init_state(Fpu_State *state);
+
+/**
+ * \brief Allocates the state of a new context, set by fpu_init_state().
+ * \param None.
+ * \returns The state, or zero if out of memory.
+ */
+Fpu_State *fpu_alloc(void);
+
+/**
+ * \brief Frees the state of a context that has ended, first making sure the
+ * registers are no longer thought to belong to it.
+ * \param [in] state The state, possibly zero.
+ * \returns None.
+ */
+void fpu_release(Fpu_State *state);
+
+/**
+ * \brief Checks that two threads using the SSE registers across thread
+ * switches each keep their own values, and prints the counters.
+ * \param None.
+ * \returns None.
+ */
+void fpu_self_test(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file gdt.c
+ * \brief Global descriptor table function implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "gdt.h"
+#include "idt.h"
+
+/**
+ * \desc Limits above 1 MiB do not fit in the 20 bits of the descriptor, so
+ * they are counted in 4 KiB pages instead, as the boot sector GDT does for its
+ * flat segments.
+ */
+void set_gdt_entry(GDT_Entry *gdt, uint32 n, uint32 base, uint32 limit,
+                   uint8 access) {
+  uint8 granularity = 0x40; /* 0b01000000 */
+
+  if (limit > 0xFFFFF) {
+    limit >>= 12;
+    granularity |= 0x80;
+  }
+
+  gdt[n].limit_low = lo16(limit);
+  gdt[n].base_low = lo16(base);
+  gdt[n].base_mid = lo8(hi16(base));
+  gdt[n].access = access;
+  gdt[n].granularity = granularity | ((limit >> 16) & 0x0F);
+  gdt[n].base_high = hi8(hi16(base));
+}
+
+/**
+ * \desc A segment register only reads its descriptor when it is loaded, so
+ * every register is reloaded after lgdt, CS through a far jump to the next
+ * instruction.
+ */
+void set_gdt(GDT_Entry *gdt, GDT_Register *reg) {
+  reg->base = (uint32)gdt;
+  reg->limit = GDT_ENTRIES * sizeof(GDT_Entry) - 1;
+  __asm__ volatile("lgdtl (%0)\n\t"
+                   "ljmp %1, $1f\n"
+                   "1:\n\t"
+                   "movw %w2, %%ds\n\t"
+                   "movw %w2, %%es\n\t"
+                   "movw %w2, %%fs\n\t"
+                   "movw %w2, %%ss\n\t"
+                   "movw %w3, %%gs"
+                   :
+                   : "r"(reg), "i"(KERNEL_CS), "r"(KERNEL_DS), "r"(PERCPU_DS)
+                   : "memory");
+}
\ No newline at end of file
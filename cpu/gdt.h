@@ -0,0 +1,82 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file gdt.h
+ * \brief Global descriptor table function declarations.
+ *
+ * The boot sector switches to protected mode with a GDT of flat 4 GiB code
+ * and data segments (boot/pikos_gdt.asm), which the kernel keeps using. Each
+ * processor then loads a GDT of its own with the same two segments at the
+ * same selectors, plus a third data segment based at the per-CPU data of that
+ * processor. With GS loaded with that segment, the running processor finds
+ * its own data with a single GS-relative load, whichever processor it is.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef GDT_H
+#define GDT_H
+
+#include "../common/types.h"
+
+/* Entries of a per-CPU GDT: null, kernel code, kernel data and per-CPU data */
+#define GDT_ENTRIES 4
+
+/* Per-CPU data segment selector */
+#define PERCPU_DS 0x18
+
+/* Access bytes: present, ring 0, code (execute/read) or data (read/write) */
+#define GDT_CODE 0x9A
+#define GDT_DATA 0x92
+
+/**
+ * Definition for a segment descriptor. This structure must be packed.
+ */
+typedef struct {
+  uint16 limit_low; /**< Limit bits 0-15 */
+  uint16 base_low;  /**< Base bits 0-15 */
+  uint8 base_mid;   /**< Base bits 16-23 */
+  uint8 access;     /**< Present, privilege level and type */
+  /**
+   * Bits 0-3: Limit bits 16-19.
+   * Bit 6: Set for a 32-bit segment.
+   * Bit 7: Set when the limit counts 4 KiB pages rather than bytes.
+   */
+  uint8 granularity;
+  uint8 base_high; /**< Base bits 24-31 */
+} __attribute__((packed)) GDT_Entry;
+
+/**
+ * Definition for the pointer to a GDT loaded by lgdt. This structure must be
+ * packed.
+ */
+typedef struct {
+  uint16 limit; /**< Size */
+  uint32 base;  /**< Memory address */
+} __attribute__((packed)) GDT_Register;
+
+/**
+ * \brief Sets a GDT entry to a 32-bit segment.
+ * \param [in] gdt The table.
+ * \param [in] n The entry to set.
+ * \param [in] base The linear address the segment starts at.
+ * \param [in] limit The size of the segment minus one, at most 0xFFFFFFFF.
+ * \param [in] access The access byte, GDT_CODE or GDT_DATA.
+ * \returns None.
+ */
+void set_gdt_entry(GDT_Entry *gdt, uint32 n, uint32 base, uint32 limit,
+                   uint8 access);
+
+/**
+ * \brief Loads a GDT of GDT_ENTRIES entries and reloads the kernel code and
+ * data segments and the per-CPU segment in GS from it.
+ * \param [in] gdt The table, kept in place while it is in use.
+ * \param [out] reg The pointer loaded, kept alongside the table.
+ * \returns None.
+ */
+void set_gdt(GDT_Entry *gdt, GDT_Register *reg);
+
+#endif
\ No newline at end of file
@@ -24,6 +24,9 @@
 /* Kernel code segment selector */
 #define KERNEL_CS 0x08
 
+/* Kernel data segment selector */
+#define KERNEL_DS 0x10
+
 /**
  * Definition for a 32-bit interrupt gate. This structure must be packed.
  */
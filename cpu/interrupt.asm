@@ -9,16 +9,20 @@
 ; not. We also handle interrupt requests (IRQs), where the programmable interrupt
 ; controller (PIC) has been remapped to the range 32-47.
 
+; Interrupt statistics are on unless the Makefile passes -DIRQ_STATS=0.
+%ifndef IRQ_STATS
+%define IRQ_STATS 1
+%endif
+
 ; Common ISR function.
 isr_common:
 	pusha               ; Pushes general purpose registers
 	mov   ax, ds        ; Move DS into the lower 16-bits of EAX
 	push  eax           ; Save the data segment descriptor
 	mov   ax, 0x10      ; Copy the kernel data segment descriptor into AX
-	mov   ds, ax        ; and then to all segment registers
-	mov   es, ax
+	mov   ds, ax        ; and then to the segment registers,
+	mov   es, ax        ; leaving GS on the per-CPU data
 	mov   fs, ax
-	mov   gs, ax
     push  esp           ; Push the register pointer
 	
     cld                 ; Clear the direction flag
@@ -28,8 +32,7 @@ isr_common:
 	pop   eax           ; Restore the general purpose registers
 	mov   ds, ax
 	mov   es, ax
-	mov   fs, ax
-	mov   gs, ax        ; Restore the segment registers
+	mov   fs, ax        ; Restore the segment registers
 	popa
 	add   esp, 8        ; Clean up the pushed error code and pushed ISR number
 	iret                ; Interrupt return, pops CS, EIP, EFLAGS, SS, and ESP
@@ -38,24 +41,34 @@ isr_common:
 ;  Common IRQ function.
   irq_common:
     pusha               ; Pushes general purpose registers
+%if IRQ_STATS
+    rdtsc               ; Keep the time-stamp counter on entry
+    mov   ebx, eax      ; in ECX:EBX for the interrupt statistics
+    mov   ecx, edx
+%else
+    xor   ebx, ebx      ; or pass zero when they are compiled out
+    xor   ecx, ecx
+%endif
 	mov   ax, ds        ; Move DS into the lower 16-bits of EAX
 	push  eax           ; Save the data segment descriptor
 	mov   ax, 0x10      ; Copy the kernel data segment descriptor into AX
-	mov   ds, ax        ; and then to all segment registers
-	mov   es, ax
+	mov   ds, ax        ; and then to the segment registers,
+	mov   es, ax        ; leaving GS on the per-CPU data
 	mov   fs, ax
-	mov   gs, ax
-    push  esp           ; Push the register pointer
+    mov   eax, esp      ; Keep the register pointer
+    push  ecx           ; Push the entry time, high half first
+    push  ebx
+    push  eax           ; Push the register pointer
 
     cld                 ; Clear the direction flag
     call  irq_handler   ; Call the C ISQ handling function
 
-    pop   ebx           ; Restore ESP
+    mov   esp, eax      ; Switch to the frame of the thread to resume,
+                        ; which also drops the arguments pushed
     pop   ebx           ; Restore the general purpose registers
     mov   ds, bx
     mov   es, bx
-    mov   fs, bx
-    mov   gs, bx        ; Set the segment registers to EBX
+    mov   fs, bx        ; Set the segment registers to EBX
     popa
     add   esp, 8        ; Clean up the pushed error code and pushed ISR number
     iret                ; Interrupt return, pops CS, EIP, EFLAGS, SS, and ESP
@@ -116,6 +129,9 @@ global irq12
 global irq13
 global irq14
 global irq15
+global irq_yield
+global irq_wake
+global irq_spurious
 
 ; ISR handlers.
 isr0: ; Divide-by-zero exception
@@ -399,4 +415,21 @@ irq15:
 	cli
 	push  byte 15
 	push  byte 47
-	jmp   irq_common
\ No newline at end of file
+	jmp   irq_common
+
+; Software interrupt taken by a thread giving up the CPU, so that the switch
+; happens on the same path as a preempting IRQ.
+irq_yield:
+	push  byte 0
+	push  byte 48
+	jmp   irq_common
+
+; Inter-processor interrupt sent to wake an application processor from hlt.
+irq_wake:
+	push  byte 0
+	push  byte 49
+	jmp   irq_common
+
+; Spurious interrupt from the local APIC, which is not acknowledged.
+irq_spurious:
+	iret
\ No newline at end of file
@@ -11,9 +11,17 @@
  */
 
 #include "isr.h"
+#include "apic.h"
+#include "../common/math.h"
+#include "../common/printf.h"
+#include "../drivers/serial.h"
+#include "../kernel/lock.h"
+#include "../kernel/thread.h"
+#include "../kernel/trace.h"
 
 /* Declare some handler functions for the IRQs */
-ISR interrupt_handlers[256];
+ISR volatile interrupt_handlers[256];
+static Spinlock handlers_lock;
 
 /* List of exception messages */
 char *exception_msgs[] = {"Division By Zero ",
@@ -52,12 +60,70 @@ char *exception_msgs[] = {"Division By Zero ",
                           "Reserved",
                           "Reserved"};
 
+#if IRQ_STATS
+/**
+ * The statistics of one vector, or of the entry to dispatch gap.
+ */
+typedef struct {
+  uint32 count;                     /**< Times recorded */
+  uint32 max;                       /**< Most cycles recorded */
+  uint64 cycles;                    /**< Total cycles, for the mean */
+  uint32 buckets[IRQ_STAT_BUCKETS]; /**< Bucket n counts 2^n to 2^(n+1)-1 */
+} Irq_Stat;
+
+static Irq_Stat vector_stats[IRQ_STAT_VECTORS];
+static Irq_Stat gap_stats;
+
+/**
+ * \brief Adds a duration to a set of statistics.
+ * \param [in,out] stat The statistics.
+ * \param [in] cycles The duration, saturated to 32 bits.
+ * \returns None.
+ */
+static void irq_record(Irq_Stat *stat, uint64 cycles) {
+  const uint32 n = cycles > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32)cycles;
+  uint32 bucket = 0;
+
+  if (n != 0) {
+    __asm__("bsrl %1, %0" : "=r"(bucket) : "rm"(n) : "cc");
+  }
+  ++stat->count;
+  stat->cycles += n;
+  ++stat->buckets[bucket];
+  if (n > stat->max) {
+    stat->max = n;
+  }
+}
+
+/**
+ * \brief Prints the count, mean and maximum of a set of statistics and the
+ * non-empty buckets of its histogram.
+ * \param [in] stat The statistics.
+ * \returns None.
+ */
+static void print_stat(const Irq_Stat* stat) {
+  uint32 i = 0;
+
+  kprintf(": %u taken, mean %u, max %u cycles\n     log2", stat->count,
+          (uint32)udiv64(stat->cycles, stat->count), stat->max);
+  for (i = 0; i < IRQ_STAT_BUCKETS; ++i) {
+    if (stat->buckets[i] != 0) {
+      kprintf(" %u:%u", i, stat->buckets[i]);
+    }
+  }
+  kprintf("\n");
+}
+#endif
+
 /**
  * \desc Populate the interrupt descriptor table with the gates defined in the
  * interrupt.asm routine. Then remap the programmable interrupt controller and
- * set the interrupt request. Finally, load the table.
+ * set the interrupt request. Finally, load the table and switch to the APICs
+ * where the machine has them.
  */
 void isr_install(void) {
+  spin_init(&handlers_lock, "interrupt handlers");
+
   /* Install the interrupt service routines */
   set_idt_gate(0, (uint32)isr0);
   set_idt_gate(1, (uint32)isr1);
@@ -121,32 +187,48 @@ void isr_install(void) {
   set_idt_gate(45, (uint32)irq13);
   set_idt_gate(46, (uint32)irq14);
   set_idt_gate(47, (uint32)irq15);
+  set_idt_gate(IRQ_YIELD, (uint32)irq_yield);
+  set_idt_gate(IRQ_WAKE, (uint32)irq_wake);
+  set_idt_gate(SPURIOUS_VECTOR, (uint32)irq_spurious);
 
   set_idt();
+
+  /* Move over to the APICs if present, masking the PICs */
+  init_apic();
 }
 
 /**
  * \desc An interrupt is identified through the Register interrupt number. We
- * can handle each interrupt therefore individually.
+ * can handle each interrupt therefore individually. An exception with an
+ * installed handler, such as the FPU's #NM, is passed to it; any other is
+ * reported.
  */
 void isr_handler(const Registers* regs) {
-  char num[3] = {0};
-  print("Received interrupt: ");
-  itostr(regs->int_no, num);
-  print(num);
-  print("\n");
-  print(exception_msgs[regs->int_no]);
-  print("\n");
+  const ISR handler = interrupt_handlers[regs->int_no];
+#if IRQ_STATS
+  const uint64 start = rdtsc();
+#endif
+  if (handler != 0) {
+    handler(regs);
+  } else {
+    kprintf("Received interrupt: %u\n%s\n", regs->int_no,
+            exception_msgs[regs->int_no]);
+  }
+#if IRQ_STATS
+  irq_record(&vector_stats[regs->int_no], rdtsc() - start);
+#endif
 }
 
 /**
  * \desc Interrupts are enabled via assembly by setting the interrupt flag. Then
- * the timer interrupt (IRQ0) and the keyboard (IRQ1) are initialised.
+ * the timer interrupt (IRQ0), the keyboard (IRQ1) and the serial port (IRQ4)
+ * are initialised.
  */
 void irq_install(void) {
   __asm__ volatile("sti");
-  init_timer(50);
+  init_timer(TIMER_HZ);
   init_keyboard();
+  init_serial_irq();
 }
 
 /**
@@ -157,26 +239,116 @@ void irq_install(void) {
  * interrupt controller, otherwise it will still think we are still within an
  * interrupt and will not send anymore. If the request is >= 40 (>= the 8th
  * absolute IRQ) then we must also inform the secondary slave PIC (I/O port
- * 0x0A).
+ * 0x0A). When the APICs are in use, a single write to the local APIC takes
+ * the place of both. The yield interrupt does not come from an interrupt
+ * controller and is not acknowledged. The wake IPI only breaks an application
+ * processor out of hlt, so it is acknowledged at the local APIC and returns
+ * straight to the interrupted code. Otherwise the scheduler picks the thread
+ * to return to, whose saved registers irq_common switches the stack to. With
+ * the statistics, the time from the entry time to the dispatch and from the
+ * dispatch to the return of the handler, EOI included, are recorded. The
+ * tracepoints mark the same span, before the scheduler runs.
  */
-void irq_handler(const Registers* regs) {
-  if (regs->int_no >= 40) {
-    port_byte_out(0xA0, 0x20);
-  }
+uint32 irq_handler(Registers* regs, uint64 entry) {
+  ISR handler = 0;
+#if IRQ_STATS
+  const uint64 start = rdtsc();
+  irq_record(&gap_stats, start - entry);
+#endif
+  TRACE_EVENT(TRACE_IRQ_ENTER, 0, regs->int_no);
 
-  port_byte_out(0x20, 0x20);
+  if (regs->int_no <= IRQ15) {
+    if (apic_active()) {
+      lapic_eoi();
+    } else {
+      if (regs->int_no >= 40) {
+        port_byte_out(0xA0, 0x20);
+      }
 
-  if (interrupt_handlers[regs->int_no] != 0) {
-    const ISR handler = interrupt_handlers[regs->int_no];
+      port_byte_out(0x20, 0x20);
+    }
+  }
+
+  handler = interrupt_handlers[regs->int_no];
+  if (handler != 0) {
     handler(regs);
   }
+
+#if IRQ_STATS
+  if (regs->int_no < IRQ_STAT_VECTORS) {
+    irq_record(&vector_stats[regs->int_no], rdtsc() - start);
+  }
+#endif
+  TRACE_EVENT(TRACE_IRQ_EXIT, 0, regs->int_no);
+
+  if (regs->int_no == IRQ_WAKE) {
+    lapic_eoi();
+    return (uint32)regs;
+  }
+
+  return schedule(regs);
 }
 
 /**
  * \desc Installs a function to an index in the handler_functions array. The
  * indices will typically be IRQ0, IRQ1 etc. The installed handler function is
- * general, dealing with timing, keyboard input etc.
+ * general, dealing with timing, keyboard input etc. Installers are serialised
+ * by the lock, while irq_handler() reads the entry once without it: an
+ * aligned pointer store is atomic, so it sees either the old or the new
+ * handler, never a mix of the two.
  */
 void reg_interrupt_handler(uint8 n, const ISR handler) {
+  const uint32 flags = spin_lock_irqsave(&handlers_lock);
   interrupt_handlers[n] = handler;
+  spin_unlock_irqrestore(&handlers_lock, flags);
+}
+
+/**
+ * \desc Exceptions are named by their message, IRQs by their line.
+ */
+void irq_stats(void) {
+#if IRQ_STATS
+  uint32 i = 0;
+
+  for (i = 0; i < IRQ_STAT_VECTORS; ++i) {
+    if (vector_stats[i].count == 0) {
+      continue;
+    }
+    kprintf("   Vector %u", i);
+    if (i < IRQ0) {
+      kprintf(" (%s)", exception_msgs[i]);
+    } else if (i <= IRQ15) {
+      kprintf(" (IRQ%u)", i - IRQ0);
+    } else if (i == IRQ_YIELD) {
+      kprintf(" (yield)");
+    } else if (i == IRQ_WAKE) {
+      kprintf(" (wake IPI)");
+    }
+    print_stat(&vector_stats[i]);
+  }
+  if (gap_stats.count != 0) {
+    kprintf("   Entry to dispatch");
+    print_stat(&gap_stats);
+  }
+#else
+  kprintf("   Interrupt statistics compiled out, build with IRQ_STATS=1\n");
+#endif
+}
+
+/**
+ * \desc The flags are pushed and popped through the stack, as there is no
+ * other way to read or write the interrupt flag together with the rest.
+ */
+uint32 irq_save(void) {
+  uint32 flags = 0;
+  __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+  return flags;
+}
+
+/**
+ * \desc Restores the whole flags register, so interrupts are only enabled
+ * again if they were enabled before irq_save().
+ */
+void irq_restore(uint32 flags) {
+  __asm__ volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
 }
\ No newline at end of file
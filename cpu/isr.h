@@ -16,6 +16,13 @@
  * handled, the PIC is notified such that it can continue to handle further
  * interrupts. 0x20 and 0xA0 are command, 0x21 and 0xA1 are data.
  *
+ * Unless built with IRQ_STATS=0, every interrupt taken is counted per vector
+ * along with the time-stamp counter cycles its handler ran for, in a
+ * histogram of log2 buckets. irq_common also reads the counter on entry,
+ * giving the gap from entering the stub to the dispatch in irq_handler().
+ * Only the BSP takes device interrupts; the APs take just the wake IPI, so
+ * the counts of that vector may miss an update when two are woken at once.
+ *
  * \author Anthony Mercer
  *
  */
@@ -82,6 +89,12 @@ extern void irq13();
 extern void irq14();
 extern void irq15();
 
+/* Software interrupt used to switch threads (implemented in interrupt.asm) */
+extern void irq_yield();
+
+/* Inter-processor interrupt waking a halted processor (in interrupt.asm) */
+extern void irq_wake();
+
 /* Define the new identifiers for the interrupt requests */
 #define IRQ0 32
 #define IRQ1 33
@@ -99,6 +112,18 @@ extern void irq15();
 #define IRQ13 45
 #define IRQ14 46
 #define IRQ15 47
+#define IRQ_YIELD 48
+#define IRQ_WAKE 49
+
+/* Interrupt statistics, on unless the Makefile passes -DIRQ_STATS=0 */
+#ifndef IRQ_STATS
+#define IRQ_STATS 1
+#endif
+
+/* Vectors with statistics (the exceptions and the IRQs), and the log2 cycle
+ * buckets of each histogram */
+#define IRQ_STAT_VECTORS 64
+#define IRQ_STAT_BUCKETS 32
 
 /**
  * Define a struct to hold a number of registers.
@@ -137,9 +162,34 @@ void irq_install(void);
 /**
  * \brief Handles a given interrupt request.
  * \param [in] regs Pass in a set of registers.
+ * \param [in] entry The time-stamp counter on entering irq_common, or zero
+ * when the statistics are compiled out.
+ * \returns The stack pointer to resume from, at the saved registers of the
+ * thread to run next.
+ */
+uint32 irq_handler(Registers* regs, uint64 entry);
+
+/**
+ * \brief Disables interrupts, keeping the previous state of the flag.
+ * \param None.
+ * \returns The flags register before interrupts were disabled.
+ */
+uint32 irq_save(void);
+
+/**
+ * \brief Restores the interrupt flag kept by irq_save().
+ * \param [in] flags The flags register returned by irq_save().
+ * \returns None.
+ */
+void irq_restore(uint32 flags);
+
+/**
+ * \brief Prints the count and handler cycle histogram of every vector taken,
+ * and the entry to dispatch gap.
+ * \param None.
  * \returns None.
  */
-void irq_handler(const Registers* regs);
+void irq_stats(void);
 
 /**
  * \brief Installs a handler function to the index of functions.
@@ -0,0 +1,323 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file smp.c
+ * \brief Multiprocessor start-up and per-CPU data implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "smp.h"
+#include "../common/atomic.h"
+#include "../common/math.h"
+#include "../common/memory.h"
+#include "../common/printf.h"
+#include "../kernel/task.h"
+#include "idt.h"
+#include "isr.h"
+#include "timer.h"
+
+static Cpu cpus[MAX_CPUS];
+static uint32 online = 0;
+
+/* Primes found by each processor in the parallel benchmark */
+static uint32 bench_primes[MAX_CPUS];
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Spins for a number of nanoseconds on the clock.
+ * \param [in] ns The time to wait.
+ * \returns None.
+ */
+static void spin_ns(uint64 ns) {
+  const uint64 end = clock_ns() + ns;
+
+  while (clock_ns() < end) {
+    cpu_relax();
+  }
+}
+
+/**
+ * \brief Gets the address a trampoline label is copied to.
+ * \param [in] label The label in the kernel image.
+ * \returns The address of the label in the copy.
+ */
+static uint32 trampoline_address(const uint8 *label) {
+  return TRAMPOLINE_BASE + (uint32)(label - trampoline_start);
+}
+
+/**
+ * \brief Loads the GDT of a processor, with its per-CPU segment in GS, and
+ * enables its FPU and SSE, which need the per-CPU data. An AP is given the
+ * FPU state of its context first, the BSP's contexts being its threads. The
+ * null descriptor is left zero.
+ * \param [in] cpu The per-CPU data of the running processor.
+ * \returns Zero if an AP's FPU state could not be allocated.
+ */
+static uint32 init_cpu(Cpu *cpu) {
+  const uint32 flags = irq_save();
+
+  if (cpu->index != 0) {
+    cpu->fpu_state = fpu_alloc();
+    if (cpu->fpu_state == 0) {
+      irq_restore(flags);
+      return 0;
+    }
+  }
+
+  cpu->self = cpu;
+  set_gdt_entry(cpu->gdt, KERNEL_CS / 8, 0, 0xFFFFFFFF, GDT_CODE);
+  set_gdt_entry(cpu->gdt, KERNEL_DS / 8, 0, 0xFFFFFFFF, GDT_DATA);
+  set_gdt_entry(cpu->gdt, PERCPU_DS / 8, (uint32)cpu, sizeof(Cpu) - 1,
+                GDT_DATA);
+  set_gdt(cpu->gdt, &cpu->gdt_reg);
+  init_fpu();
+  irq_restore(flags);
+  return 1;
+}
+
+/**
+ * \brief Runs the task posted to a processor and marks it done.
+ * \param [in] cpu The per-CPU data of the running processor.
+ * \returns None.
+ */
+static void run_task(Cpu *cpu) {
+  const uint64 start = clock_ns();
+
+  cpu->task(cpu->arg);
+  cpu->task_ns = clock_ns() - start;
+  barrier();
+  cpu->task = 0;
+}
+
+/**
+ * \brief Starts an AP at the trampoline with the INIT, startup, startup
+ * sequence and waits for it to come online. The second startup IPI is only
+ * sent if the first was missed. An AP that does not come online is sent INIT
+ * again, so that it waits for a startup IPI rather than running late on a
+ * Cpu block that has been reused.
+ * \param [in] cpu The per-CPU data for the AP, with its APIC ID set.
+ * \returns Non-zero if the AP came online.
+ */
+static uint32 start_cpu(Cpu *cpu) {
+  const uint32 size = (uint32)(trampoline_end - trampoline_start);
+  uint64 deadline = 0;
+  uint32 i = 0;
+
+  cpu->stack = (uint8 *)kmalloc(CPU_STACK_SIZE);
+  if (cpu->stack == 0) {
+    return 0;
+  }
+
+  memcpy((void *)TRAMPOLINE_BASE, trampoline_start, size);
+  *(uint32 *)trampoline_address(trampoline_stack) =
+      (uint32)(cpu->stack + CPU_STACK_SIZE);
+  *(Cpu **)trampoline_address(trampoline_cpu) = cpu;
+
+  lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+  spin_ns(SMP_INIT_DELAY_NS);
+  for (i = 0; i < 2 && !cpu->online; ++i) {
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | TRAMPOLINE_VECTOR);
+    spin_ns(SMP_STARTUP_DELAY_NS);
+  }
+
+  deadline = clock_ns() + SMP_ONLINE_TIMEOUT_NS;
+  while (!cpu->online && clock_ns() < deadline) {
+    cpu_relax();
+  }
+  if (!cpu->online) {
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    kfree(cpu->stack);
+    cpu->stack = 0;
+  }
+  return cpu->online;
+}
+
+/**
+ * \brief Checks a number for primality by trial division.
+ * \param [in] n The number.
+ * \returns Non-zero if the number is prime.
+ */
+static uint32 is_prime(uint32 n) {
+  uint32 d = 0;
+
+  if (n < 2) {
+    return 0;
+  }
+  for (d = 2; d * d <= n; ++d) {
+    if (n % d == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * \brief Counts the primes below SMP_BENCH_LIMIT at a stride given by the
+ * processor count, starting at the index of the running processor.
+ * \param [in] arg The stride.
+ * \returns None.
+ */
+static void count_primes(void *arg) {
+  const uint32 stride = (uint32)arg;
+  const Cpu *cpu = cpu_current();
+  uint32 n = 0, found = 0;
+
+  for (n = cpu->index; n < SMP_BENCH_LIMIT; n += stride) {
+    found += is_prime(n);
+  }
+  bench_primes[cpu->index] = found;
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc The APs are started one at a time, as they share the trampoline and
+ * its parameters. Without the APICs only the BSP is brought up.
+ */
+void init_smp(void) {
+  Cpu *bsp = &cpus[0];
+  uint32 i = 0;
+
+  bsp->index = 0;
+  bsp->apic_id = lapic_id();
+  init_cpu(bsp);
+  bsp->online = 1;
+  online = 1;
+
+  if (!apic_active()) {
+    return;
+  }
+
+  for (i = 0; i < apic_cpu_count() && online < MAX_CPUS; ++i) {
+    Cpu *cpu = &cpus[online];
+
+    if (apic_cpu_id(i) == bsp->apic_id) {
+      continue;
+    }
+    cpu->index = online;
+    cpu->apic_id = apic_cpu_id(i);
+    if (start_cpu(cpu)) {
+      ++online;
+    }
+  }
+}
+
+/**
+ * \desc The AP arrives with interrupts disabled and the segments of the boot
+ * GDT. Once it has its own GDT, the shared IDT and its local APIC, it runs
+ * the tasks posted by smp_run() and those it finds in the task deques, and
+ * halts with interrupts enabled when there are none. Work is checked with
+ * interrupts disabled, and sti only takes effect after the following hlt, so
+ * a wake IPI sent in between still ends the hlt. An AP that cannot get its
+ * FPU state halts for good without coming online, and start_cpu() gives up
+ * on it.
+ */
+void ap_main(Cpu *cpu) {
+  if (!init_cpu(cpu)) {
+    while (1) {
+      __asm__ volatile("cli; hlt");
+    }
+  }
+  set_idt();
+  lapic_enable();
+  cpu->online = 1;
+
+  while (1) {
+    __asm__ volatile("cli" : : : "memory");
+    if (cpu->task != 0) {
+      run_task(cpu);
+    } else if (!task_run_one() && task_may_halt()) {
+      __asm__ volatile("sti; hlt" : : : "memory");
+      task_woken();
+    }
+  }
+}
+
+/**
+ * \desc The pointer to the block is the first thing in the per-CPU segment.
+ */
+Cpu *cpu_current(void) {
+  Cpu *cpu = 0;
+  __asm__ volatile("movl %%gs:0, %0" : "=r"(cpu));
+  return cpu;
+}
+
+/**
+ * \desc Counted by init_smp().
+ */
+uint32 smp_cpu_count(void) { return online ? online : 1; }
+
+/**
+ * \desc Processors online take the first indices.
+ */
+Cpu *smp_cpu(uint32 n) { return &cpus[n]; }
+
+/**
+ * \desc The argument is written before the task, which is what an AP checks,
+ * and the store order is kept by x86. The BSP runs its own share before it
+ * waits on the others.
+ */
+void smp_run(Cpu_Task task, void *arg) {
+  uint32 i = 0;
+
+  for (i = 1; i < online; ++i) {
+    cpus[i].arg = arg;
+    barrier();
+    cpus[i].task = task;
+    lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_FIXED | IRQ_WAKE);
+  }
+
+  cpus[0].arg = arg;
+  cpus[0].task = task;
+  run_task(&cpus[0]);
+
+  for (i = 1; i < online; ++i) {
+    while (cpus[i].task != 0) {
+      cpu_relax();
+    }
+  }
+}
+
+/**
+ * \desc The BSP first counts every prime alone, then each processor counts
+ * the numbers congruent to its index modulo the processor count, which
+ * spreads the cost of the larger numbers evenly. The totals must agree.
+ */
+void smp_benchmark(void) {
+  uint64 start = 0;
+  uint32 alone_us = 0, together_us = 0;
+  uint32 i = 0, total = 0, expected = 0;
+
+  start = clock_ns();
+  count_primes((void *)1);
+  alone_us = (uint32)udiv64(clock_ns() - start, 1000);
+  expected = bench_primes[0];
+
+  start = clock_ns();
+  smp_run(count_primes, (void *)online);
+  together_us = (uint32)udiv64(clock_ns() - start, 1000);
+
+  for (i = 0; i < online; ++i) {
+    kprintf("   CPU %u (APIC %u): %u primes in %u us\n", i, cpus[i].apic_id,
+            bench_primes[i], (uint32)udiv64(cpus[i].task_ns, 1000));
+    total += bench_primes[i];
+  }
+
+  kprintf("   %u primes below %u on %u CPUs in %u us, %u us on one", total,
+          SMP_BENCH_LIMIT, online, together_us, alone_us);
+  if (together_us != 0) {
+    const uint32 speedup =
+        (uint32)udiv64((uint64)alone_us * 100, together_us);
+    kprintf(", speedup %u.%02u", speedup / 100, speedup % 100);
+  }
+  kprintf("%s\n", total == expected ? "" : ", MISMATCH");
+}
\ No newline at end of file
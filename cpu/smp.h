@@ -0,0 +1,135 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file smp.h
+ * \brief Multiprocessor start-up and per-CPU data declarations.
+ *
+ * Only the bootstrap processor (BSP) runs the BIOS and the boot sector. The
+ * other processors listed in the MADT, the application processors (APs),
+ * wait until they are sent an INIT IPI followed by startup IPIs, on which
+ * they start in real mode at the page given by the startup vector. Each is
+ * started in turn at the trampoline of boot/pikos_trampoline.asm, copied below
+ * 1 MiB, which switches to protected mode and calls ap_main() on a stack of
+ * its own.
+ *
+ * Every processor, the BSP included, has a Cpu block of per-CPU data and
+ * loads a GDT of its own with a segment based at that block in GS (see
+ * gdt.h), so cpu_current() is one GS-relative load. All of them share the
+ * IDT. The threads, the timers and the ISA interrupts stay on the BSP, while
+ * the APs run the tasks of the work-stealing scheduler (see task.h), or a
+ * task posted to every processor by smp_run(), and halt until woken by the
+ * IRQ_WAKE IPI when there are none.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include "../common/types.h"
+#include "apic.h"
+#include "fpu.h"
+#include "gdt.h"
+
+/* Page below 1 MiB the trampoline is copied to, and its startup vector */
+#define TRAMPOLINE_BASE 0x8000
+#define TRAMPOLINE_VECTOR (TRAMPOLINE_BASE >> 12)
+
+/* Stack size of each application processor */
+#define CPU_STACK_SIZE 4096
+
+/* Delays of the start-up sequence: after INIT, between the startup IPIs and
+ * the longest wait for an AP to come online */
+#define SMP_INIT_DELAY_NS 10000000ULL
+#define SMP_STARTUP_DELAY_NS 200000ULL
+#define SMP_ONLINE_TIMEOUT_NS 100000000ULL
+
+/* Numbers tested for primality by the parallel benchmark */
+#define SMP_BENCH_LIMIT 100000
+
+/* Function pointer definition for work run on every processor */
+typedef void (*Cpu_Task)(void *arg);
+
+/**
+ * The per-CPU data of a processor. The first member must be the pointer to
+ * the block itself, read by cpu_current().
+ */
+typedef struct Cpu {
+  struct Cpu *self;            /**< This block, at offset zero from GS */
+  uint32 index;                /**< Processor number, zero for the BSP */
+  uint32 apic_id;              /**< Local APIC ID */
+  volatile uint32 online;      /**< Set by the processor once running */
+  Cpu_Task volatile task;      /**< Work posted by smp_run(), zero when done */
+  void *arg;                   /**< Argument passed to the task */
+  uint64 task_ns;              /**< Time the last task took */
+  uint8 *stack;                /**< Base of the stack, zero for the BSP */
+  GDT_Entry gdt[GDT_ENTRIES];  /**< The GDT of the processor */
+  GDT_Register gdt_reg;        /**< Pointer to the GDT loaded by set_gdt() */
+  Fpu_State *fpu_owner;        /**< State held in the FPU registers, or zero */
+  Fpu_State *fpu_state;        /**< State of the processor, an AP's context */
+  uint32 fpu_live;             /**< Set if TS is clear since the last switch */
+} Cpu;
+
+/* Trampoline bounds and parameters (implemented in pikos_trampoline.asm) */
+extern uint8 trampoline_start[];
+extern uint8 trampoline_stack[];
+extern uint8 trampoline_cpu[];
+extern uint8 trampoline_end[];
+
+/**
+ * \brief Sets up the per-CPU data of the BSP and starts every AP in the MADT.
+ * Needs the APICs and a calibrated clock for the start-up delays.
+ * \param None.
+ * \returns None.
+ */
+void init_smp(void);
+
+/**
+ * \brief Entry point of an AP, called by the trampoline.
+ * \param [in] cpu The per-CPU data of the processor.
+ * \returns Does not return.
+ */
+void ap_main(Cpu *cpu);
+
+/**
+ * \brief Gets the per-CPU data of the running processor.
+ * \param None.
+ * \returns The per-CPU data, valid once init_smp() has run.
+ */
+Cpu *cpu_current(void);
+
+/**
+ * \brief Gets the number of processors online.
+ * \param None.
+ * \returns The processor count, at least one.
+ */
+uint32 smp_cpu_count(void);
+
+/**
+ * \brief Gets the per-CPU data of a processor online.
+ * \param [in] n The processor index, less than smp_cpu_count().
+ * \returns The per-CPU data.
+ */
+Cpu *smp_cpu(uint32 n);
+
+/**
+ * \brief Runs a task on every processor online, the calling BSP included, and
+ * waits for all of them to finish it.
+ * \param [in] task The function each processor runs.
+ * \param [in] arg The argument passed to the task.
+ * \returns None.
+ */
+void smp_run(Cpu_Task task, void *arg);
+
+/**
+ * \brief Counts primes on every processor and prints the share and time of
+ * each, against the time of the BSP alone.
+ * \param None.
+ * \returns None.
+ */
+void smp_benchmark(void);
+
+#endif
\ No newline at end of file
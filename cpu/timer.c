@@ -11,36 +11,418 @@
  */
 
 #include "timer.h"
+#include "apic.h"
+#include "../common/printf.h"
+#include "../kernel/lock.h"
+#include "../kernel/profile.h"
+#include "../kernel/trace.h"
+#include "../kernel/wheel.h"
+#include "../kernel/work.h"
 
-static uint32 tick = 0;
+/* Fractional bits of the cycles to nanoseconds multiplier */
+#define NS_SHIFT 24
+
+static volatile uint32 interrupts = 0;
+static uint32 tick_hz = 0;
+static uint32 tick_ns = 0;
+
+/* Time-stamp counter calibration, the clock parameters read by every
+ * processor under the seqlock */
+static uint32 tsc_khz = 0;
+static uint32 tsc_ns_mult = 0;
+static uint64 tsc_base = 0;
+static Seqlock clock_lock;
+
+/* Clock event sources, from the least to the most preferred */
+#define SOURCE_PIT 0
+#define SOURCE_LAPIC 1
+#define SOURCE_TSC_DEADLINE 2
+
+static const char *source_names[] = {"PIT", "local APIC timer",
+                                     "TSC-deadline timer"};
+static uint32 source = SOURCE_PIT;
+static uint32 lapic_khz = 0;
+
+/* Cost of arming the event source, in time-stamp counter cycles */
+static uint64 arm_cycles = 0;
+static uint32 arm_count = 0;
+
+/* Deadline asked for by the timer wheel, zero for none, and the profiler
+ * sampling interval, zero when it is not sampling */
+static uint64 wheel_deadline = 0;
+static uint32 sample_ns = 0;
+static uint64 sample_deadline = 0;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Reads the current count of PIT channel 0.
+ *
+ * The count is latched first so that the low and high bytes belong to the
+ * same value.
+ *
+ * \param None.
+ * \returns The current count.
+ */
+static uint16 read_pit_count(void) {
+  uint16 count = 0;
+  port_byte_out(PIT_COMM, PIT0_LATCH);
+  count = port_byte_in(PIT0);
+  count |= port_byte_in(PIT0) << 8;
+  return count;
+}
+
+/**
+ * \brief Calibrates the time-stamp counter, and the local APIC timer where the
+ * APICs are in use, against PIT channel 0.
+ *
+ * Channel 0 is set to count down from 65536 repeatedly, and polled until it
+ * has counted CALIBRATE_TICKS cycles, adding up the distance between reads so
+ * that wrapping is handled. The TSC is read at both ends, giving the TSC
+ * frequency in kHz, from which the 8.24 fixed-point nanoseconds per cycle
+ * multiplier is found. The clock parameters are written under the seqlock,
+ * as the 64-bit base takes two stores. The local APIC timer counts down from
+ * its largest count over the same period, masked so that it cannot interrupt.
+ *
+ * \param None.
+ * \returns None.
+ */
+static void calibrate_clocks(void) {
+  uint32 elapsed = 0, lapic_start = 0, lapic_end = 0;
+  uint16 last = 0, count = 0;
+  uint64 start = 0;
+  uint32 flags = 0;
+
+  port_byte_out(PIT_COMM, PIT0_RATE_FLAG);
+  port_byte_out(PIT0, 0);
+  port_byte_out(PIT0, 0);
+
+  if (apic_active()) {
+    lapic_timer_setup(LAPIC_MASKED);
+    lapic_timer_oneshot(0xFFFFFFFF);
+  }
+
+  last = read_pit_count();
+  start = rdtsc();
+  lapic_start = apic_active() ? lapic_timer_count() : 0;
+  while (elapsed < CALIBRATE_TICKS) {
+    count = read_pit_count();
+    elapsed += (uint16)(last - count);
+    last = count;
+  }
+  lapic_end = apic_active() ? lapic_timer_count() : 0;
+
+  tsc_khz = (uint32)udiv64((rdtsc() - start) * PIT_CLOCK, elapsed * 1000);
+  flags = seq_write_begin(&clock_lock);
+  tsc_ns_mult = tsc_khz ? (uint32)udiv64(1000000ULL << NS_SHIFT, tsc_khz) : 0;
+  tsc_base = rdtsc();
+  seq_write_end(&clock_lock, flags);
+  lapic_khz = (uint32)udiv64((uint64)(lapic_start - lapic_end) * PIT_CLOCK,
+                             elapsed * 1000);
+  if (apic_active()) {
+    lapic_timer_oneshot(0);
+  }
+}
+
+/**
+ * \brief Arms PIT channel 0 to interrupt once.
+ *
+ * The time is converted to PIT cycles and limited to the 16 bits of the
+ * counter, so a deadline further away than about 55 ms fires early and is
+ * simply re-armed. Loading the count in mode 0 restarts the countdown, and the
+ * output rises once, raising IRQ0, when it reaches zero.
+ *
+ * \param [in] delta_ns Nanoseconds from now to interrupt at.
+ * \returns None.
+ */
+static void pit_oneshot(uint64 delta_ns) {
+  uint32 count = 0xFFFF;
+
+  if (delta_ns < PIT_MAX_NS) {
+    count = (uint32)udiv64(delta_ns * PIT_CLOCK, 1000000000);
+    if (count == 0) {
+      count = 1;
+    }
+  }
+
+  port_byte_out(PIT_COMM, PIT0_ONESHOT_FLAG);
+  port_byte_out(PIT0, lo8(count));
+  port_byte_out(PIT0, hi8(count));
+}
+
+/**
+ * \brief Stops PIT channel 0. Writing the mode alone is enough, as mode 0
+ * does not start counting until a count is loaded.
+ * \param None.
+ * \returns None.
+ */
+static void pit_stop(void) { port_byte_out(PIT_COMM, PIT0_ONESHOT_FLAG); }
+
+/**
+ * \brief Arms the clock event source to interrupt once at a deadline.
+ *
+ * The remaining time is limited to TIMER_MAX_NS, so that it converts to the
+ * counts of each source without overflow; a later deadline fires early and is
+ * re-armed. The TSC-deadline source takes an absolute counter value and the
+ * local APIC timer a count at its own frequency. The cycles spent are added
+ * up for uptime().
+ *
+ * \param [in] deadline_ns The clock_ns() time to interrupt at.
+ * \returns None.
+ */
+static void source_arm(uint64 deadline_ns) {
+  const uint64 start = rdtsc();
+  const uint64 now = clock_ns();
+  uint64 delta = 0, count = 0;
+
+  if (deadline_ns > now) {
+    delta = deadline_ns - now < TIMER_MAX_NS ? deadline_ns - now : TIMER_MAX_NS;
+  }
+
+  if (source == SOURCE_TSC_DEADLINE) {
+    lapic_timer_deadline(rdtsc() + udiv64(delta * tsc_khz, 1000000));
+  } else if (source == SOURCE_LAPIC) {
+    count = udiv64(delta * lapic_khz, 1000000);
+    lapic_timer_oneshot(count == 0 ? 1 : count > 0xFFFFFFFF ? 0xFFFFFFFF
+                                                            : (uint32)count);
+  } else {
+    pit_oneshot(delta);
+  }
+
+  arm_cycles += rdtsc() - start;
+  ++arm_count;
+}
+
+/**
+ * \brief Stops the clock event source. A zero deadline or count stops the
+ * local APIC timer.
+ * \param None.
+ * \returns None.
+ */
+static void source_stop(void) {
+  if (source == SOURCE_TSC_DEADLINE) {
+    lapic_timer_deadline(0);
+  } else if (source == SOURCE_LAPIC) {
+    lapic_timer_oneshot(0);
+  } else {
+    pit_stop();
+  }
+}
+
+/**
+ * \brief Arms the event source for the earlier of the wheel deadline and the
+ * next sample, or stops it if there is neither. Called with interrupts
+ * disabled, as the timer interrupt updates both deadlines.
+ * \param None.
+ * \returns None.
+ */
+static void source_rearm(void) {
+  uint64 deadline = wheel_deadline;
+
+  if (sample_ns != 0 && (deadline == 0 || sample_deadline < deadline)) {
+    deadline = sample_deadline;
+  }
+
+  if (deadline == 0) {
+    source_stop();
+  } else {
+    source_arm(deadline);
+  }
+}
 
 /**
  * \brief Callback function for the timer interrupt.
  *
- * The implemented callback function for timer interrupts. The only
- * functionality to handle is incrementing the tick counter.
+ * The implemented callback function for timer interrupts. The event source
+ * only fires when a deadline has been reached, so the interrupt is counted
+ * and the timer wheel is left to the kernel loop as deferred work. While the
+ * profiler is sampling the interrupt may instead be for a sample, which is
+ * taken from the interrupted registers here, and the wheel work is only
+ * raised once its own deadline has passed. The source is then re-armed
+ * directly, as the wheel does not know about the samples.
  *
- * \param [in] reg Not used, present to conform with function pointer
- * prototype.
+ * \param [in] regs The registers of the interrupted code, for the profiler.
  * \returns None.
  */
-static void timer_callback(const Registers* /*reg*/) {
-  ++tick;
+static void timer_callback(const Registers *regs) {
+  uint64 now = 0;
+
+  ++interrupts;
+  TRACE_EVENT(TRACE_TIMER, 0, regs->eip);
+  if (sample_ns == 0) {
+    raise_work(WORK_TIMER);
+    return;
+  }
+
+  now = clock_ns();
+  if (now >= sample_deadline) {
+    profile_sample(regs);
+    sample_deadline = now + sample_ns;
+  }
+  if (wheel_deadline != 0 && now >= wheel_deadline) {
+    wheel_deadline = 0;
+    raise_work(WORK_TIMER);
+  }
+  source_rearm();
 }
 
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
 /**
- * \desc Installs the timer_callback() function to the first handler index,
- * calculates the frequency of the timer interrupt (based on the PIT clock) and
- * communicates this to the PIT I/O port.
+ * \desc Calibrates the clocks on the first call, then installs the
+ * timer_callback() function to the first handler index and the timer wheel to
+ * the timer work. The frequency sets the resolution of the clock ticks and so
+ * of timer deadlines. The event source is the best available: the local APIC
+ * timer in TSC-deadline mode, else in one-shot mode, else the PIT. The local
+ * APIC timer interrupts on the IRQ0 vector, so the same callback serves every
+ * source. The PIT is stopped whichever is chosen, as calibration leaves it
+ * running.
  */
 void init_timer(uint32 freq) {
-  uint32 divisor = PIT_CLOCK / freq;
-  uint8 low = lo8(divisor);
-  uint8 high = hi8(divisor);
+  if (tsc_khz == 0) {
+    seq_init(&clock_lock, "clock");
+    calibrate_clocks();
+  }
+
+  if (freq == 0) {
+    freq = 1;
+  } else if (freq > 1000000) {
+    freq = 1000000;
+  }
+  tick_hz = freq;
+  tick_ns = 1000000000 / freq;
+  interrupts = 0;
 
   reg_interrupt_handler(IRQ0, timer_callback);
+  reg_work_handler(WORK_TIMER, run_timers);
+  pit_stop();
+
+  if (tsc_deadline_supported() && tsc_khz != 0) {
+    source = SOURCE_TSC_DEADLINE;
+    lapic_timer_setup(IRQ0 | LAPIC_TIMER_TSC_DEADLINE);
+  } else if (apic_active() && lapic_khz != 0) {
+    source = SOURCE_LAPIC;
+    lapic_timer_setup(IRQ0 | LAPIC_TIMER_ONESHOT);
+  } else {
+    source = SOURCE_PIT;
+  }
+}
+
+/**
+ * \desc The deadline is kept, so that sampling can arm the source for
+ * whichever comes first.
+ */
+void timer_arm(uint64 deadline_ns) {
+  const uint32 flags = irq_save();
+
+  wheel_deadline = deadline_ns ? deadline_ns : 1;
+  source_rearm();
+  irq_restore(flags);
+}
+
+/**
+ * \desc The source keeps running for the profiler, if it is sampling.
+ */
+void timer_stop(void) {
+  const uint32 flags = irq_save();
+
+  wheel_deadline = 0;
+  source_rearm();
+  irq_restore(flags);
+}
+
+/**
+ * \desc The first sample is taken one interval from now.
+ */
+void timer_sample(uint32 interval_ns) {
+  const uint32 flags = irq_save();
+
+  sample_ns = interval_ns;
+  sample_deadline = clock_ns() + interval_ns;
+  source_rearm();
+  irq_restore(flags);
+}
+
+/**
+ * \desc The rdtsc instruction loads the 64-bit time-stamp counter into EDX:EAX,
+ * which the "A" constraint maps directly onto a 64-bit result.
+ */
+uint64 rdtsc(void) {
+  uint64 result = 0;
+  __asm__ volatile("rdtsc" : "=A"(result));
+  return result;
+}
+
+/**
+ * \desc The cycles since calibration are split into 32-bit halves, each scaled
+ * by the 8.24 fixed-point multiplier, so that the product needs no more than
+ * 64 bits. The parameters are copied under the seqlock, so that a reader on
+ * any processor never pairs a multiplier with half of a base. Before
+ * calibration the clock reads zero.
+ */
+uint64 clock_ns(void) {
+  uint64 cycles = 0, base = 0;
+  uint32 mult = 0, sequence = 0;
+
+  do {
+    sequence = seq_read_begin(&clock_lock);
+    mult = tsc_ns_mult;
+    base = tsc_base;
+  } while (seq_read_retry(&clock_lock, sequence));
+
+  if (mult == 0) {
+    return 0;
+  }
+
+  cycles = rdtsc() - base;
+  return (((uint64)(uint32)cycles * mult) >> NS_SHIFT) +
+         (((uint64)(uint32)(cycles >> 32) * mult) << (32 - NS_SHIFT));
+}
+
+/**
+ * \desc Ticks are derived from the clock rather than counted, as there is no
+ * periodic interrupt to count.
+ */
+uint32 clock_ticks(void) {
+  return tick_ns ? (uint32)udiv64(clock_ns(), tick_ns) : 0;
+}
+
+/**
+ * \desc Returns the frequency given to init_timer(), after limiting.
+ */
+uint32 clock_tick_hz(void) { return tick_hz; }
+
+/**
+ * \desc Returns the counter incremented by timer_callback().
+ */
+uint32 timer_interrupts(void) { return interrupts; }
+
+/**
+ * \desc Returns the frequency found by calibrate_clocks().
+ */
+uint32 tsc_frequency(void) { return tsc_khz; }
+
+/**
+ * \desc Prints the uptime as hours, minutes, seconds and milliseconds, then
+ * the number of timer interrupts, the tick resolution and the TSC frequency,
+ * and on a second line the clock event source and the cycles taken to arm it.
+ */
+void uptime(void) {
+  const uint32 ms = (uint32)udiv64(clock_ns(), 1000000);
+  const uint32 secs = ms / 1000;
 
-  port_byte_out(PIT_COMM, PIT0_FLAG);
-  port_byte_out(PIT0, low);
-  port_byte_out(PIT0, high);
+  kprintf("   Up %u:%02u:%02u.%03u, %u timer interrupts, ticks at %u Hz, "
+          "TSC %u MHz\n",
+          secs / 3600, secs / 60 % 60, secs % 60, ms % 1000, interrupts,
+          tick_hz, tsc_khz / 1000);
+  kprintf("   Events from the %s", source_names[source]);
+  if (source == SOURCE_LAPIC) {
+    kprintf(" at %u MHz", lapic_khz / 1000);
+  }
+  kprintf(", %u cycles to arm\n",
+          arm_count ? (uint32)udiv64(arm_cycles, arm_count) : 0);
 }
\ No newline at end of file
@@ -37,6 +37,32 @@
  *
  * The channel 0 of the PIT connects up to IRQ0.
  *
+ * Before any timer is armed, channel 0 is used to calibrate the processor
+ * time-stamp counter: the count is latched and read back while the
+ * counter runs for CALIBRATE_TICKS PIT cycles, giving the TSC frequency. The
+ * clock then reads the TSC and scales it to nanoseconds with a fixed-point
+ * multiplier, so it costs no port I/O and does not depend on the frequency
+ * given to init_timer().
+ *
+ * The timer is tickless: rather than interrupting at a fixed rate, a clock
+ * event source is armed for the next deadline of the timer wheel, so an idle
+ * CPU is only woken when a timer is due. The best available source is used:
+ * the local APIC timer in TSC-deadline mode, which takes the deadline as a
+ * TSC value, else the local APIC timer in one-shot mode, calibrated against
+ * the PIT along with the TSC, else channel 0 in mode 0. Both local APIC modes
+ * are armed with a single register write and no port I/O. The PIT can only
+ * count 55 ms ahead, so it wakes the CPU that often for later deadlines.
+ *
+ * The local APIC timer is per processor, but only the BSP's is programmed.
+ * The wheel is global and runs on the BSP, as do the threads and the ISA
+ * interrupts, so init_timer() and timer_arm() only ever arm the BSP's timer.
+ * The APs, which only run tasks, leave theirs masked as INIT left it and take
+ * no timer interrupts.
+ *
+ * While the profiler is sampling, the timer interrupt also hands it the
+ * interrupted registers at a fixed interval, and the source is armed for the
+ * earlier of the next sample and the wheel deadline.
+ *
  * \author Anthony Mercer
  *
  */
@@ -45,6 +71,7 @@
 #define TIMER_H
 
 #include "../common/types.h"
+#include "../common/math.h"
 #include "../common/string.h"
 #include "../drivers/screen.h"
 #include "isr.h"
@@ -65,16 +92,117 @@
 #define PIT_COMM 0x43
 
 /** \typdef
- * \brief Channel 0 flag: access mode lo/hi, mode 3 square wave generator,
- * 16-bit binary.
+ * \brief Channel 0 flag: access mode lo/hi, mode 0 interrupt on terminal
+ * count, 16-bit binary.
+ */
+#define PIT0_ONESHOT_FLAG 0x30
+
+/** \typdef
+ * \brief Channel 0 flag used for calibration: access mode lo/hi, mode 2 rate
+ * generator, 16-bit binary.
+ */
+#define PIT0_RATE_FLAG 0x34
+
+/** \typdef
+ * \brief Command latching the channel 0 count so that it can be read.
+ */
+#define PIT0_LATCH 0x00
+
+/** \typdef
+ * \brief PIT cycles to count the TSC over, roughly 50 ms.
+ */
+#define CALIBRATE_TICKS 59659
+
+/** \typdef
+ * \brief Furthest ahead an event source is armed, one second.
+ */
+#define TIMER_MAX_NS 1000000000ULL
+
+/** \typdef
+ * \brief Tick frequency of the clock and the timer wheel, 1 ms resolution.
+ */
+#define TIMER_HZ 1000
+
+/** \typdef
+ * \brief Longest one-shot countdown in nanoseconds, 65535 PIT cycles.
  */
-#define PIT0_FLAG 0x36
+#define PIT_MAX_NS 54924000
 
 /**
- * \brief Registers the timer callback and sends data to PIT I/O port.
- * \param [in] freq The frequency in Hertz to update the timer interrupt.
+ * \brief Registers the timer callback and the timer wheel work.
+ * \param [in] freq The tick frequency in Hertz, i.e. the timer resolution.
  * \returns None.
  */
 void init_timer(uint32 freq);
 
+/**
+ * \brief Arms the clock event source to interrupt once at a deadline.
+ * \param [in] deadline_ns The clock_ns() time to interrupt at.
+ * \returns None.
+ */
+void timer_arm(uint64 deadline_ns);
+
+/**
+ * \brief Stops the clock event source so that it does not interrupt.
+ * \param None.
+ * \returns None.
+ */
+void timer_stop(void);
+
+/**
+ * \brief Calls profile_sample() from the timer interrupt at an interval.
+ * \param [in] interval_ns The nanoseconds between samples, or zero to stop.
+ * \returns None.
+ */
+void timer_sample(uint32 interval_ns);
+
+/**
+ * \brief Reads the processor time-stamp counter.
+ * \param None.
+ * \returns The number of cycles since the processor was reset.
+ */
+uint64 rdtsc(void);
+
+/**
+ * \brief Gets the time since the clock was calibrated.
+ * \param None.
+ * \returns Monotonic time in nanoseconds.
+ */
+uint64 clock_ns(void);
+
+/**
+ * \brief Gets the time since the clock was calibrated in ticks.
+ * \param None.
+ * \returns The tick count.
+ */
+uint32 clock_ticks(void);
+
+/**
+ * \brief Gets the tick frequency given to init_timer().
+ * \param None.
+ * \returns The tick frequency in Hertz.
+ */
+uint32 clock_tick_hz(void);
+
+/**
+ * \brief Gets the number of timer interrupts since init_timer().
+ * \param None.
+ * \returns The interrupt count.
+ */
+uint32 timer_interrupts(void);
+
+/**
+ * \brief Gets the calibrated time-stamp counter frequency.
+ * \param None.
+ * \returns The TSC frequency in kHz, or zero before calibration.
+ */
+uint32 tsc_frequency(void);
+
+/**
+ * \brief Prints the time since boot and the clock sources.
+ * \param None.
+ * \returns None.
+ */
+void uptime(void);
+
 #endif
\ No newline at end of file
@@ -11,6 +11,9 @@
  */
 
 #include "keyboard.h"
+#include "../common/atomic.h"
+#include "../common/printf.h"
+#include "../kernel/trace.h"
 
 /* Maximum number of scancodes */
 #define SC_MAX 57
@@ -23,9 +26,36 @@
 #define LCTRL 0x1D
 #define LALT 0x38
 #define CAPS_LOCK 0x3A
+#define PAGE_UP 0x49
+#define PAGE_DOWN 0x51
 
-#define MAX_BUFFER_LEN 1024
-static char key_buffer[MAX_BUFFER_LEN];
+/* Line being typed, a string buffer so that keys cost the same at any length */
+static char key_line[MAX_BUFFER_LEN];
+static String_Buffer key_buffer = {key_line, 0, MAX_BUFFER_LEN};
+
+/* Mask for indexing the event ring with the free-running head and tail */
+#define KEY_RING_MASK (KEY_RING_SIZE - 1)
+
+/**
+ * A scancode received by the interrupt handler and the time-stamp counter
+ * value when it arrived.
+ */
+typedef struct {
+  uint64 time;    /**< Time-stamp counter on arrival */
+  uint8 scancode; /**< Scancode read from the data port */
+} Key_Event;
+
+/* Event ring: only the interrupt handler moves the head and only
+ * process_keyboard() moves the tail */
+static Key_Event key_ring[KEY_RING_SIZE];
+static volatile uint32 key_head = 0;
+static volatile uint32 key_tail = 0;
+
+/* Ring statistics */
+static volatile uint32 key_dropped = 0;
+static volatile uint32 key_peak = 0;
+static uint32 key_processed = 0;
+static uint32 key_max_latency = 0;
 
 const char *sc_name[] = {
     "ERROR",     "Esc",     "1", "2", "3", "4",      "5",
@@ -46,7 +76,43 @@ const char sc_str[] = {'?',  '?', '1', '2',  '3', '4',  '5', '6', '7', '8',
                        'M',  ',', '.', '/',  '?', '?',  '?', ' '};
 
 /**
- * \brief Prints the character received from the keyboard.
+ * \brief Queues the scancode received from the keyboard.
+ *
+ * Runs in interrupt context, so it does no more than read the scancode and
+ * push it with a time stamp onto the event ring, then raise the keyboard work
+ * for the kernel loop. The event is written before the head is moved, so the
+ * consumer never sees a partial event. When the ring is full the event is
+ * dropped and counted.
+ *
+ * \params [in] regs Not used, present to conform with function pointer
+ * prototype.
+ * \returns None.
+ */
+static void keyboard_callback(const Registers *regs) {
+  const uint8 scancode = port_byte_in(KEY_DATA_PORT);
+  const uint32 head = key_head;
+  uint32 depth = head - atomic_load(&key_tail);
+
+  (void)regs;
+  if (depth >= KEY_RING_SIZE) {
+    ++key_dropped;
+    return;
+  }
+
+  key_ring[head & KEY_RING_MASK].time = rdtsc();
+  key_ring[head & KEY_RING_MASK].scancode = scancode;
+  atomic_store(&key_head, head + 1);
+
+  if (++depth > key_peak) {
+    key_peak = depth;
+  }
+  TRACE_EVENT(TRACE_KEYBOARD, depth, scancode);
+
+  raise_work(WORK_KEYBOARD);
+}
+
+/**
+ * \brief Handles a single scancode from the event ring.
  *
  * The keyboard has many scancodes, only some of which we consider here. For
  * each of these cases, this function prints either the ASCII representation of
@@ -54,45 +120,49 @@ const char sc_str[] = {'?',  '?', '1', '2',  '3', '4',  '5', '6', '7', '8',
  * do not allow the buffer to be less than 1 when backspacing as the prompt
  * symbol should remain. Similarly, the buffer has a maximum length and no input
  * can be entered longer than that length. The TAB key enters up to the number
- * of configured spaces provided there is room in the buffer.
+ * of configured spaces provided there is room in the buffer. Page up and page
+ * down move through the screen scrollback, and any other key returns to the
+ * live screen.
  *
  * \params [in] scancode The number of the keyboard key that is pressed.
  * \returns None.
  */
-static void keyboard_callback(const Registers* regs) {
-  const uint8 scancode = port_byte_in(KEY_DATA_PORT);
+static void process_scancode(uint8 scancode) {
+  if (scancode == PAGE_UP) {
+    scrollback_up();
+    return;
+  } else if (scancode == PAGE_DOWN) {
+    scrollback_down();
+    return;
+  }
 
   if (scancode > SC_MAX) {
     return;
   }
 
+  scrollback_reset();
+
   if (scancode == BACKSPACE) {
-    if (strlen(key_buffer) > 0) {
-      strbs(key_buffer);
+    if (strbuf_bs(&key_buffer)) {
       print_bs();
     }
   } else if (scancode == TAB) {
-    if (strlen(key_buffer) < MAX_BUFFER_LEN - 1) {
-      uint32 i = 0;
-      for (i = 0; i < TAB_SIZE; ++i) {
-        if (strlen(key_buffer) >= MAX_BUFFER_LEN - 1) {
-          break;
-        }
-        strapp(key_buffer, ' ');
-      }
+    uint32 i = 0;
+    while (i < TAB_SIZE && strbuf_app(&key_buffer, ' ')) {
+      ++i;
+    }
+    if (i > 0) {
       print_tab();
     }
   } else if (scancode == ENTER) {
     print_ln();
-    user_input(key_buffer); /* kernel-controlled function */
-    key_buffer[0] = '\0';
+    user_input(key_buffer.data); /* kernel-controlled function */
+    strbuf_clr(&key_buffer);
   } else {
-    if (strlen(key_buffer) < MAX_BUFFER_LEN - 1) {
-      char letter = sc_str[scancode];
-      char str[2] = {0};
-      str[0] = letter;
-      str[1] = '\0';
-      strapp(key_buffer, letter);
+    char str[2] = {0};
+    str[0] = sc_str[scancode];
+    str[1] = '\0';
+    if (strbuf_app(&key_buffer, str[0])) {
       print(str);
     }
   }
@@ -100,6 +170,43 @@ static void keyboard_callback(const Registers* regs) {
 
 /**
  * \desc Installs the keyboard callback function to the second interrupt request
- * (IRQ1).
+ * (IRQ1) and process_keyboard() as the keyboard deferred work.
+ */
+void init_keyboard(void) {
+  reg_work_handler(WORK_KEYBOARD, process_keyboard);
+  reg_interrupt_handler(IRQ1, keyboard_callback);
+}
+
+/**
+ * \desc Takes events from the tail of the ring until it catches up with the
+ * head. Each event is copied out before the tail is moved, so the interrupt
+ * handler cannot overwrite it while it is read. The line editing and any
+ * command entered then run with interrupts enabled.
+ */
+void process_keyboard(void) {
+  while (key_tail != atomic_load(&key_head)) {
+    const uint32 tail = key_tail;
+    const Key_Event event = key_ring[tail & KEY_RING_MASK];
+    uint32 latency = 0;
+
+    atomic_store(&key_tail, tail + 1);
+
+    latency = (uint32)(rdtsc() - event.time);
+    if (latency > key_max_latency) {
+      key_max_latency = latency;
+    }
+    ++key_processed;
+
+    process_scancode(event.scancode);
+  }
+}
+
+/**
+ * \desc Prints the counters kept by the interrupt handler and the consumer.
  */
-void init_keyboard(void) { reg_interrupt_handler(IRQ1, keyboard_callback); }
\ No newline at end of file
+void keyboard_stats(void) {
+  kprintf("   Events processed %u, dropped %u, peak depth %u/%u\n"
+          "   Worst queueing latency %u cycles\n",
+          key_processed, key_dropped, key_peak, KEY_RING_SIZE,
+          key_max_latency);
+}
\ No newline at end of file
@@ -13,6 +13,12 @@
  * scancodes to consider. Here we only handle the general ones. Note that to
  * detect whether a key was released, we can add 0x80 to the scancode.
  *
+ * The interrupt handler only reads the scancode and pushes it, time stamped,
+ * onto a single-producer/single-consumer ring. Line editing and running the
+ * entered command happen outside of interrupt context, in process_keyboard()
+ * run by the kernel loop as deferred work, so a long command never holds off
+ * the timer or other interrupts.
+ *
  * \author Anthony Mercer
  *
  */
@@ -23,8 +29,10 @@
 #include "../common/types.h"
 #include "../cpu/isr.h"
 #include "../cpu/ports.h"
+#include "../cpu/timer.h"
 #include "../drivers/screen.h"
 #include "../kernel/kernel.h"
+#include "../kernel/work.h"
 
 /** \typdef
  * \brief Defines the keyboard data port from which the received scancode can be
@@ -32,6 +40,16 @@
  */
 #define KEY_DATA_PORT 0x60
 
+/** \typdef
+ * \brief Number of events the keyboard ring can hold, a power of two.
+ */
+#define KEY_RING_SIZE 64
+
+/** \typdef
+ * \brief Size of the line buffer, the null terminator included.
+ */
+#define MAX_BUFFER_LEN 1024
+
 /**
  * \brief Registers the keyboard callback.
  * \params None.
@@ -39,4 +57,18 @@
  */
 void init_keyboard(void);
 
+/**
+ * \brief Handles every keyboard event queued since the last call.
+ * \params None.
+ * \returns None.
+ */
+void process_keyboard(void);
+
+/**
+ * \brief Prints the keyboard event ring counters.
+ * \params None.
+ * \returns None.
+ */
+void keyboard_stats(void);
+
 #endif
\ No newline at end of file
@@ -11,17 +11,46 @@
  */
 
 #include "screen.h"
+#include "serial.h"
+#include "../kernel/trace.h"
+
+/* Bytes in a row of text */
+#define ROW_BYTES (2 * MAX_X)
+
+/* Window row at the top of the live screen and rows of scrollback shown */
+static int32 screen_top = 0;
+static uint32 view_rows = 0;
+
+/* Ring of rows that have scrolled off the top of the live screen */
+static uint16 scrollback[SCROLLBACK_ROWS][MAX_X];
+static uint32 scrollback_head = 0;
+static uint32 scrollback_count = 0;
+
+/* Shadow of the live screen, a ring of rows starting at shadow_top */
+static uint16 shadow[MAX_Y][MAX_X];
+static int32 shadow_top = 0;
+
+/* Software cursor and the range of live screen rows not yet flushed */
+static int32 cursor_offset = 0;
+static int32 dirty_first = MAX_Y;
+static int32 dirty_last = -1;
+static uint8 display_moved = 0;
+static uint8 unbuffered = 0;
 
 /*------------------------------------------------------------------------------
  * FUNCTION PROTOTYPES
  * ---------------------------------------------------------------------------*/
-static int32 print_char(uint8 character, int32 x, int32 y, uint8 fg, uint8 bg);
+static int32 print_char(uint8 character, int32 offset, uint8 attr);
 static int32 get_screen_offset(const int32 x, const int32 y);
-static int32 get_offset_x(const int32 offset);
 static int32 get_offset_y(const int32 offset);
-static int32 get_cursor_offset();
+static uint16 *shadow_row(int32 y);
+static void mark_dirty(int32 y);
+static void flush_screen(void);
 static void set_cursor_offset(int32 offset);
 static int32 handle_scrolling(int32 offset);
+static uint8 *live_memory(void);
+static void set_display_start(int32 row);
+static void draw_scrollback(void);
 
 /*------------------------------------------------------------------------------
  * PUBLIC API FUNCTIONS
@@ -30,26 +59,41 @@ static int32 handle_scrolling(int32 offset);
 /**
  * \desc Prints a string at a given location on the screen. If both of the
  * positions are negative, then the string is written to the cursor position.
- * Single character printing is relegated to the print_char() function.
+ * Single character printing is relegated to the print_char() function, which
+ * only writes to the shadow of the screen. The rows written are copied to
+ * video memory and the hardware cursor is moved once the string is done. Text
+ * printed at the cursor is also sent to the serial port.
  */
 void print_at(const char *str, int32 x, int32 y, const uint8 fg,
               const uint8 bg) {
-  int32 offset = 0;
+  const uint8 attr = COLOR(fg, bg);
+  int32 offset = cursor_offset;
+  uint32 i = 0;
 
   /* Set cursor if x/y are negative */
   if (x >= 0 && y >= 0) {
+    if (x >= MAX_X || y >= MAX_Y) {
+      return;
+    }
     offset = get_screen_offset(x, y);
-  } else {
-    offset = get_cursor_offset();
-    x = get_offset_x(offset);
-    y = get_offset_y(offset);
   }
+  TRACE_EVENT(TRACE_PRINT_BEGIN, 0, 0);
+
+  for (i = 0; str[i] != '\0'; ++i) {
+    offset = print_char(str[i], offset, attr);
+    if (unbuffered) {
+      cursor_offset = offset;
+      flush_screen();
+    }
+  }
+
+  cursor_offset = offset;
+  flush_screen();
 
-  for (uint32 i = 0; i < strlen(str); ++i) {
-    offset = print_char(str[i], x, y, fg, bg);
-    x = get_offset_x(offset);
-    y = get_offset_y(offset);
+  if (x < 0 || y < 0) {
+    serial_print(str);
   }
+  TRACE_EVENT(TRACE_PRINT_END, 0, i);
 }
 
 /**
@@ -58,6 +102,15 @@ void print_at(const char *str, int32 x, int32 y, const uint8 fg,
  */
 void print(const char *str) { print_at(str, -1, -1, GREY_LIGHT, BLACK); }
 
+/**
+ * \desc The text is printed as a whole at the cursor, so it is also mirrored
+ * to the serial port.
+ */
+void screen_sink(const char *str, uint32 len) {
+  (void)len;
+  print(str);
+}
+
 /**
  * \desc Prints a given colored string at the cursor location. This function is
  * a wrapper to the print_at() function, passing in a negative position.
@@ -71,52 +124,98 @@ void printc(const char *str, uint8 fg, uint8 bg) {
  * print_char() function. This mimics a destructive backspace (ASCII 0x08).
  */
 void print_bs(void) {
-  int32 offset = get_cursor_offset() - 2;
-  uint32 x = get_offset_x(offset);
-  uint32 y = get_offset_y(offset);
-  print_char(ASCII_BS, x, y, BLACK, BLACK);
+  if (cursor_offset >= 2) {
+    cursor_offset = print_char(ASCII_BS, cursor_offset - 2, COLOR(BLACK, BLACK));
+    flush_screen();
+    serial_write("\b \b", 3);
+  }
 }
 
 /**
- * \desc Gets the current cursor position and prints the number of spaces a tab
- * (ASCII 0x09) is configured to using the print_char() function.
+ * \desc Prints the number of spaces a tab (ASCII 0x09) is configured to at the
+ * current cursor position using the print_char() function.
  */
 void print_tab(void) {
-  int32 offset = get_cursor_offset();
-  uint32 x = get_offset_x(offset);
-  uint32 y = get_offset_y(offset);
-  print_char(ASCII_TAB, x, y, BLACK, BLACK);
+  cursor_offset = print_char(ASCII_TAB, cursor_offset, COLOR(BLACK, BLACK));
+  flush_screen();
+  serial_write("\t", 1);
 }
 
 /**
- * \desc Gets the current cursor position and calls print_char() which
- * consequently increments the row by 1. This mimics a newline/feed line
- * (ASCII 0x0A).
+ * \desc Calls print_char() at the current cursor position which consequently
+ * increments the row by 1. This mimics a newline/feed line (ASCII 0x0A).
  * */
 void print_ln(void) {
-  int32 offset = get_cursor_offset();
-  uint32 x = get_offset_x(offset);
-  uint32 y = get_offset_y(offset);
-  print_char(ASCII_LN, x, y, BLACK, BLACK);
+  cursor_offset = print_char(ASCII_LN, cursor_offset, COLOR(BLACK, BLACK));
+  flush_screen();
+  serial_write("\r\n", 2);
 }
 
 /**
- * \desc Clears the screen by looping over the screen buffer and replacing all
- * characters with a space.
+ * \desc Clears the screen by moving the live screen back to the top of the
+ * window and replacing all of its characters with a space. Any scrollback
+ * being shown is left for the live screen.
  */
 void clear_screen(void) {
-  uint32 i = 0;
+  int32 x = 0, y = 0;
+
+  screen_top = 0;
+  shadow_top = 0;
+  view_rows = 0;
+  display_moved = 1;
+
+  for (y = 0; y < MAX_Y; ++y) {
+    for (x = 0; x < MAX_X; ++x) {
+      shadow[y][x] = ' ' | COLOR(BLACK, BLACK) << 8;
+    }
+    mark_dirty(y);
+  }
+
+  cursor_offset = get_screen_offset(0, 0);
+  flush_screen();
+}
+
+/**
+ * \desc Moves the view up by a page, limited by the number of rows held in
+ * the scrollback ring, and redraws the scrollback page.
+ */
+void scrollback_up(void) {
+  view_rows += MAX_Y;
+  if (view_rows > scrollback_count) {
+    view_rows = scrollback_count;
+  }
+  if (view_rows > 0) {
+    draw_scrollback();
+  }
+}
 
-  uint8 *screen = (uint8 *)VIDEO_ADDRESS;
-  for (i = 0; i < MAX_X * MAX_Y; ++i) {
-    screen[i * 2] = ' ';
-    screen[i * 2 + 1] = COLOR(BLACK, BLACK);
+/**
+ * \desc Moves the view down by a page. Reaching the bottom pans the display
+ * back to the live screen, otherwise the scrollback page is redrawn.
+ */
+void scrollback_down(void) {
+  view_rows = view_rows > MAX_Y ? view_rows - MAX_Y : 0;
+  if (view_rows > 0) {
+    draw_scrollback();
+  } else {
+    set_display_start(screen_top);
+  }
+}
+
+/**
+ * \desc Pans the display back to the live screen, which has been kept up to
+ * date while the scrollback was shown.
+ */
+void scrollback_reset(void) {
+  if (view_rows > 0) {
+    view_rows = 0;
+    set_display_start(screen_top);
   }
-  set_cursor_offset(get_screen_offset(0, 0));
 }
 
 /**
  * \desc Shows the PikOS splash screen whenever a shell is started or restarted.
+ * The prompt is left to the caller so that boot messages can follow the logo.
  */
 void splash_screen(void) {
   clear_screen();
@@ -139,7 +238,48 @@ void splash_screen(void) {
   printc(" dP ", GREY_DARK, BLACK);
   printc("\t  v0.0.1", GREY_DARK, BLACK);
 
-  print("\n\n > ");
+  print("\n\n");
+}
+
+/**
+ * \desc Prints PRINT_BENCH_LINES numbered lines twice: once buffered, and once
+ * with the screen flushed and the cursor moved after every character as the
+ * console did before it was buffered. The cycles taken per character by each,
+ * and the characters per second using the calibrated TSC frequency, are then
+ * printed.
+ */
+void print_benchmark(void) {
+  static const char *line = " The quick brown fox jumps over the lazy dog\n";
+  const uint32 chars = PRINT_BENCH_LINES * (strlen(line) + 4);
+  uint32 cycles[2] = {0};
+  uint32 pass = 0, i = 0;
+  char num[12] = {0};
+
+  for (pass = 0; pass < 2; ++pass) {
+    const uint64 start = rdtsc();
+    unbuffered = pass;
+    for (i = 0; i < PRINT_BENCH_LINES; ++i) {
+      strclr(num);
+      itostr(1000 + i % 1000, num);
+      print(num);
+      print(line);
+    }
+    cycles[pass] = (uint32)(rdtsc() - start);
+  }
+  unbuffered = 0;
+
+  for (pass = 0; pass < 2; ++pass) {
+    print(pass == 0 ? "Buffered: " : "Unbuffered: ");
+    strclr(num);
+    itostr(cycles[pass] / chars, num);
+    print(num);
+    print(" cycles per character, ");
+    strclr(num);
+    itostr((uint32)udiv64((uint64)chars * tsc_frequency() * 1000, cycles[pass]),
+           num);
+    print(num);
+    print(" characters per second\n");
+  }
 }
 
 /*------------------------------------------------------------------------------
@@ -147,63 +287,43 @@ void splash_screen(void) {
  * ---------------------------------------------------------------------------*/
 
 /**
- * \brief Prints a single character to the screen at some location
+ * \brief Prints a single character to the shadow of the screen
  *
- * \desc A provided character is printed to the screen at the given position
- * provided this position lies within the screen buffer, defined by MAX_X
- * and MAX_Y. If the position is negative, the character is printed at
- * the cursor position. A newline character increments the row. If the
- * character is not an escape sequence, the video memory/cursor position
- * offset is increased. Scrolling of the screen is handled through the
- * handle_scrolling() function.
+ * \desc A provided character is written to the shadow of the screen at the
+ * given position, and its row is marked to be flushed to video memory. A
+ * newline character increments the row. If the character is not an escape
+ * sequence, the position is increased. Scrolling of the screen is handled
+ * through the handle_scrolling() function.
  *
  * \param [in] character The character to be printed.
- * \param [in] x The x-position of the character.
- * \param [in] y The y-position of the character.
- * \param [in] attr The color attribute of the character, default to black
- * on white.
+ * \param [in] offset The position of the character on the live screen.
+ * \param [in] attr The color attribute of the character.
  *
  * \returns Position of the cursor/position in video memory.
  */
-static int32 print_char(uint8 character, int32 x, int32 y,
-                        uint8 fg, uint8 bg) {
-  int32 offset = 0;
-  uint8 *vid_mem = (uint8 *)VIDEO_ADDRESS;
-  uint8 attr = COLOR(fg, bg);
-
-  if (x >= MAX_X || y >= MAX_Y) {
-    return get_screen_offset(x, y);
-  }
-
-  if (x >= 0 && y >= 0) {
-    offset = get_screen_offset(x, y);
-  } else {
-    offset = get_cursor_offset();
-  }
+static int32 print_char(uint8 character, int32 offset, uint8 attr) {
+  const int32 y = get_offset_y(offset);
+  uint16 *row = shadow_row(y);
+  const uint16 blank = ' ' | attr << 8;
+  int32 x = (offset - y * ROW_BYTES) / 2;
 
   if (character == ASCII_LN) {
-    y = get_offset_y(offset);
     offset = get_screen_offset(0, y + 1);
   } else if (character == ASCII_BS) {
-    vid_mem[offset] = ' ';
-    vid_mem[offset + 1] = attr;
+    row[x] = blank;
   } else if (character == ASCII_TAB) {
     uint32 i = 0;
-    for (i = 0; i < TAB_SIZE; ++i) {
-      vid_mem[offset] = ' ';
-      vid_mem[offset + 1] = attr;
-      offset += 2;
+    for (i = 0; i < TAB_SIZE && x < MAX_X; ++i) {
+      row[x++] = blank;
     }
+    offset += 2 * i;
   } else {
-    vid_mem[offset] = character;
-    vid_mem[offset + 1] = attr;
+    row[x] = character | attr << 8;
     offset += 2;
   }
 
-  offset = handle_scrolling(offset);
-
-  set_cursor_offset(offset);
-  return offset;
+  mark_dirty(y);
+  return handle_scrolling(offset);
 }
 
 /**
@@ -223,46 +343,69 @@ static int32 get_screen_offset(int32 x, int32 y) {
 }
 
 /**
- * \brief Gets the screen x from a given position in video memory.
+ * \brief Gets the screen y from a given position in video memory.
  *
  * \param [in] offset The current position in video memory.
  *
- * \returns The corresponding screen x.
+ * \returns The corresponding screen y.
  */
-static int32 get_offset_x(int32 offset) {
-  return (offset - (get_offset_y(offset) * 2 * MAX_X)) / 2;
+static int32 get_offset_y(int32 offset) { return offset / (2 * MAX_X); }
+
+/**
+ * \brief Gets a row of the shadow of the live screen.
+ *
+ * \param [in] y The row of the live screen.
+ *
+ * \returns The cells of the row.
+ */
+static uint16 *shadow_row(int32 y) {
+  return shadow[(shadow_top + y) % MAX_Y];
 }
 
 /**
- * \brief Gets the screen y from a given position in video memory.
+ * \brief Marks a row of the live screen to be copied to video memory.
  *
- * \param [in] offset The current position in video memory.
+ * \param [in] y The row of the live screen.
  *
- * \returns The corresponding screen y.
+ * \returns None.
  */
-static int32 get_offset_y(int32 offset) { return offset / (2 * MAX_X); }
+static void mark_dirty(int32 y) {
+  if (y < dirty_first) {
+    dirty_first = y;
+  }
+  if (y > dirty_last) {
+    dirty_last = y;
+  }
+}
 
 /**
- * \brief Gets the cursor position via the video port.
+ * \brief Copies the pending rows to video memory and updates the hardware.
  *
- * \desc The current position of the cursor can be retrieved through querying
- * the video port. The data 14 and 15 access the low and high 8-bits of the
- * position respectively, which is consequently read in. The two bytes are
- * concatenated into a single int and returned in character units.
+ * \desc Every row written since the last flush is copied from the shadow to
+ * the live screen in video memory a whole row at a time. The display start
+ * address is only sent if the screen has scrolled, and the hardware cursor is
+ * moved once for the whole flush rather than once per character.
  *
  * \param None.
  *
- * \returns The current cursor position.
+ * \returns None.
  */
-static int32 get_cursor_offset() {
-  int32 offset = 0;
+static void flush_screen(void) {
+  uint8 *vid_mem = live_memory();
+  int32 y = 0;
 
-  port_byte_out(REG_SCREEN_CTRL, 14);
-  offset = port_byte_in(REG_SCREEN_DATA) << 8;
-  port_byte_out(REG_SCREEN_CTRL, 15);
-  offset += port_byte_in(REG_SCREEN_DATA);
+  for (y = dirty_first; y <= dirty_last; ++y) {
+    memcpy(vid_mem + y * ROW_BYTES, shadow_row(y), ROW_BYTES);
+  }
+  dirty_first = MAX_Y;
+  dirty_last = -1;
 
-  return offset * 2;
+  if (display_moved && view_rows == 0) {
+    set_display_start(screen_top);
+  }
+  display_moved = 0;
+
+  set_cursor_offset(cursor_offset);
 }
 
 /**
@@ -270,18 +413,19 @@ static int32 get_cursor_offset() {
  *
  * \desc The current position of the cursor can be set through querying
  * the video port. The data 14 and 15 accesses the low and high 8-bits of the
- * position respectively. This function sends out the current position of the
- * cursor in, splitting into low and high bytes respectively.
+ * position respectively. This function moves the position from the live screen
+ * into the text window and sends it out, splitting into low and high bytes
+ * respectively.
  *
  * \param [in] offset The current cursor position.
  *
  * \returns None.
  */
 static void set_cursor_offset(int32 offset) {
-  offset /= 2;
-  port_byte_out(REG_SCREEN_CTRL, 14);
+  offset = offset / 2 + screen_top * MAX_X;
+  port_byte_out(REG_SCREEN_CTRL, CRTC_CURSOR_HIGH);
   port_byte_out(REG_SCREEN_DATA, (uint8)(offset >> 8));
-  port_byte_out(REG_SCREEN_CTRL, 15);
+  port_byte_out(REG_SCREEN_CTRL, CRTC_CURSOR_LOW);
   port_byte_out(REG_SCREEN_DATA, (uint8)(offset & 0xff));
 }
 
@@ -289,32 +433,111 @@ static void set_cursor_offset(int32 offset) {
  * \brief Scrolls the screen if required.
  *
  * \desc The function checks if the current position is within the screen, and
- * returns it if it is. If not, each row is moved backward using memcpy() and
- * utilising the fact that we know where the video memory is and how far into
- * it we are. The last line is removed and the cursor position is set back a
- * row and is returned.
+ * returns it if it is. If not, the top row of the shadow is saved to the
+ * scrollback ring and reused as the new, blank bottom row, so the shadow never
+ * moves. The live screen is panned down the text window by a row, which only
+ * costs a CRTC start address update at the next flush. Rows already in video
+ * memory stay where they are, so only the pending rows move up with the screen.
+ * Once the live screen reaches the end of its part of the window, it moves back
+ * to the top of the window and is flushed whole. The cursor position is set
+ * back a row and is returned.
  *
  * \param [in] offset The current position in video memory.
  *
  * \returns The new position in video memory.
  */
 static int32 handle_scrolling(int32 offset) {
-  int32 i = 0;
-  char *last_line = (char *)get_screen_offset(0, MAX_Y - 1) + VIDEO_ADDRESS;
+  uint16 *row = 0;
+  int32 x = 0;
 
   if (offset < MAX_Y * MAX_X * 2) {
     return offset;
   }
 
-  for (i = 1; i < MAX_Y; ++i) {
-    memcpy((char *)(get_screen_offset(0, i)) + VIDEO_ADDRESS,
-           (char *)(get_screen_offset(0, i - 1)) + VIDEO_ADDRESS, MAX_X * 2);
+  row = shadow_row(0);
+  memcpy(scrollback[scrollback_head], row, ROW_BYTES);
+  scrollback_head = (scrollback_head + 1) % SCROLLBACK_ROWS;
+  if (scrollback_count < SCROLLBACK_ROWS) {
+    ++scrollback_count;
+  }
+
+  for (x = 0; x < MAX_X; ++x) {
+    row[x] = 0;
   }
+  shadow_top = (shadow_top + 1) % MAX_Y;
 
-  for (i = 0; i < MAX_X * 2; ++i) {
-    last_line[i] = 0;
+  if (screen_top + MAX_Y < LIVE_ROWS) {
+    ++screen_top;
+    dirty_first = dirty_first > 0 ? dirty_first - 1 : 0;
+    dirty_last = dirty_last > 0 ? dirty_last - 1 : -1;
+    mark_dirty(MAX_Y - 1);
+  } else {
+    screen_top = 0;
+    dirty_first = 0;
+    dirty_last = MAX_Y - 1;
   }
+  display_moved = 1;
 
   offset -= 2 * MAX_X;
   return offset;
+}
+
+/**
+ * \brief Gets the start of the live screen within the text window.
+ *
+ * \param None.
+ *
+ * \returns The address of the top-left character of the live screen.
+ */
+static uint8 *live_memory(void) {
+  return (uint8 *)VIDEO_ADDRESS + screen_top * ROW_BYTES;
+}
+
+/**
+ * \brief Shows the text window from a given row.
+ *
+ * \desc The CRTC start address registers hold the character in the text
+ * window shown at the top-left of the display, split into high and low bytes.
+ *
+ * \param [in] row The row of the text window to show at the top.
+ *
+ * \returns None.
+ */
+static void set_display_start(int32 row) {
+  const uint32 start = row * MAX_X;
+  port_byte_out(REG_SCREEN_CTRL, CRTC_START_HIGH);
+  port_byte_out(REG_SCREEN_DATA, hi8(start));
+  port_byte_out(REG_SCREEN_CTRL, CRTC_START_LOW);
+  port_byte_out(REG_SCREEN_DATA, lo8(start));
+}
+
+/**
+ * \brief Draws the scrollback page and shows it.
+ *
+ * \desc The page starts view_rows rows above the top of the live screen.
+ * Rows above the live screen come from the scrollback ring, newest last, and
+ * any remaining rows are copied from the shadow of the live screen. The page
+ * is drawn in the last MAX_Y rows of the text window, which the live screen
+ * never reaches.
+ *
+ * \param None.
+ *
+ * \returns None.
+ */
+static void draw_scrollback(void) {
+  uint8 *page = (uint8 *)VIDEO_ADDRESS + LIVE_ROWS * ROW_BYTES;
+  int32 row = 0;
+
+  for (row = 0; row < MAX_Y; ++row) {
+    const int32 back = (int32)view_rows - row;
+    if (back > 0) {
+      const uint32 index =
+          (scrollback_head + SCROLLBACK_ROWS - back) % SCROLLBACK_ROWS;
+      memcpy(page + row * ROW_BYTES, scrollback[index], ROW_BYTES);
+    } else {
+      memcpy(page + row * ROW_BYTES, shadow_row(-back), ROW_BYTES);
+    }
+  }
+
+  set_display_start(LIVE_ROWS);
 }
\ No newline at end of file
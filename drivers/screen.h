@@ -6,6 +6,19 @@
  * \file screen.h
  * \brief Screen function definition.
  *
+ * The 32 KiB text window at VIDEO_ADDRESS holds VIDEO_ROWS rows, far more than
+ * the MAX_Y shown at once. Rather than copying the screen up by a row on every
+ * scroll, the live screen is panned down the first LIVE_ROWS rows of the window
+ * through the CRTC start address registers, and is only copied back to the top
+ * when it reaches the end. Each row that leaves the top of the screen is kept
+ * in a scrollback ring of SCROLLBACK_ROWS rows, which is paged through on the
+ * last MAX_Y rows of the window so that the live screen is left untouched.
+ *
+ * Printing goes through a shadow of the live screen in memory and a software
+ * cursor. The rows written by a call are copied to video memory in one pass
+ * when it returns, and the hardware cursor and display start address are only
+ * sent then, rather than reading and writing the cursor for every character.
+ *
  * \author Anthony Mercer
  *
  */
@@ -14,10 +27,12 @@
 #define SCREEN_H
 
 #include "../common/color.h"
+#include "../common/math.h"
 #include "../common/types.h"
 #include "../common/string.h"
 #include "../common/memory.h"
 #include "../cpu/ports.h"
+#include "../cpu/timer.h"
 
 /* Video memory and screen buffer constants */
 #define VIDEO_ADDRESS 0xB8000
@@ -25,6 +40,15 @@
 #define MAX_Y 25
 #define TAB_SIZE 4
 
+/* Rows in the text window, the rows the live screen pans across and the rows
+ * kept once scrolled off */
+#define VIDEO_ROWS 204
+#define LIVE_ROWS (VIDEO_ROWS - MAX_Y)
+#define SCROLLBACK_ROWS 256
+
+/* Lines printed by each pass of print_benchmark() */
+#define PRINT_BENCH_LINES 2000
+
 /* ASCII escape codes */
 #define ASCII_BS 0x08
 #define ASCII_TAB 0x09
@@ -34,6 +58,12 @@
 #define REG_SCREEN_CTRL 0x3D4
 #define REG_SCREEN_DATA 0x3D5
 
+/* CRTC registers for the display start address and the cursor location */
+#define CRTC_START_HIGH 0x0C
+#define CRTC_START_LOW 0x0D
+#define CRTC_CURSOR_HIGH 0x0E
+#define CRTC_CURSOR_LOW 0x0F
+
 /**
  * \brief Clears the screen.
  * \param None.
@@ -94,4 +124,42 @@ void print_tab(void);
  */
 void print_ln(void);
 
+/**
+ * \brief Prints the output of kprintf(), a sink for it.
+ * \param [in] str The null-terminated text.
+ * \param [in] len The length of the text.
+ * \returns None.
+ */
+void screen_sink(const char *str, uint32 len);
+
+/**
+ * \brief Shows the page of scrollback above the one currently shown.
+ * \param None.
+ * \returns None.
+ */
+void scrollback_up(void);
+
+/**
+ * \brief Shows the page of scrollback below the one currently shown, returning
+ * to the live screen at the bottom.
+ * \param None.
+ * \returns None.
+ */
+void scrollback_down(void);
+
+/**
+ * \brief Returns to the live screen if scrollback is being shown.
+ * \param None.
+ * \returns None.
+ */
+void scrollback_reset(void);
+
+/**
+ * \brief Prints a few thousand lines with and without buffering, then prints
+ * the cycles taken per character by each.
+ * \param None.
+ * \returns None.
+ */
+void print_benchmark(void);
+
 #endif
\ No newline at end of file
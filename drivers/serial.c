@@ -0,0 +1,211 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file serial.c
+ * \brief Serial port function implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "serial.h"
+#include "../common/atomic.h"
+#include "../common/printf.h"
+#include "../cpu/isr.h"
+#include "../kernel/lock.h"
+
+/* Mask for indexing the ring with its free-running head and tail */
+#define SERIAL_RING_MASK (SERIAL_RING_SIZE - 1)
+
+/* Set once the UART has passed the loopback test */
+static uint8 present = 0;
+
+/* Transmit ring, written by any printer and read by the interrupt, both under
+ * the lock */
+static Spinlock serial_lock;
+static char tx_ring[SERIAL_RING_SIZE];
+static volatile uint32 tx_head = 0;
+static volatile uint32 tx_tail = 0;
+
+/* Ring statistics */
+static uint32 tx_bytes = 0;
+static uint32 tx_dropped = 0;
+static uint32 tx_peak = 0;
+static uint32 tx_interrupts = 0;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Moves bytes from the ring to the transmit FIFO, if it is empty.
+ *
+ * The holding register empty bit of the line status is set once the whole
+ * FIFO has been sent, so up to UART_FIFO_SIZE bytes can then be written
+ * without checking again. Called with the lock held.
+ *
+ * \param None.
+ * \returns None.
+ */
+static void fill_fifo(void) {
+  uint32 i = 0;
+
+  if ((port_byte_in(COM1 + UART_LSR) & UART_LSR_THRE) == 0) {
+    return;
+  }
+  for (i = 0; i < UART_FIFO_SIZE && tx_tail != tx_head; ++i) {
+    port_byte_out(COM1 + UART_DATA, tx_ring[tx_tail & SERIAL_RING_MASK]);
+    ++tx_tail;
+    ++tx_bytes;
+  }
+}
+
+/**
+ * \brief Callback function for the serial interrupt.
+ *
+ * Reading the interrupt identification register acknowledges the transmit
+ * interrupt, after which the FIFO is refilled from the ring.
+ *
+ * \param [in] regs Not used, present to conform with function pointer
+ * prototype.
+ * \returns None.
+ */
+static void serial_callback(const Registers *regs) {
+  uint32 flags = 0;
+
+  (void)regs;
+  if (port_byte_in(COM1 + UART_IIR) & UART_IIR_NONE) {
+    return;
+  }
+
+  flags = spin_lock_irqsave(&serial_lock);
+  ++tx_interrupts;
+  fill_fifo();
+  spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc Interrupts are disabled at the UART while it is set up. A byte is
+ * sent through the loopback first: if it does not come back, there is no
+ * UART and nothing is ever sent. The divisor is written with the DLAB set,
+ * then the line is set to 8N1, the FIFOs are enabled and cleared, and the
+ * transmit interrupt is enabled with OUT2 connecting it to the IRQ line.
+ */
+void init_serial(void) {
+  const uint16 divisor = UART_CLOCK / SERIAL_BAUD;
+
+  port_byte_out(COM1 + UART_IER, 0);
+  port_byte_out(COM1 + UART_MCR, UART_MCR_LOOPBACK);
+  port_byte_out(COM1 + UART_DATA, 0xAE);
+  if (port_byte_in(COM1 + UART_DATA) != 0xAE) {
+    return;
+  }
+
+  port_byte_out(COM1 + UART_LCR, UART_LCR_DLAB);
+  port_byte_out(COM1 + UART_DLL, lo8(divisor));
+  port_byte_out(COM1 + UART_DLM, hi8(divisor));
+  port_byte_out(COM1 + UART_LCR, UART_LCR_8N1);
+  port_byte_out(COM1 + UART_FCR, UART_FCR_ENABLE);
+  port_byte_out(COM1 + UART_MCR, UART_MCR_NORMAL);
+  port_byte_out(COM1 + UART_IER, UART_IER_THRE);
+
+  spin_init(&serial_lock, "serial");
+  present = 1;
+}
+
+/**
+ * \desc Installs the serial callback to IRQ4.
+ */
+void init_serial_irq(void) {
+  if (present) {
+    reg_interrupt_handler(IRQ4, serial_callback);
+  }
+}
+
+/**
+ * \desc The bytes that fit are pushed onto the ring and the rest dropped.
+ * The FIFO is then filled directly if it is empty, which starts the transmit
+ * interrupts going again after the ring has run dry.
+ */
+void serial_write(const char *data, uint32 len) {
+  uint32 flags = 0, i = 0;
+
+  if (!present) {
+    return;
+  }
+
+  flags = spin_lock_irqsave(&serial_lock);
+  for (i = 0; i < len; ++i) {
+    if (tx_head - tx_tail == SERIAL_RING_SIZE) {
+      tx_dropped += len - i;
+      break;
+    }
+    tx_ring[tx_head & SERIAL_RING_MASK] = data[i];
+    ++tx_head;
+  }
+  if (tx_head - tx_tail > tx_peak) {
+    tx_peak = tx_head - tx_tail;
+  }
+  fill_fifo();
+  spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/**
+ * \desc The string is written up to each newline, which is then sent as a
+ * carriage return and line feed for the terminal.
+ */
+void serial_print(const char *str) {
+  uint32 start = 0, i = 0;
+
+  for (i = 0; str[i] != '\0'; ++i) {
+    if (str[i] == '\n') {
+      serial_write(str + start, i - start);
+      serial_write("\r\n", 2);
+      start = i + 1;
+    }
+  }
+  serial_write(str + start, i - start);
+}
+
+/**
+ * \desc The text is queued as by serial_print(), newlines included.
+ */
+void serial_sink(const char *str, uint32 len) {
+  (void)len;
+  serial_print(str);
+}
+
+/**
+ * \desc The FIFO is refilled here as well as by the interrupt, so the wait
+ * also ends with interrupts disabled.
+ */
+void serial_flush(void) {
+  uint32 flags = 0;
+
+  while (present && atomic_load(&tx_tail) != atomic_load(&tx_head)) {
+    flags = spin_lock_irqsave(&serial_lock);
+    fill_fifo();
+    spin_unlock_irqrestore(&serial_lock, flags);
+    cpu_relax();
+  }
+}
+
+/**
+ * \desc Prints the counters kept by the writers and the interrupt.
+ */
+void serial_stats(void) {
+  if (!present) {
+    kprintf("   No serial port\n");
+    return;
+  }
+  kprintf("   COM1 at %u baud: sent %u, dropped %u, peak depth %u/%u, %u "
+          "interrupts\n",
+          SERIAL_BAUD, tx_bytes, tx_dropped, tx_peak, SERIAL_RING_SIZE,
+          tx_interrupts);
+}
\ No newline at end of file
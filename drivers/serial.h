@@ -0,0 +1,142 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file serial.h
+ * \brief Serial port function definitions.
+ *
+ * The first serial port, COM1, is a 16550 UART at the I/O port range 0x3F8 to
+ * 0x3FF, interrupting on IRQ4. The ports are used for the following:
+ *
+ * 0x3F8 : Transmit holding register (write), receive buffer (read). With the
+ *         divisor latch access bit (DLAB) set, the low byte of the divisor.
+ * 0x3F9 : Interrupt enable register. With DLAB set, the high byte of the
+ *         divisor.
+ * 0x3FA : Interrupt identification register (read), FIFO control (write).
+ * 0x3FB : Line control register, word length, parity, stop bits and DLAB.
+ * 0x3FC : Modem control register, DTR, RTS, OUT2 and loopback.
+ * 0x3FD : Line status register.
+ * 0x3FF : Scratch register.
+ *
+ * The baud rate is UART_CLOCK divided by the divisor, so a divisor of one
+ * gives the highest rate of 115200 baud. The 16550 has 16-byte FIFOs, which
+ * are enabled, so that up to 16 bytes can be written at once.
+ *
+ * Everything printed at the cursor is also sent to the serial port, so the
+ * kernel can be run headless and its output captured. Bytes are pushed onto a
+ * transmit ring and the UART raises IRQ4 whenever its transmit FIFO empties,
+ * upon which up to 16 more bytes are moved from the ring. Writing never waits
+ * on the line status: if the FIFO is empty the first bytes are sent at once,
+ * else they wait in the ring for the interrupt, and if the ring is full they
+ * are dropped and counted. The interrupt may be lost before interrupts are
+ * set up, which the next write recovers from by finding the FIFO empty. Bulk
+ * output that must not be dropped waits for the ring with serial_flush().
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "../common/types.h"
+#include "../cpu/ports.h"
+
+/* COM1 base port and registers, offsets from the base */
+#define COM1 0x3F8
+#define UART_DATA 0
+#define UART_IER 1
+#define UART_IIR 2
+#define UART_FCR 2
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_DLL 0
+#define UART_DLM 1
+
+/* Input clock of the baud rate divisor, and the rate used */
+#define UART_CLOCK 115200
+#define SERIAL_BAUD 115200
+
+/* Interrupt enable: transmit holding register empty */
+#define UART_IER_THRE 0x02
+
+/* Interrupt identification: no interrupt pending, and FIFOs enabled */
+#define UART_IIR_NONE 0x01
+#define UART_IIR_FIFO 0xC0
+
+/* FIFO control: enable and clear both FIFOs, receive trigger at 14 bytes */
+#define UART_FCR_ENABLE 0xC7
+
+/* Line control: 8 data bits, no parity, one stop bit, and the DLAB */
+#define UART_LCR_8N1 0x03
+#define UART_LCR_DLAB 0x80
+
+/* Modem control: DTR, RTS and OUT2, which gates the interrupt line, and the
+ * loopback used to test that the UART is present */
+#define UART_MCR_NORMAL 0x0B
+#define UART_MCR_LOOPBACK 0x1E
+
+/* Line status: transmit holding register empty */
+#define UART_LSR_THRE 0x20
+
+/* Bytes the transmit FIFO holds */
+#define UART_FIFO_SIZE 16
+
+/* Bytes the transmit ring holds, a power of two */
+#define SERIAL_RING_SIZE 4096
+
+/**
+ * \brief Sets up COM1 at SERIAL_BAUD with its FIFOs, if it is present.
+ * \param None.
+ * \returns None.
+ */
+void init_serial(void);
+
+/**
+ * \brief Registers the serial interrupt callback, once interrupts are set up.
+ * \param None.
+ * \returns None.
+ */
+void init_serial_irq(void);
+
+/**
+ * \brief Queues bytes for sending, without waiting on the UART.
+ * \param [in] data The bytes.
+ * \param [in] len The number of bytes.
+ * \returns None.
+ */
+void serial_write(const char *data, uint32 len);
+
+/**
+ * \brief Queues a string for sending, a newline being sent as CR LF.
+ * \param [in] str The null-terminated string.
+ * \returns None.
+ */
+void serial_print(const char *str);
+
+/**
+ * \brief Queues the output of kprintf() for sending, a sink for it.
+ * \param [in] str The null-terminated text.
+ * \param [in] len The length of the text.
+ * \returns None.
+ */
+void serial_sink(const char *str, uint32 len);
+
+/**
+ * \brief Waits until every byte queued has been passed to the UART, for bulk
+ * output such as dumps that must not be dropped.
+ * \param None.
+ * \returns None.
+ */
+void serial_flush(void);
+
+/**
+ * \brief Prints the transmit ring counters.
+ * \param None.
+ * \returns None.
+ */
+void serial_stats(void);
+
+#endif
\ No newline at end of file
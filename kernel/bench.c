@@ -0,0 +1,307 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file bench.c
+ * \brief Benchmark harness implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "bench.h"
+#include "../common/memory.h"
+#include "../common/printf.h"
+#include "../common/string.h"
+#include "../cpu/apic.h"
+#include "../cpu/ports.h"
+#include "../cpu/timer.h"
+#include "../drivers/keyboard.h"
+#include "../drivers/screen.h"
+#include "../drivers/serial.h"
+#include "frame.h"
+
+/* Frames the memory and string benchmarks work on */
+static char *bench_src = 0;
+static char *bench_dest = 0;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Copies 64 bytes, the size of a cache line.
+ * \param [in] ops The copies to make.
+ * \returns Non-zero if the last copy matches.
+ */
+static uint32 bench_memcpy_64(uint32 ops) {
+  uint32 i = 0;
+
+  for (i = 0; i < ops; ++i) {
+    memcpy(bench_dest, bench_src, 64);
+  }
+  return bench_dest[0] == bench_src[0] && bench_dest[63] == bench_src[63];
+}
+
+/**
+ * \brief Copies a whole frame.
+ * \param [in] ops The copies to make.
+ * \returns Non-zero if the last copy matches.
+ */
+static uint32 bench_memcpy_4k(uint32 ops) {
+  uint32 i = 0;
+
+  for (i = 0; i < ops; ++i) {
+    memcpy(bench_dest, bench_src, FRAME_SIZE);
+  }
+  return bench_dest[0] == bench_src[0] &&
+         bench_dest[FRAME_SIZE - 1] == bench_src[FRAME_SIZE - 1];
+}
+
+/**
+ * \brief Measures a string of BENCH_STRING_LEN characters.
+ * \param [in] ops The strings to measure.
+ * \returns Non-zero if the last length is right.
+ */
+static uint32 bench_strlen(uint32 ops) {
+  uint32 i = 0, len = 0;
+
+  for (i = 0; i < ops; ++i) {
+    len = strlen(bench_src);
+  }
+  return len == BENCH_STRING_LEN;
+}
+
+/**
+ * \brief Compares two equal strings of BENCH_STRING_LEN characters, which
+ * must be read to the end.
+ * \param [in] ops The comparisons to make.
+ * \returns Non-zero if the last comparison found them equal.
+ */
+static uint32 bench_strcmp(uint32 ops) {
+  uint32 i = 0;
+  int8 result = 1;
+
+  for (i = 0; i < ops; ++i) {
+    result = strcmp(bench_src, bench_dest);
+  }
+  return result == 0;
+}
+
+/**
+ * \brief Converts the largest signed number to decimal.
+ * \param [in] ops The conversions to make.
+ * \returns Non-zero if the last string is right.
+ */
+static uint32 bench_itostr(uint32 ops) {
+  char num[12] = {0};
+  uint32 i = 0;
+
+  for (i = 0; i < ops; ++i) {
+    itostr(0x7FFFFFFF, num);
+  }
+  return strcmp(num, "2147483647") == 0;
+}
+
+/**
+ * \brief Converts a number with every digit set to hexadecimal. The string
+ * is cleared first, as xtostr() appends to it.
+ * \param [in] ops The conversions to make.
+ * \returns Non-zero if the last string is right.
+ */
+static uint32 bench_xtostr(uint32 ops) {
+  char num[12] = {0};
+  uint32 i = 0;
+
+  for (i = 0; i < ops; ++i) {
+    num[0] = '\0';
+    xtostr(0x7EADBEEF, num);
+  }
+  return strcmp(num, "0x7eadbeef") == 0;
+}
+
+/**
+ * \brief Types a full keyboard line, MAX_BUFFER_LEN - 1 characters, one
+ * strapp() at a time, each finding the end of the line again.
+ * \param [in] ops The lines to build.
+ * \returns Non-zero if the last line is full.
+ */
+static uint32 bench_line_strapp(uint32 ops) {
+  uint32 i = 0, j = 0;
+
+  for (i = 0; i < ops; ++i) {
+    bench_dest[0] = '\0';
+    for (j = 0; j < MAX_BUFFER_LEN - 1; ++j) {
+      strapp(bench_dest, 'k');
+    }
+  }
+  return strlen(bench_dest) == MAX_BUFFER_LEN - 1;
+}
+
+/**
+ * \brief Types a full keyboard line into a string buffer, as the keyboard
+ * driver does.
+ * \param [in] ops The lines to build.
+ * \returns Non-zero if the last line is full.
+ */
+static uint32 bench_line_strbuf(uint32 ops) {
+  String_Buffer sb;
+  uint32 i = 0, j = 0;
+
+  for (i = 0; i < ops; ++i) {
+    strbuf_init(&sb, bench_dest, MAX_BUFFER_LEN);
+    for (j = 0; j < MAX_BUFFER_LEN - 1; ++j) {
+      strbuf_app(&sb, 'k');
+    }
+  }
+  return strlen(bench_dest) == MAX_BUFFER_LEN - 1;
+}
+
+/**
+ * \brief Prints lines of BENCH_LINE_LEN characters, newline included, so
+ * that the screen scrolls once the cursor reaches the bottom.
+ * \param [in] ops The lines to print.
+ * \returns Always non-zero.
+ */
+static uint32 bench_print(uint32 ops) {
+  char line[BENCH_LINE_LEN + 1] = {0};
+  uint32 i = 0;
+
+  for (i = 0; i < BENCH_LINE_LEN - 1; ++i) {
+    line[i] = (char)('A' + i % 26);
+  }
+  line[BENCH_LINE_LEN - 1] = '\n';
+
+  for (i = 0; i < ops; ++i) {
+    print(line);
+  }
+  return 1;
+}
+
+/**
+ * \brief Prints bare newlines at the bottom of the screen, each scrolling it
+ * by a row.
+ * \param [in] ops The newlines to print.
+ * \returns Always non-zero.
+ */
+static uint32 bench_scroll(uint32 ops) {
+  uint32 i = 0;
+
+  for (i = 0; i < ops; ++i) {
+    print_ln();
+  }
+  return 1;
+}
+
+/**
+ * \brief Takes the benchmark interrupt through the whole interrupt path,
+ * handler dispatch, EOI and scheduler included.
+ * \param [in] ops The interrupts to take.
+ * \returns Always non-zero.
+ */
+static uint32 bench_interrupt(uint32 ops) {
+  uint32 i = 0;
+
+  for (i = 0; i < ops; ++i) {
+    __asm__ volatile("int %0" : : "i"(IRQ_BENCH) : "memory");
+  }
+  return 1;
+}
+
+/* The benchmarks, in the order run; the print benchmark leaves the cursor at
+ * the bottom of the screen for the scroll benchmark */
+static const Bench benches[] = {
+    {"memcpy_64", bench_memcpy_64, 1000},
+    {"memcpy_4k", bench_memcpy_4k, 100},
+    {"strlen_256", bench_strlen, 100},
+    {"strcmp_256", bench_strcmp, 100},
+    {"itostr", bench_itostr, 1000},
+    {"xtostr", bench_xtostr, 1000},
+    {"line_strapp", bench_line_strapp, 2},
+    {"line_strbuf", bench_line_strbuf, 100},
+    {"print_line", bench_print, 50},
+    {"scroll", bench_scroll, 50},
+    {"interrupt", bench_interrupt, 1000},
+};
+
+/**
+ * \brief Runs a benchmark BENCH_RUNS times and prints its result line. The
+ * serial port is flushed first, so that output of the benchmark itself
+ * cannot crowd the result out of the ring.
+ * \param [in] bench The benchmark.
+ * \returns Non-zero if every run checked out.
+ */
+static uint32 run_bench(const Bench *bench) {
+  uint32 per_op[BENCH_RUNS] = {0};
+  uint32 run = 0, i = 0, ok = 1;
+
+  for (run = 0; run < BENCH_RUNS; ++run) {
+    const uint64 start = rdtsc();
+    ok = bench->fn(bench->ops) && ok;
+    per_op[run] = (uint32)udiv64(rdtsc() - start, bench->ops);
+  }
+
+  for (run = 1; run < BENCH_RUNS; ++run) {
+    const uint32 value = per_op[run];
+    for (i = run; i > 0 && per_op[i - 1] > value; --i) {
+      per_op[i] = per_op[i - 1];
+    }
+    per_op[i] = value;
+  }
+
+  serial_flush();
+  kprintf("@bench %s %u %u %u%s\n", bench->name, bench->ops, per_op[0],
+          per_op[BENCH_RUNS / 2], ok ? "" : " FAILED");
+  return ok;
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc The source frame is filled with a pattern and starts with a string
+ * of BENCH_STRING_LEN characters, and the destination is a copy of it. Every
+ * benchmark counts as failed if the frames cannot be had.
+ */
+uint32 bench_run(void) {
+  const uint32 count = sizeof(benches) / sizeof(benches[0]);
+  uint32 i = 0, failures = 0;
+
+  if (bench_src == 0) {
+    bench_src = (char *)frame_alloc();
+    bench_dest = (char *)frame_alloc();
+  }
+  if (bench_src == 0 || bench_dest == 0) {
+    kprintf("@bench begin 0\n@bench end %u\n", count);
+    return count;
+  }
+
+  for (i = 0; i < FRAME_SIZE; ++i) {
+    bench_src[i] = (char)(i * 7 + 1);
+  }
+  memset(bench_src, 's', BENCH_STRING_LEN);
+  bench_src[BENCH_STRING_LEN] = '\0';
+  memcpy(bench_dest, bench_src, FRAME_SIZE);
+
+  kprintf("@bench begin %u\n", tsc_frequency());
+  for (i = 0; i < count; ++i) {
+    failures += !run_bench(&benches[i]);
+  }
+  kprintf("@bench end %u\n", failures);
+  serial_flush();
+  return failures;
+}
+
+/**
+ * \desc Interrupts are disabled first, so that only the debug exit or a
+ * reset ends the halt.
+ */
+void bench_exit(uint32 failures) {
+  __asm__ volatile("cli");
+  port_byte_out(BENCH_EXIT_PORT, failures ? 1 : 0);
+  for (;;) {
+    __asm__ volatile("hlt");
+  }
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file bench.h
+ * \brief Benchmark harness declarations.
+ *
+ * The harness runs every micro-benchmark in its table BENCH_RUNS times and
+ * times each run with the time-stamp counter. A benchmark repeats its
+ * operation a given number of times and checks the result of the last one,
+ * so a broken routine fails the suite rather than just looking fast. The
+ * fastest and the median run are reported, in cycles per operation, as the
+ * fastest shows the cost of the code itself and the median how much the
+ * interrupts in between add to it.
+ *
+ * The results are printed, and so also sent over the serial port, as lines
+ * meant for scripts rather than people:
+ *
+ *   @bench begin <TSC kHz>
+ *   @bench <name> <operations per run> <fastest> <median>
+ *   @bench end <failures>
+ *
+ * A kernel built with BENCH=1 runs the suite once it has started and then
+ * leaves QEMU through the isa-debug-exit device, which exits with the value
+ * written shifted left by one, plus one. The suite writes 0 when every
+ * benchmark passed, so QEMU exits with 1, and 1 when any failed, giving 3.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "../common/types.h"
+
+/* Run the suite at boot and exit, on if the Makefile passes -DBENCH=1 */
+#ifndef BENCH
+#define BENCH 0
+#endif
+
+/* Runs of each benchmark, odd so that the median is a run */
+#define BENCH_RUNS 5
+
+/* Port of the QEMU isa-debug-exit device, as set up by make bench */
+#define BENCH_EXIT_PORT 0xF4
+
+/* Length of the strings and of the line printed by the benchmarks */
+#define BENCH_STRING_LEN 256
+#define BENCH_LINE_LEN 64
+
+/* Function pointer definition for benchmarks, given the operations to run */
+typedef uint32 (*Bench_Fn)(uint32 ops);
+
+/**
+ * A benchmark in the table of the harness.
+ */
+typedef struct {
+  const char *name; /**< Name reported, without spaces */
+  Bench_Fn fn;      /**< Runs the operations, non-zero if the result is right */
+  uint32 ops;       /**< Operations per run */
+} Bench;
+
+/**
+ * \brief Runs every benchmark and prints the results.
+ * \param None.
+ * \returns The number of benchmarks that failed.
+ */
+uint32 bench_run(void);
+
+/**
+ * \brief Leaves QEMU through the isa-debug-exit device, halting if there is
+ * none.
+ * \param [in] failures The benchmarks that failed.
+ * \returns Does not return.
+ */
+void bench_exit(uint32 failures);
+
+#endif
\ No newline at end of file
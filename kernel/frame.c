@@ -0,0 +1,310 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file frame.c
+ * \brief Physical page-frame allocator implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "frame.h"
+#include "../common/printf.h"
+#include "lock.h"
+
+/* Frames in the 32-bit physical address space */
+#define MAX_FRAMES 0x100000
+
+/* Upper bound of the 32-bit physical address space */
+#define ADDRESS_LIMIT 0x100000000ULL
+
+/* Bitmap levels: frames, then words of frames, then words of those words */
+static uint32 *frame_map = 0;
+static uint32 frame_map_l1[MAX_FRAMES / 32 / 32];
+static uint32 frame_map_l2[MAX_FRAMES / 32 / 32 / 32];
+static uint32 frame_map_l3 = 0;
+
+static const E820_Map *memory_map = 0;
+static uint32 frame_limit = 0;
+static uint32 frames_free = 0;
+static uint32 frames_total = 0;
+
+/* Guards the bitmap and the free count */
+static Spinlock frame_lock;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Finds the lowest set bit of a non-zero word.
+ * \param [in] word The word to scan.
+ * \returns The index of the lowest set bit.
+ */
+static uint32 lowest_bit(uint32 word) {
+  uint32 index = 0;
+  __asm__("bsf %1, %0" : "=r"(index) : "rm"(word));
+  return index;
+}
+
+/**
+ * \brief Marks a frame as free, setting the summary bits above it.
+ * \param [in] frame The frame number.
+ * \returns One if the frame was previously in use, otherwise zero.
+ */
+static uint32 mark_free(uint32 frame) {
+  const uint32 w0 = frame / 32;
+  const uint32 w1 = w0 / 32;
+  const uint32 w2 = w1 / 32;
+
+  if (frame_map[w0] & (1u << (frame % 32))) {
+    return 0;
+  }
+
+  frame_map[w0] |= 1u << (frame % 32);
+  frame_map_l1[w1] |= 1u << (w0 % 32);
+  frame_map_l2[w2] |= 1u << (w1 % 32);
+  frame_map_l3 |= 1u << w2;
+  return 1;
+}
+
+/**
+ * \brief Marks a frame as used, clearing the summary bits above it whenever
+ * the word below becomes empty.
+ * \param [in] frame The frame number.
+ * \returns One if the frame was previously free, otherwise zero.
+ */
+static uint32 mark_used(uint32 frame) {
+  const uint32 w0 = frame / 32;
+  const uint32 w1 = w0 / 32;
+  const uint32 w2 = w1 / 32;
+
+  if (!(frame_map[w0] & (1u << (frame % 32)))) {
+    return 0;
+  }
+
+  frame_map[w0] &= ~(1u << (frame % 32));
+  if (frame_map[w0] == 0) {
+    frame_map_l1[w1] &= ~(1u << (w0 % 32));
+    if (frame_map_l1[w1] == 0) {
+      frame_map_l2[w2] &= ~(1u << (w1 % 32));
+      if (frame_map_l2[w2] == 0) {
+        frame_map_l3 &= ~(1u << w2);
+      }
+    }
+  }
+  return 1;
+}
+
+/**
+ * \brief Clips a memory map entry to the managed range [1 MiB, 4 GiB).
+ * \param [in] entry The memory map entry.
+ * \param [out] start The first byte of the clipped region.
+ * \param [out] end One past the last byte of the clipped region.
+ * \returns Non-zero if any of the region remains after clipping.
+ */
+static uint32 clip_entry(const E820_Entry *entry, uint64 *start,
+                         uint64 *end) {
+  *start = entry->base;
+  *end = entry->base + entry->length;
+
+  if (*start < FRAME_LOW_LIMIT) {
+    *start = FRAME_LOW_LIMIT;
+  }
+  if (*end > ADDRESS_LIMIT) {
+    *end = ADDRESS_LIMIT;
+  }
+  return *start < *end;
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc The highest usable address determines how many frames are tracked and
+ * so the size of the frame level of the bitmap, which is placed at the start
+ * of the first usable region that can hold it. Every frame starts as used, then
+ * the usable regions are freed (rounded inwards) and any reserved regions are
+ * marked as used again (rounded outwards), so overlapping entries err on the
+ * side of caution. Finally the frames holding the bitmap itself are taken.
+ */
+void init_frames(const E820_Map *map) {
+  uint64 start = 0, end = 0;
+  uint32 map_bytes = 0;
+  uint32 i = 0, f = 0;
+
+  spin_init(&frame_lock, "frames");
+  memory_map = map;
+
+  for (i = 0; i < map->count; ++i) {
+    const E820_Entry *entry = &map->entries[i];
+    if (entry->type == E820_USABLE && clip_entry(entry, &start, &end) &&
+        (uint32)(end >> 12) > frame_limit) {
+      frame_limit = (uint32)(end >> 12);
+    }
+  }
+
+  map_bytes = ((frame_limit + 31) / 32) * 4;
+  for (i = 0; i < map->count && frame_map == 0; ++i) {
+    const E820_Entry *entry = &map->entries[i];
+    if (entry->type == E820_USABLE && clip_entry(entry, &start, &end)) {
+      start = (start + FRAME_SIZE - 1) & ~(uint64)(FRAME_SIZE - 1);
+      if (start + map_bytes <= end) {
+        frame_map = (uint32 *)(uint32)start;
+      }
+    }
+  }
+
+  if (frame_map == 0) {
+    frame_limit = 0;
+    return;
+  }
+
+  for (i = 0; i < map_bytes / 4; ++i) {
+    frame_map[i] = 0;
+  }
+
+  for (i = 0; i < map->count; ++i) {
+    const E820_Entry *entry = &map->entries[i];
+    if (entry->type == E820_USABLE && clip_entry(entry, &start, &end)) {
+      for (f = (uint32)((start + FRAME_SIZE - 1) >> 12);
+           f < (uint32)(end >> 12); ++f) {
+        frames_free += mark_free(f);
+      }
+    }
+  }
+
+  for (i = 0; i < map->count; ++i) {
+    const E820_Entry *entry = &map->entries[i];
+    if (entry->type != E820_USABLE && clip_entry(entry, &start, &end)) {
+      for (f = (uint32)(start >> 12);
+           f < (uint32)((end + FRAME_SIZE - 1) >> 12) && f < frame_limit;
+           ++f) {
+        frames_free -= mark_used(f);
+      }
+    }
+  }
+
+  for (f = (uint32)frame_map / FRAME_SIZE;
+       f < ((uint32)frame_map + map_bytes + FRAME_SIZE - 1) / FRAME_SIZE; ++f) {
+    frames_free -= mark_used(f);
+  }
+
+  frames_total = frames_free;
+}
+
+/**
+ * \desc Walks down from the top-level word, taking the lowest set bit at each
+ * level to find a word of frames with at least one free frame in it. The frame
+ * is marked as used, which clears the summary bits of any word left empty.
+ * Frames are taken from any thread, handler or processor, so the walk is made
+ * under frame_lock with interrupts disabled.
+ */
+uint32 frame_alloc(void) {
+  uint32 w2 = 0, w1 = 0, w0 = 0, frame = 0;
+  const uint32 flags = spin_lock_irqsave(&frame_lock);
+
+  if (frame_map_l3 == 0) {
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return 0;
+  }
+
+  w2 = lowest_bit(frame_map_l3);
+  w1 = w2 * 32 + lowest_bit(frame_map_l2[w2]);
+  w0 = w1 * 32 + lowest_bit(frame_map_l1[w1]);
+  frame = w0 * 32 + lowest_bit(frame_map[w0]);
+
+  mark_used(frame);
+  --frames_free;
+  spin_unlock_irqrestore(&frame_lock, flags);
+  return frame * FRAME_SIZE;
+}
+
+/**
+ * \desc Addresses that are misaligned, outside of the managed range or that
+ * are already free are ignored, so a double free cannot corrupt the count.
+ */
+void frame_free(uint32 addr) {
+  const uint32 frame = addr / FRAME_SIZE;
+  uint32 flags = 0;
+
+  if (addr % FRAME_SIZE != 0 || addr < FRAME_LOW_LIMIT ||
+      frame >= frame_limit) {
+    return;
+  }
+
+  flags = spin_lock_irqsave(&frame_lock);
+  frames_free += mark_free(frame);
+  spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+/**
+ * \desc Returns the running count kept by frame_alloc() and frame_free().
+ */
+uint32 frame_free_count(void) { return frames_free; }
+
+/**
+ * \desc Prints each memory map entry as its base address, its size in KiB and
+ * its type, followed by the number of free and total frames.
+ */
+void frame_stats(void) {
+  uint32 i = 0;
+
+  for (i = 0; memory_map != 0 && i < memory_map->count; ++i) {
+    const E820_Entry *entry = &memory_map->entries[i];
+    kprintf("   0x%x %u KiB type %u\n", (uint32)entry->base,
+            (uint32)(entry->length >> 10), entry->type);
+  }
+
+  kprintf("   Frames free %u of %u (%u MiB)\n", frames_free, frames_total,
+          frames_free / 256);
+}
+
+/**
+ * \desc Takes up to FRAME_TEST_COUNT frames, checking that each is aligned and
+ * within the managed range, then returns them all and checks that the free
+ * count is restored. The time-stamp counter gives the cycles spent per frame.
+ */
+void frame_self_test(void) {
+  static uint32 frames[FRAME_TEST_COUNT];
+  const uint32 before = frames_free;
+  const uint32 n = before < FRAME_TEST_COUNT ? before : FRAME_TEST_COUNT;
+  uint32 alloc_cycles = 0, free_cycles = 0;
+  uint32 i = 0, ok = 1;
+  uint64 start = 0;
+
+  if (n == 0) {
+    kprintf("Frame allocator: no usable memory\n");
+    return;
+  }
+
+  start = rdtsc();
+  for (i = 0; i < n; ++i) {
+    frames[i] = frame_alloc();
+  }
+  alloc_cycles = (uint32)(rdtsc() - start);
+
+  for (i = 0; i < n; ++i) {
+    if (frames[i] < FRAME_LOW_LIMIT || frames[i] % FRAME_SIZE != 0) {
+      ok = 0;
+    }
+  }
+
+  start = rdtsc();
+  for (i = 0; i < n; ++i) {
+    frame_free(frames[i]);
+  }
+  free_cycles = (uint32)(rdtsc() - start);
+
+  if (frames_free != before) {
+    ok = 0;
+  }
+
+  kprintf("Frame allocator: %u MiB, %u frames, alloc %u cycles, free %u "
+          "cycles, %s\n",
+          frames_total / 256, n, alloc_cycles / n, free_cycles / n,
+          ok ? "OK" : "FAILED");
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file frame.h
+ * \brief Physical page-frame allocator declarations.
+ *
+ * The boot sector queries the BIOS E820 function for the physical memory map
+ * and hands it to the kernel. Usable memory above 1 MiB is split into 4 KiB
+ * frames, which are tracked by a hierarchical bitmap: one bit per frame, one
+ * bit per non-empty word of frames and so on up to a single top-level word. A
+ * set bit means free, so finding a free frame takes a bit scan per level and
+ * both allocation and freeing run in O(log32 n), i.e. four steps for 4 GiB.
+ *
+ * The frame level of the bitmap lives at the start of the first usable region
+ * that can hold it, while the small upper levels are static.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "../common/types.h"
+#include "../common/string.h"
+#include "../cpu/timer.h"
+#include "../drivers/screen.h"
+
+/* Size of a physical page frame */
+#define FRAME_SIZE 4096
+
+/* Frames below this address hold the kernel, its stack and the BIOS data */
+#define FRAME_LOW_LIMIT 0x100000
+
+/* Memory map entry type for usable RAM */
+#define E820_USABLE 1
+
+/* Number of frames taken by the boot-time self-test */
+#define FRAME_TEST_COUNT 1024
+
+/**
+ * A single memory map entry as written by the BIOS. This structure must be
+ * packed.
+ */
+typedef struct {
+  uint64 base;   /**< Physical start address of the region */
+  uint64 length; /**< Size of the region in bytes */
+  uint32 type;   /**< Region type, 1 for usable RAM */
+  uint32 acpi;   /**< ACPI 3.0 extended attributes, not always written */
+} __attribute__((packed)) E820_Entry;
+
+/**
+ * The memory map stored by the boot sector. This structure must be packed.
+ */
+typedef struct {
+  uint16 count;         /**< Number of entries */
+  uint16 reserved;      /**< Unused */
+  E820_Entry entries[]; /**< The entries themselves */
+} __attribute__((packed)) E820_Map;
+
+/**
+ * \brief Builds the frame bitmap from the BIOS memory map.
+ * \param [in] map The memory map stored by the boot sector.
+ * \returns None.
+ */
+void init_frames(const E820_Map *map);
+
+/**
+ * \brief Allocates a single physical frame.
+ * \param None.
+ * \returns The physical address of the frame, or zero if memory is exhausted.
+ */
+uint32 frame_alloc(void);
+
+/**
+ * \brief Returns a frame to the allocator.
+ * \param [in] addr The physical address of a frame from frame_alloc().
+ * \returns None.
+ */
+void frame_free(uint32 addr);
+
+/**
+ * \brief Gets the number of frames currently free.
+ * \param None.
+ * \returns The number of free frames.
+ */
+uint32 frame_free_count(void);
+
+/**
+ * \brief Prints the memory map and the frame usage.
+ * \param None.
+ * \returns None.
+ */
+void frame_stats(void);
+
+/**
+ * \brief Allocates and frees a batch of frames, checking the results and
+ * printing the number of cycles taken per frame.
+ * \param None.
+ * \returns None.
+ */
+void frame_self_test(void);
+
+#endif
\ No newline at end of file
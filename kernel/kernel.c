@@ -12,22 +12,63 @@
 
 #include "kernel.h"
 #include "../common/color.h"
+#include "../common/printf.h"
+#include "../cpu/apic.h"
+#include "../cpu/cpuid.h"
+#include "../cpu/fpu.h"
 #include "../cpu/isr.h"
+#include "../cpu/smp.h"
 #include "../drivers/screen.h"
+#include "../drivers/serial.h"
+#include "bench.h"
+#include "frame.h"
+#include "lock.h"
+#include "profile.h"
+#include "task.h"
+#include "thread.h"
+#include "trace.h"
+#include "wheel.h"
+#include "work.h"
 
 /**
  *
  * \brief The main entry point for the kernel.
  *
- * Clears the screen, initialises interrupts and starts the shell.
+ * Reads the processor features, sets up the serial port and the kprintf()
+ * sinks, clears the screen, builds the page-frame allocator from the memory
+ * map passed in by the boot sector and checks it along with the kernel heap,
+ * makes itself the kernel thread, initialises interrupts, starts the other
+ * processors, binds the dispatched routines to the implementations that suit
+ * the processor, checks and times the memory routines and then hands over to
+ * the kernel loop, which runs the shell as deferred keyboard work and halts
+ * the CPU when there is nothing to do. A kernel built with BENCH=1 instead
+ * runs the benchmark suite and exits QEMU.
  *
- * \param None.
+ * \param [in] map The BIOS memory map stored by the boot sector.
  * \return None.
  */
-void pikos_main(void) {
+void pikos_main(const E820_Map *map) {
+  init_cpuid();
+  init_serial();
+  kprintf_add_sink(screen_sink);
+  kprintf_add_sink(trace_sink);
   splash_screen();
+  init_frames(map);
+  frame_self_test();
+  kmalloc_self_test();
+  init_threads();
   isr_install();
   irq_install();
+  init_smp();
+  cpu_dispatch();
+  memory_benchmark();
+  print("\n > ");
+  init_tasks();
+#if BENCH
+  bench_exit(bench_run());
+#endif
+
+  kernel_loop();
 }
 
 /**
@@ -37,12 +78,90 @@ void pikos_main(void) {
 void user_input(const char *input) {
   if (strcmp(input, "QUIT") == 0) {
     print("CPU halted!\n");
-    __asm__ volatile("hlt");
+    __asm__ volatile("cli; hlt");
   } else if (strcmp(input, "CLEAR") == 0) {
     clear_screen();
     print("\n > ");
   } else if (strcmp(input, "RESTART") == 0) {
     splash_screen();
+    print(" > ");
+  } else if (strcmp(input, "MEMORY") == 0) {
+    frame_stats();
+    kmalloc_stats();
+    print(" > ");
+  } else if (strcmp(input, "UPTIME") == 0) {
+    uptime();
+    print(" > ");
+  } else if (strcmp(input, "TIMERS") == 0) {
+    timer_stats();
+    print(" > ");
+  } else if (strcmp(input, "SLEEP") == 0) {
+    sleep_test();
+    print(" > ");
+  } else if (strcmp(input, "THREADS") == 0) {
+    thread_stats();
+    print(" > ");
+  } else if (strcmp(input, "SWITCHBENCH") == 0) {
+    switch_benchmark();
+    print(" > ");
+  } else if (strcmp(input, "APIC") == 0) {
+    apic_stats();
+    interrupt_benchmark();
+    print(" > ");
+  } else if (strcmp(input, "SMP") == 0) {
+    smp_benchmark();
+    print(" > ");
+  } else if (strcmp(input, "TASKS") == 0) {
+    task_benchmark();
+    task_stats();
+    print(" > ");
+  } else if (strcmp(input, "LOCKS") == 0) {
+    lock_stats();
+    lock_benchmark();
+    print(" > ");
+  } else if (strcmp(input, "IRQSTAT") == 0) {
+    irq_stats();
+    print(" > ");
+  } else if (strcmp(input, "IDLE") == 0) {
+    idle_stats();
+    print(" > ");
+  } else if (strcmp(input, "KEYSTAT") == 0) {
+    keyboard_stats();
+    print(" > ");
+  } else if (strcmp(input, "PRINTBENCH") == 0) {
+    print_benchmark();
+    print(" > ");
+  } else if (strcmp(input, "SERIAL") == 0) {
+    serial_stats();
+    print(" > ");
+  } else if (strcmp(input, "TRACE") == 0) {
+    if (trace_mask != 0) {
+      kprintf("   Sent %u trace records over serial\n", trace_dump());
+    } else if (trace_start()) {
+      print("   Tracing, enter TRACE again to send the trace over serial\n");
+    } else {
+      print("   Tracing is compiled out or out of memory\n");
+    }
+    print(" > ");
+  } else if (strcmp(input, "CPUINFO") == 0) {
+    cpu_info_print();
+    print(" > ");
+  } else if (strcmp(input, "FPU") == 0) {
+    fpu_self_test();
+    print(" > ");
+  } else if (strcmp(input, "BENCH") == 0) {
+    bench_run();
+    print(" > ");
+  } else if (strcmp(input, "PROFILE") == 0) {
+    if (profile_running()) {
+      profile_stop();
+      profile_report();
+    } else if (profile_start()) {
+      print("   Profiling, enter PROFILE again to stop\n");
+    } else {
+      print("   Out of memory for the profile\n");
+    }
+    print(" > ");
   } else {
     print("   ");
     print(input);
@@ -0,0 +1,242 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file lock.c
+ * \brief Spinlock and seqlock implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "lock.h"
+#include "../common/math.h"
+#include "../common/printf.h"
+#include "../cpu/isr.h"
+#include "../cpu/smp.h"
+#include "../cpu/timer.h"
+
+static Spinlock *all_locks = 0;
+
+/* Locks timed by the benchmark, and the counter shared by the processors in
+ * the contended pass */
+static Spinlock bench_lock;
+static Seqlock bench_seq;
+static uint32 bench_count = 0;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Takes the benchmark lock repeatedly, incrementing the counter it
+ * protects.
+ * \param [in] arg Not used.
+ * \returns None.
+ */
+static void contend(void *arg) {
+  uint32 i = 0;
+
+  (void)arg;
+  for (i = 0; i < LOCK_CONTEND_ROUNDS; ++i) {
+    spin_lock(&bench_lock);
+    ++bench_count;
+    spin_unlock(&bench_lock);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc A lock of all zeroes is also unlocked, so a static lock may be taken
+ * before it is initialised; it is just not listed.
+ */
+void spin_init(Spinlock *lock, const char *name) {
+  const uint32 flags = irq_save();
+
+  lock->next = 0;
+  lock->owner = 0;
+  lock->acquired = 0;
+  lock->contended = 0;
+  lock->spins = 0;
+  lock->name = name;
+  lock->all_next = all_locks;
+  all_locks = lock;
+  irq_restore(flags);
+}
+
+/**
+ * \desc The ticket is taken with a locked xadd. The owner count is loaded
+ * once before spinning, so an uncontended lock costs the xadd and one load.
+ */
+void spin_lock(Spinlock *lock) {
+  const uint32 ticket = atomic_fetch_add(&lock->next, 1);
+  uint32 spins = 0;
+
+  while (atomic_load(&lock->owner) != ticket) {
+    cpu_relax();
+    ++spins;
+  }
+
+  ++lock->acquired;
+  if (spins != 0) {
+    ++lock->contended;
+    lock->spins += spins;
+  }
+}
+
+/**
+ * \desc Only the holder writes the owner count, so a plain store after the
+ * critical section is enough.
+ */
+void spin_unlock(Spinlock *lock) {
+  atomic_store(&lock->owner, lock->owner + 1);
+}
+
+/**
+ * \desc Interrupts are disabled before the ticket is taken, so the lock is
+ * never held while an interrupt handler on the same processor waits for it.
+ */
+uint32 spin_lock_irqsave(Spinlock *lock) {
+  const uint32 flags = irq_save();
+  spin_lock(lock);
+  return flags;
+}
+
+/**
+ * \desc The lock is released before interrupts are enabled again.
+ */
+void spin_unlock_irqrestore(Spinlock *lock, uint32 flags) {
+  spin_unlock(lock);
+  irq_restore(flags);
+}
+
+/**
+ * \desc The sequence starts even, i.e. with no write in progress.
+ */
+void seq_init(Seqlock *seq, const char *name) {
+  seq->sequence = 0;
+  spin_init(&seq->lock, name);
+}
+
+/**
+ * \desc The sequence is made odd before any of the data is written, which
+ * x86 keeps in store order.
+ */
+uint32 seq_write_begin(Seqlock *seq) {
+  const uint32 flags = spin_lock_irqsave(&seq->lock);
+  atomic_store(&seq->sequence, seq->sequence + 1);
+  return flags;
+}
+
+/**
+ * \desc The sequence is made even after all of the data is written.
+ */
+void seq_write_end(Seqlock *seq, uint32 flags) {
+  atomic_store(&seq->sequence, seq->sequence + 1);
+  spin_unlock_irqrestore(&seq->lock, flags);
+}
+
+/**
+ * \desc Spins while the sequence is odd, as data read then would be retried
+ * anyway.
+ */
+uint32 seq_read_begin(const Seqlock *seq) {
+  uint32 sequence = atomic_load(&seq->sequence);
+
+  while (sequence & 1) {
+    cpu_relax();
+    sequence = atomic_load(&seq->sequence);
+  }
+  return sequence;
+}
+
+/**
+ * \desc The data loads are kept before the second sequence load by the
+ * compiler barrier, and by x86 keeping loads in order.
+ */
+uint32 seq_read_retry(const Seqlock *seq, uint32 sequence) {
+  barrier();
+  return atomic_load(&seq->sequence) != sequence;
+}
+
+/**
+ * \desc Locks are listed newest first.
+ */
+void lock_stats(void) {
+  const Spinlock *lock = all_locks;
+
+  while (lock != 0) {
+    kprintf("   %s: acquired %u, contended %u, spins %u\n", lock->name,
+            lock->acquired, lock->contended, lock->spins);
+    lock = lock->all_next;
+  }
+}
+
+/**
+ * \desc The uncontended passes time each operation pair on the running
+ * processor from the time-stamp counter. The contended pass has every
+ * processor increment a shared counter under one lock, checks that no
+ * increment was lost and gives the mean time per acquisition.
+ */
+void lock_benchmark(void) {
+  uint64 start = 0, cycles = 0;
+  uint32 i = 0, flags = 0, sequence = 0;
+  volatile uint32 counter = 0;
+
+  if (bench_lock.name == 0) {
+    spin_init(&bench_lock, "lock benchmark");
+    seq_init(&bench_seq, "seqlock benchmark");
+  }
+
+  start = rdtsc();
+  for (i = 0; i < LOCK_BENCH_ROUNDS; ++i) {
+    spin_lock(&bench_lock);
+    spin_unlock(&bench_lock);
+  }
+  cycles = rdtsc() - start;
+  kprintf("   Spinlock %u", (uint32)udiv64(cycles, LOCK_BENCH_ROUNDS));
+
+  start = rdtsc();
+  for (i = 0; i < LOCK_BENCH_ROUNDS; ++i) {
+    flags = spin_lock_irqsave(&bench_lock);
+    spin_unlock_irqrestore(&bench_lock, flags);
+  }
+  cycles = rdtsc() - start;
+  kprintf(", irqsave %u", (uint32)udiv64(cycles, LOCK_BENCH_ROUNDS));
+
+  start = rdtsc();
+  for (i = 0; i < LOCK_BENCH_ROUNDS; ++i) {
+    do {
+      sequence = seq_read_begin(&bench_seq);
+    } while (seq_read_retry(&bench_seq, sequence));
+  }
+  cycles = rdtsc() - start;
+  kprintf(", seqlock read %u", (uint32)udiv64(cycles, LOCK_BENCH_ROUNDS));
+
+  start = rdtsc();
+  for (i = 0; i < LOCK_BENCH_ROUNDS; ++i) {
+    atomic_inc(&counter);
+  }
+  cycles = rdtsc() - start;
+  kprintf(", atomic inc %u cycles\n",
+          (uint32)udiv64(cycles, LOCK_BENCH_ROUNDS));
+
+  if (smp_cpu_count() < 2) {
+    return;
+  }
+
+  bench_count = 0;
+  i = bench_lock.contended;
+  start = rdtsc();
+  smp_run(contend, 0);
+  cycles = rdtsc() - start;
+  kprintf("   Contended by %u CPUs: %u increments, %u waits, %u cycles per "
+          "acquisition%s\n",
+          smp_cpu_count(), bench_count, bench_lock.contended - i,
+          (uint32)udiv64(cycles, bench_count),
+          bench_count == smp_cpu_count() * LOCK_CONTEND_ROUNDS ? "" : ", LOST");
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file lock.h
+ * \brief Spinlock and seqlock declarations.
+ *
+ * A spinlock is a ticket lock: a processor takes the next ticket with one
+ * atomic add and spins until the owner count reaches it, so the lock is
+ * handed over in the order it was asked for and no processor can be starved.
+ * The holder is the only one to write the owner count, with a plain store.
+ * Data that an interrupt handler also takes the lock for must be locked with
+ * interrupts disabled, through the irqsave variants, else the handler could
+ * spin forever on a lock held by the code it interrupted.
+ *
+ * A seqlock protects read-mostly data without readers writing anything. The
+ * writer, serialised by a spinlock, makes the sequence odd while it writes
+ * and even again after. A reader reads the sequence, copies the data and
+ * retries if the sequence was odd or has changed meanwhile.
+ *
+ * Every lock is created with a name and kept on a list for lock_stats(),
+ * which prints how often each was taken and how often it had to wait. The
+ * counters are updated by the holder, so they need no atomics of their own.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef LOCK_H
+#define LOCK_H
+
+#include "../common/atomic.h"
+#include "../common/types.h"
+
+/* Rounds of each pass of the lock benchmark */
+#define LOCK_BENCH_ROUNDS 100000
+
+/* Acquisitions by each processor in the contended pass */
+#define LOCK_CONTEND_ROUNDS 10000
+
+/**
+ * A ticket spinlock.
+ */
+typedef struct Spinlock {
+  volatile uint32 next;      /**< Next ticket to hand out */
+  volatile uint32 owner;     /**< Ticket of the holder */
+  uint32 acquired;           /**< Times the lock was taken */
+  uint32 contended;          /**< Times the lock was taken after waiting */
+  uint32 spins;              /**< Spin loop iterations spent waiting */
+  const char *name;          /**< Name shown by lock_stats() */
+  struct Spinlock *all_next; /**< Next lock in the list of all locks */
+} Spinlock;
+
+/**
+ * A seqlock.
+ */
+typedef struct {
+  volatile uint32 sequence; /**< Odd while a write is in progress */
+  Spinlock lock;            /**< Serialises the writers */
+} Seqlock;
+
+/**
+ * \brief Initialises a spinlock, unlocked, and adds it to the list of locks.
+ * \param [out] lock The lock.
+ * \param [in] name The name of the lock.
+ * \returns None.
+ */
+void spin_init(Spinlock *lock, const char *name);
+
+/**
+ * \brief Takes a spinlock, waiting for it in turn.
+ * \param [in,out] lock The lock.
+ * \returns None.
+ */
+void spin_lock(Spinlock *lock);
+
+/**
+ * \brief Releases a spinlock to the next waiter.
+ * \param [in,out] lock The lock, held by the caller.
+ * \returns None.
+ */
+void spin_unlock(Spinlock *lock);
+
+/**
+ * \brief Disables interrupts and takes a spinlock.
+ * \param [in,out] lock The lock.
+ * \returns The flags register, for spin_unlock_irqrestore().
+ */
+uint32 spin_lock_irqsave(Spinlock *lock);
+
+/**
+ * \brief Releases a spinlock and restores the interrupt flag.
+ * \param [in,out] lock The lock, held by the caller.
+ * \param [in] flags The flags returned by spin_lock_irqsave().
+ * \returns None.
+ */
+void spin_unlock_irqrestore(Spinlock *lock, uint32 flags);
+
+/**
+ * \brief Initialises a seqlock and adds its spinlock to the list of locks.
+ * \param [out] seq The lock.
+ * \param [in] name The name of the lock.
+ * \returns None.
+ */
+void seq_init(Seqlock *seq, const char *name);
+
+/**
+ * \brief Starts a write, disabling interrupts so that no reader on this
+ * processor can spin on the odd sequence.
+ * \param [in,out] seq The lock.
+ * \returns The flags register, for seq_write_end().
+ */
+uint32 seq_write_begin(Seqlock *seq);
+
+/**
+ * \brief Ends a write and restores the interrupt flag.
+ * \param [in,out] seq The lock.
+ * \param [in] flags The flags returned by seq_write_begin().
+ * \returns None.
+ */
+void seq_write_end(Seqlock *seq, uint32 flags);
+
+/**
+ * \brief Starts a read, waiting out a write in progress.
+ * \param [in] seq The lock.
+ * \returns The sequence, for seq_read_retry().
+ */
+uint32 seq_read_begin(const Seqlock *seq);
+
+/**
+ * \brief Checks whether a read raced with a write and must be repeated.
+ * \param [in] seq The lock.
+ * \param [in] sequence The sequence returned by seq_read_begin().
+ * \returns Non-zero if the data read may be inconsistent.
+ */
+uint32 seq_read_retry(const Seqlock *seq, uint32 sequence);
+
+/**
+ * \brief Prints every lock with its acquisition and contention counts.
+ * \param None.
+ * \returns None.
+ */
+void lock_stats(void);
+
+/**
+ * \brief Times uncontended lock operations and a spinlock contended by every
+ * processor.
+ * \param None.
+ * \returns None.
+ */
+void lock_benchmark(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,307 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file profile.c
+ * \brief Sampling profiler implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "profile.h"
+#include "../common/atomic.h"
+#include "../common/math.h"
+#include "../common/memory.h"
+#include "../common/printf.h"
+#include "../cpu/smp.h"
+#include "../cpu/timer.h"
+#include "frame.h"
+#include "lock.h"
+
+/* Mask for indexing a ring with its free-running head and tail */
+#define PROFILE_RING_MASK (PROFILE_RING_SIZE - 1)
+
+static Profile_Ring rings[MAX_CPUS];
+static volatile uint32 running = 0;
+
+/* Samples counted per function, by index in kernel_symbols, under the lock */
+static Spinlock profile_lock;
+static uint32 self_hits[PROFILE_MAX_SYMBOLS];
+static uint32 total_hits[PROFILE_MAX_SYMBOLS];
+static uint32 sample_count = 0;
+static uint32 unknown_count = 0;
+
+/* Time the profile was started, and its length once stopped */
+static uint64 start_ns = 0;
+static uint64 length_ns = 0;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Checks whether an address lies in the functions of the table.
+ * \param [in] pc The address.
+ * \returns Non-zero if the address is kernel code.
+ */
+static uint32 in_text(uint32 pc) {
+  return kernel_symbol_count != 0 && pc >= kernel_symbols[0].addr &&
+         pc < (uint32)etext;
+}
+
+/**
+ * \brief Finds the function containing an address by binary search for the
+ * last symbol at or below it.
+ * \param [in] pc The address.
+ * \returns The index of the function, or PROFILE_MAX_SYMBOLS if there is none
+ * that can be counted.
+ */
+static uint32 find_symbol(uint32 pc) {
+  uint32 low = 0, high = kernel_symbol_count;
+
+  if (!in_text(pc)) {
+    return PROFILE_MAX_SYMBOLS;
+  }
+
+  while (high - low > 1) {
+    const uint32 middle = low + (high - low) / 2;
+    if (kernel_symbols[middle].addr <= pc) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return low < PROFILE_MAX_SYMBOLS ? low : PROFILE_MAX_SYMBOLS;
+}
+
+/**
+ * \brief Fills in the callers of a sample from the frame pointer chain.
+ *
+ * Each frame holds the previous frame pointer at EBP and the return address
+ * above it. There is no paging, so any address can be read, but the chain is
+ * only followed while it looks sound: aligned, growing towards the top of the
+ * stack by less than PROFILE_MAX_FRAME, and returning into kernel code.
+ *
+ * \param [out] sample The sample, its interrupted EIP already set.
+ * \param [in] ebp The frame pointer of the interrupted code.
+ * \returns None.
+ */
+static void walk_frames(Profile_Sample *sample, uint32 ebp) {
+  uint32 depth = 0;
+
+  for (depth = 1; depth < PROFILE_DEPTH; ++depth) {
+    const uint32 *frame = (const uint32 *)ebp;
+    if (ebp == 0 || (ebp & 3) != 0 || !in_text(frame[1])) {
+      return;
+    }
+    sample->pc[depth] = frame[1];
+    if (frame[0] <= ebp || frame[0] - ebp > PROFILE_MAX_FRAME) {
+      return;
+    }
+    ebp = frame[0];
+  }
+}
+
+/**
+ * \brief Counts a sample: self for the interrupted function, total once for
+ * each function in the chain, so that recursion does not count twice.
+ * \param [in] sample The sample.
+ * \returns None.
+ */
+static void count_sample(const Profile_Sample *sample) {
+  uint32 seen[PROFILE_DEPTH] = {0};
+  uint32 depth = 0, found = 0, i = 0;
+
+  ++sample_count;
+  for (depth = 0; depth < PROFILE_DEPTH && sample->pc[depth] != 0; ++depth) {
+    const uint32 symbol = find_symbol(sample->pc[depth]);
+    if (symbol == PROFILE_MAX_SYMBOLS) {
+      unknown_count += depth == 0;
+      continue;
+    }
+    if (depth == 0) {
+      ++self_hits[symbol];
+    }
+    for (i = 0; i < found; ++i) {
+      if (seen[i] == symbol) {
+        break;
+      }
+    }
+    if (i == found) {
+      seen[found++] = symbol;
+      ++total_hits[symbol];
+    }
+  }
+}
+
+/**
+ * \brief Counts the samples waiting in a ring. Called with the profile lock
+ * held.
+ * \param [in,out] ring The ring.
+ * \returns None.
+ */
+static void drain(Profile_Ring *ring) {
+  const uint32 head = atomic_load(&ring->head);
+  uint32 tail = ring->tail;
+
+  while (tail != head) {
+    count_sample(&ring->samples[tail & PROFILE_RING_MASK]);
+    ++tail;
+  }
+  atomic_store(&ring->tail, tail);
+}
+
+/**
+ * \brief Counts the samples waiting in every ring.
+ * \param None.
+ * \returns None.
+ */
+static void drain_all(void) {
+  const uint32 flags = spin_lock_irqsave(&profile_lock);
+  uint32 i = 0;
+
+  for (i = 0; i < smp_cpu_count(); ++i) {
+    if (rings[i].samples != 0) {
+      drain(&rings[i]);
+    }
+  }
+  spin_unlock_irqrestore(&profile_lock, flags);
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc Only the interrupt of a processor writes the head of its ring. A full
+ * ring is drained on the spot, under the lock as the shell may be counting
+ * the same ring.
+ */
+void profile_sample(const Registers *regs) {
+  Profile_Ring *ring = 0;
+  Profile_Sample *sample = 0;
+  uint32 head = 0, flags = 0;
+
+  if (!atomic_load(&running)) {
+    return;
+  }
+  ring = &rings[cpu_current()->index];
+  if (ring->samples == 0) {
+    return;
+  }
+
+  head = ring->head;
+  if (head - atomic_load(&ring->tail) == PROFILE_RING_SIZE) {
+    flags = spin_lock_irqsave(&profile_lock);
+    drain(ring);
+    spin_unlock_irqrestore(&profile_lock, flags);
+  }
+
+  sample = &ring->samples[head & PROFILE_RING_MASK];
+  memset(sample, 0, sizeof(Profile_Sample));
+  sample->pc[0] = regs->eip;
+  walk_frames(sample, regs->ebp);
+  atomic_store(&ring->head, head + 1);
+}
+
+/**
+ * \desc A ring is allocated for each processor online the first time, and
+ * kept for later profiles.
+ */
+uint32 profile_start(void) {
+  uint32 i = 0, flags = 0;
+
+  if (running) {
+    return 1;
+  }
+  if (profile_lock.name == 0) {
+    spin_init(&profile_lock, "profile");
+  }
+
+  for (i = 0; i < smp_cpu_count(); ++i) {
+    if (rings[i].samples == 0) {
+      rings[i].samples = (Profile_Sample *)frame_alloc();
+      if (rings[i].samples == 0) {
+        return 0;
+      }
+    }
+    rings[i].head = 0;
+    rings[i].tail = 0;
+  }
+
+  flags = spin_lock_irqsave(&profile_lock);
+  memset(self_hits, 0, sizeof(self_hits));
+  memset(total_hits, 0, sizeof(total_hits));
+  sample_count = 0;
+  unknown_count = 0;
+  spin_unlock_irqrestore(&profile_lock, flags);
+
+  start_ns = clock_ns();
+  atomic_store(&running, 1);
+  timer_sample(PROFILE_INTERVAL_NS);
+  return 1;
+}
+
+/**
+ * \desc Sampling is stopped before the rings are drained for the last
+ * time.
+ */
+void profile_stop(void) {
+  if (!running) {
+    return;
+  }
+  timer_sample(0);
+  atomic_store(&running, 0);
+  length_ns = clock_ns() - start_ns;
+  drain_all();
+}
+
+/**
+ * \desc Returns the flag set by profile_start().
+ */
+uint32 profile_running(void) { return running; }
+
+/**
+ * \desc The functions are picked by selection, most self samples first and
+ * ties in address order, as only the first PROFILE_TOP are wanted. A running
+ * profile is drained first and reported up to now.
+ */
+void profile_report(void) {
+  uint32 rank = 0, i = 0, best = 0;
+  uint32 last_hits = 0xFFFFFFFF, last = 0;
+
+  if (running) {
+    drain_all();
+    length_ns = clock_ns() - start_ns;
+  }
+
+  kprintf("   %u samples over %u ms, %u outside the kernel code\n",
+          sample_count, (uint32)udiv64(length_ns, 1000000), unknown_count);
+  if (kernel_symbol_count == 0) {
+    kprintf("   No symbol table, the kernel was linked without one\n");
+    return;
+  }
+
+  for (rank = 0; rank < PROFILE_TOP; ++rank) {
+    best = PROFILE_MAX_SYMBOLS;
+    for (i = 0; i < kernel_symbol_count && i < PROFILE_MAX_SYMBOLS; ++i) {
+      const uint32 hits = self_hits[i];
+      const uint32 after = hits < last_hits || (hits == last_hits && i > last);
+      if (hits != 0 && after &&
+          (best == PROFILE_MAX_SYMBOLS || hits > self_hits[best])) {
+        best = i;
+      }
+    }
+    if (best == PROFILE_MAX_SYMBOLS) {
+      break;
+    }
+
+    kprintf("   %s: %u self (%u%%), %u total\n", kernel_symbols[best].name,
+            self_hits[best], self_hits[best] * 100 / sample_count,
+            total_hits[best]);
+    last_hits = self_hits[best];
+    last = best;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file profile.h
+ * \brief Sampling profiler declarations.
+ *
+ * While profiling, the timer interrupt calls profile_sample() every
+ * PROFILE_INTERVAL_NS with the registers of the code it interrupted. The
+ * sample is the interrupted EIP followed by the return addresses found by
+ * walking the chain of saved frame pointers from EBP, which the kernel keeps
+ * as it is built without optimisation. Code interrupted before it has pushed
+ * its frame pointer, such as the first instruction of a function or the
+ * assembly stubs, gives a chain that skips its immediate caller.
+ *
+ * Samples are pushed onto a ring of the interrupted processor. The rings are
+ * drained into counts per function when the profile is printed, or by the
+ * interrupt itself when its ring is full, so no sample is lost. A function is
+ * counted as self when it was executing and as total when it was anywhere in
+ * the chain.
+ *
+ * Addresses are turned into function names through kernel_symbols, a table
+ * of every function sorted by address and generated from the kernel by
+ * tools/ksyms.sh. The kernel is linked twice, first with an empty table, and
+ * the table made from that link only adds data after the code of the second,
+ * so the addresses it holds do not move.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "../common/types.h"
+#include "../cpu/isr.h"
+
+/* Time between samples, 997 us, a prime number of microseconds so that the
+ * samples do not keep step with millisecond timers */
+#define PROFILE_INTERVAL_NS 997000
+
+/* Addresses kept per sample, the interrupted EIP and its callers */
+#define PROFILE_DEPTH 4
+
+/* Samples each processor ring holds, a power of two filling one frame */
+#define PROFILE_RING_SIZE 256
+
+/* Functions printed by profile_report() */
+#define PROFILE_TOP 12
+
+/* Most functions the profile can count */
+#define PROFILE_MAX_SYMBOLS 1024
+
+/* Largest frame accepted when walking the frame pointer chain */
+#define PROFILE_MAX_FRAME 0x10000
+
+/**
+ * A function of the kernel.
+ */
+typedef struct {
+  uint32 addr;      /**< Address of the first instruction */
+  const char *name; /**< Name of the function */
+} Kernel_Symbol;
+
+/**
+ * The addresses of one sample, unused entries being zero.
+ */
+typedef struct {
+  uint32 pc[PROFILE_DEPTH]; /**< Interrupted EIP, then the return addresses */
+} Profile_Sample;
+
+/**
+ * The samples of one processor not yet counted.
+ */
+typedef struct {
+  volatile uint32 head;    /**< Next sample to write, by the interrupt */
+  volatile uint32 tail;    /**< Next sample to count */
+  Profile_Sample *samples; /**< PROFILE_RING_SIZE samples, in a frame */
+} Profile_Ring;
+
+/* Functions sorted by address, then an entry with no name (generated by
+ * tools/ksyms.sh) */
+extern const Kernel_Symbol kernel_symbols[];
+extern const uint32 kernel_symbol_count;
+
+/* End of the kernel code (provided by the linker) */
+extern uint8 etext[];
+
+/**
+ * \brief Takes a sample of the interrupted code, from the timer interrupt.
+ * \param [in] regs The registers of the interrupted code.
+ * \returns None.
+ */
+void profile_sample(const Registers *regs);
+
+/**
+ * \brief Clears the counts and starts sampling.
+ * \param None.
+ * \returns Non-zero if profiling started.
+ */
+uint32 profile_start(void);
+
+/**
+ * \brief Stops sampling and counts the samples left in the rings.
+ * \param None.
+ * \returns None.
+ */
+void profile_stop(void);
+
+/**
+ * \brief Checks whether the profiler is sampling.
+ * \param None.
+ * \returns Non-zero while sampling.
+ */
+uint32 profile_running(void);
+
+/**
+ * \brief Prints the functions with the most samples.
+ * \param None.
+ * \returns None.
+ */
+void profile_report(void);
+
+#endif
\ No newline at end of file
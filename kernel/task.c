@@ -0,0 +1,368 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file task.c
+ * \brief Work-stealing task scheduler implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "task.h"
+#include "../common/atomic.h"
+#include "../common/math.h"
+#include "../common/printf.h"
+#include "../cpu/smp.h"
+#include "../cpu/timer.h"
+#include "frame.h"
+
+/* Mask for indexing a deque with its free-running top and bottom */
+#define TASK_DEQUE_MASK (TASK_DEQUE_SIZE - 1)
+
+static Task_Deque deques[MAX_CPUS];
+
+/* Processors taking part, the first this many, and those halted while idle */
+static uint32 workers = 1;
+static volatile uint32 idle_mask = 0;
+
+/**
+ * The state shared by the tasks of a parallel_for().
+ */
+typedef struct {
+  Task_Fn fn;        /**< Function called with each piece */
+  void *arg;         /**< Argument passed to the function */
+  uint32 grain;      /**< Largest piece */
+  Task_Group *group; /**< Group the pieces are spawned in */
+} Parallel_For;
+
+/* Pages checksummed by the benchmark */
+static uint32 bench_pages[TASK_BENCH_PAGES];
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Takes the newest task from the bottom of a deque.
+ * \param [in,out] deque The deque of the running processor.
+ * \param [out] task The task.
+ * \returns Non-zero if there was a task.
+ */
+static uint32 deque_pop(Task_Deque *deque, Task *task) {
+  uint32 flags = 0, found = 0;
+
+  if (atomic_load(&deque->top) == atomic_load(&deque->bottom)) {
+    return 0;
+  }
+
+  flags = spin_lock_irqsave(&deque->lock);
+  if (deque->top != deque->bottom) {
+    --deque->bottom;
+    *task = deque->tasks[deque->bottom & TASK_DEQUE_MASK];
+    found = 1;
+  }
+  spin_unlock_irqrestore(&deque->lock, flags);
+  return found;
+}
+
+/**
+ * \brief Takes the oldest task from the top of a deque.
+ * \param [in,out] deque The deque of another processor.
+ * \param [out] task The task.
+ * \returns Non-zero if there was a task.
+ */
+static uint32 deque_steal(Task_Deque *deque, Task *task) {
+  uint32 flags = 0, found = 0;
+
+  if (atomic_load(&deque->top) == atomic_load(&deque->bottom)) {
+    return 0;
+  }
+
+  flags = spin_lock_irqsave(&deque->lock);
+  if (deque->top != deque->bottom) {
+    *task = deque->tasks[deque->top & TASK_DEQUE_MASK];
+    ++deque->top;
+    found = 1;
+  }
+  spin_unlock_irqrestore(&deque->lock, flags);
+  return found;
+}
+
+/**
+ * \brief Checks every deque of the workers for a task, without locking.
+ * \param None.
+ * \returns Non-zero if any deque has a task.
+ */
+static uint32 tasks_waiting(void) {
+  uint32 i = 0;
+
+  for (i = 0; i < workers; ++i) {
+    if (atomic_load(&deques[i].top) != atomic_load(&deques[i].bottom)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * \brief Wakes one idle worker to steal a task just spawned. The idle mark is
+ * cleared by the waker, so no other spawn sends it a second IPI.
+ * \param None.
+ * \returns None.
+ */
+static void wake_idle(void) {
+  uint32 i = 0;
+
+  atomic_fence();
+  for (i = 1; i < workers; ++i) {
+    if ((atomic_load(&idle_mask) & (1u << i)) &&
+        atomic_test_and_clear(&idle_mask, i)) {
+      lapic_send_ipi(smp_cpu(i)->apic_id, LAPIC_ICR_FIXED | IRQ_WAKE);
+      return;
+    }
+  }
+}
+
+/**
+ * \brief Runs a task and counts it as finished in its group.
+ * \param [in] task The task.
+ * \returns None.
+ */
+static void run(const Task *task) {
+  task->fn(task->arg, task->begin, task->end);
+  atomic_fetch_add(&task->group->pending, (uint32)-1);
+}
+
+/**
+ * \brief Splits a range in halves, spawning the upper half, until it is no
+ * larger than the grain, then calls the function of the parallel_for().
+ * \param [in] arg The Parallel_For.
+ * \param [in] begin The start of the range.
+ * \param [in] end The end of the range.
+ * \returns None.
+ */
+static void split_range(void *arg, uint32 begin, uint32 end) {
+  const Parallel_For *job = (const Parallel_For *)arg;
+
+  while (end - begin > job->grain) {
+    const uint32 middle = begin + (end - begin) / 2;
+    task_spawn(job->group, split_range, arg, middle, end);
+    end = middle;
+  }
+  job->fn(job->arg, begin, end);
+}
+
+/**
+ * \brief Adds up a range of the benchmark pages, each word rotated by its
+ * position so that the sum depends on the order of the words in a page.
+ * \param [in,out] arg The total, added to atomically.
+ * \param [in] begin The first page.
+ * \param [in] end One past the last page.
+ * \returns None.
+ */
+static void checksum_pages(void *arg, uint32 begin, uint32 end) {
+  uint32 page = 0, i = 0, sum = 0;
+
+  for (page = begin; page < end; ++page) {
+    const uint32 *words = (const uint32 *)bench_pages[page];
+    for (i = 0; i < FRAME_SIZE / 4; ++i) {
+      const uint32 shift = i & 31;
+      sum += shift ? (words[i] << shift) | (words[i] >> (32 - shift))
+                   : words[i];
+    }
+  }
+  atomic_fetch_add((volatile uint32 *)arg, sum);
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc Every processor online is a worker.
+ */
+void init_tasks(void) {
+  uint32 i = 0;
+
+  for (i = 0; i < smp_cpu_count(); ++i) {
+    spin_init(&deques[i].lock, "task deque");
+  }
+  workers = smp_cpu_count();
+}
+
+/**
+ * \desc The task is counted in its group before it is pushed, so the group
+ * cannot appear finished while the task waits. Interrupts are disabled while
+ * the deque is locked, so that no other thread of the BSP, which shares its
+ * deque, can be switched to and spin on the lock.
+ */
+void task_spawn(Task_Group *group, Task_Fn fn, void *arg, uint32 begin,
+                uint32 end) {
+  Task_Deque *deque = &deques[cpu_current()->index];
+  Task task = {fn, arg, begin, end, group};
+  uint32 flags = 0, pushed = 0;
+
+  atomic_inc(&group->pending);
+
+  flags = spin_lock_irqsave(&deque->lock);
+  if (deque->bottom - deque->top < TASK_DEQUE_SIZE) {
+    deque->tasks[deque->bottom & TASK_DEQUE_MASK] = task;
+    atomic_store(&deque->bottom, deque->bottom + 1);
+    pushed = 1;
+  }
+  spin_unlock_irqrestore(&deque->lock, flags);
+
+  if (!pushed) {
+    atomic_inc(&deque->inlined);
+    run(&task);
+    return;
+  }
+  atomic_inc(&deque->spawned);
+  wake_idle();
+}
+
+/**
+ * \desc While the group has tasks left, the waiting processor runs any task
+ * it can find, which need not belong to the group.
+ */
+void task_wait(Task_Group *group) {
+  while (atomic_load(&group->pending) != 0) {
+    if (!task_run_one()) {
+      cpu_relax();
+    }
+  }
+}
+
+/**
+ * \desc Victims are tried in turn from the next processor on, so that the
+ * thieves spread over the deques rather than all trying the first.
+ */
+uint32 task_run_one(void) {
+  const uint32 self = cpu_current()->index;
+  Task task;
+  uint32 i = 0;
+
+  if (self >= workers) {
+    return 0;
+  }
+
+  if (deque_pop(&deques[self], &task)) {
+    atomic_inc(&deques[self].executed);
+    run(&task);
+    return 1;
+  }
+
+  for (i = 1; i < workers; ++i) {
+    const uint32 victim = (self + i) % workers;
+    if (deque_steal(&deques[victim], &task)) {
+      atomic_inc(&deques[self].stolen);
+      run(&task);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * \desc The idle mark is set with a locked instruction before the deques are
+ * checked, and a spawn pushes its task before it reads the marks, so either
+ * the check sees the task or the spawn sees the mark and sends a wake IPI.
+ */
+uint32 task_may_halt(void) {
+  const uint32 self = cpu_current()->index;
+
+  atomic_or(&idle_mask, 1u << self);
+  if (self < workers && tasks_waiting()) {
+    atomic_test_and_clear(&idle_mask, self);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * \desc The mark is already clear if the processor was woken by a spawn.
+ */
+void task_woken(void) {
+  atomic_test_and_clear(&idle_mask, cpu_current()->index);
+}
+
+/**
+ * \desc The first half is split by the calling processor itself, which then
+ * helps with the rest until every piece is done. A grain of zero is taken as
+ * one.
+ */
+void parallel_for(uint32 begin, uint32 end, uint32 grain, Task_Fn fn,
+                  void *arg) {
+  Task_Group group = {0};
+  Parallel_For job = {fn, arg, grain ? grain : 1, &group};
+
+  if (begin < end) {
+    split_range(&job, begin, end);
+  }
+  task_wait(&group);
+}
+
+/**
+ * \desc Tasks run at once count as neither spawned nor executed.
+ */
+void task_stats(void) {
+  uint32 i = 0;
+
+  for (i = 0; i < smp_cpu_count(); ++i) {
+    kprintf("   CPU %u: spawned %u, ran %u own and %u stolen, %u inline\n", i,
+            deques[i].spawned, deques[i].executed, deques[i].stolen,
+            deques[i].inlined);
+  }
+}
+
+/**
+ * \desc The pages are checksummed with 1, 2, 4 and so on workers, then all of
+ * them, limiting the deques that are used. The checksum of one worker is the
+ * reference the others must match.
+ */
+void task_benchmark(void) {
+  const uint32 cpus = smp_cpu_count();
+  uint32 i = 0, n = 0, pages = 0, expected = 0;
+  uint32 one_us = 0;
+
+  for (pages = 0; pages < TASK_BENCH_PAGES; ++pages) {
+    uint32 *words = 0;
+    bench_pages[pages] = frame_alloc();
+    if (bench_pages[pages] == 0) {
+      break;
+    }
+    words = (uint32 *)bench_pages[pages];
+    for (i = 0; i < FRAME_SIZE / 4; ++i) {
+      words[i] = pages * 2654435761u + i;
+    }
+  }
+
+  for (n = 1; n <= cpus; n = (n * 2 > cpus && n < cpus) ? cpus : n * 2) {
+    volatile uint32 sum = 0;
+    uint64 start = 0;
+    uint32 us = 0;
+
+    workers = n;
+    start = clock_ns();
+    parallel_for(0, pages, TASK_BENCH_GRAIN, checksum_pages, (void *)&sum);
+    us = (uint32)udiv64(clock_ns() - start, 1000);
+    if (n == 1) {
+      one_us = us;
+      expected = sum;
+    }
+
+    kprintf("   %u CPUs: %u pages in %u us", n, pages, us);
+    if (us != 0) {
+      const uint32 speedup = (uint32)udiv64((uint64)one_us * 100, us);
+      kprintf(", speedup %u.%02u", speedup / 100, speedup % 100);
+    }
+    kprintf(", checksum 0x%x%s\n", sum, sum == expected ? "" : ", MISMATCH");
+  }
+  workers = cpus;
+
+  for (i = 0; i < pages; ++i) {
+    frame_free(bench_pages[i]);
+  }
+}
\ No newline at end of file
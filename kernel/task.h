@@ -0,0 +1,154 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file task.h
+ * \brief Work-stealing task scheduler declarations.
+ *
+ * Short kernel tasks are spread over the processors without a shared run
+ * queue. Every processor has a deque of its own: it pushes the tasks it spawns
+ * onto the bottom and pops from the bottom, newest first, so a processor keeps
+ * working on the data it has just touched. A processor whose deque is empty
+ * steals the oldest task from the top of another deque, which for a divide
+ * and conquer task is the largest piece of work left. Each deque has its own
+ * spinlock, so processors only meet on a lock when one steals from the other.
+ *
+ * A task is counted in a Task_Group when it is spawned, and task_wait() runs
+ * tasks until the count drops to zero, so the waiting processor helps rather
+ * than blocks. parallel_for() builds on this, splitting a range in halves and
+ * spawning the upper half until the pieces are no larger than a grain.
+ *
+ * The APs look for tasks whenever they are not running an smp_run() task and
+ * halt when there are none, marking themselves idle. Spawning a task wakes an
+ * idle processor with the IRQ_WAKE IPI, through irq_handler().
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef TASK_H
+#define TASK_H
+
+#include "../common/types.h"
+#include "lock.h"
+
+/* Tasks each deque holds, a power of two; a task spawned onto a full deque
+ * is run at once instead */
+#define TASK_DEQUE_SIZE 64
+
+/* Pages checksummed by the benchmark, and pages per task */
+#define TASK_BENCH_PAGES 512
+#define TASK_BENCH_GRAIN 4
+
+/* Function pointer definition for tasks, given a range of work */
+typedef void (*Task_Fn)(void *arg, uint32 begin, uint32 end);
+
+/**
+ * The tasks spawned by a fork-join and not yet finished.
+ */
+typedef struct {
+  volatile uint32 pending; /**< Tasks spawned and not yet finished */
+} Task_Group;
+
+/**
+ * A task waiting in a deque.
+ */
+typedef struct {
+  Task_Fn fn;        /**< Function the task runs */
+  void *arg;         /**< Argument passed to the function */
+  uint32 begin;      /**< Start of the range of work */
+  uint32 end;        /**< End of the range of work */
+  Task_Group *group; /**< Group the task is counted in */
+} Task;
+
+/**
+ * The deque of tasks of one processor.
+ */
+typedef struct {
+  Spinlock lock;               /**< Taken by the owner and by thieves */
+  volatile uint32 top;         /**< Oldest task, stolen by other processors */
+  volatile uint32 bottom;      /**< Newest task, pushed and popped by owner */
+  Task tasks[TASK_DEQUE_SIZE]; /**< The tasks, indexed modulo the size */
+  volatile uint32 spawned;     /**< Tasks pushed by the owner */
+  volatile uint32 inlined;     /**< Tasks run at once, the deque being full */
+  volatile uint32 executed;    /**< Tasks run by the owner */
+  volatile uint32 stolen;      /**< Tasks taken from other deques */
+} Task_Deque;
+
+/**
+ * \brief Sets up a deque for every processor online.
+ * \param None.
+ * \returns None.
+ */
+void init_tasks(void);
+
+/**
+ * \brief Spawns a task onto the deque of the running processor.
+ * \param [in,out] group The group the task is counted in.
+ * \param [in] fn The function the task runs.
+ * \param [in] arg The argument passed to the function.
+ * \param [in] begin The start of the range of work.
+ * \param [in] end The end of the range of work.
+ * \returns None.
+ */
+void task_spawn(Task_Group *group, Task_Fn fn, void *arg, uint32 begin,
+                uint32 end);
+
+/**
+ * \brief Runs tasks until every task of a group has finished.
+ * \param [in] group The group.
+ * \returns None.
+ */
+void task_wait(Task_Group *group);
+
+/**
+ * \brief Runs one task, from the own deque or else stolen from another.
+ * \param None.
+ * \returns Non-zero if a task was run.
+ */
+uint32 task_run_one(void);
+
+/**
+ * \brief Marks an AP idle unless tasks are waiting. Called with interrupts
+ * disabled, before halting.
+ * \param None.
+ * \returns Non-zero if the processor may halt.
+ */
+uint32 task_may_halt(void);
+
+/**
+ * \brief Clears the idle mark of a processor that has woken.
+ * \param None.
+ * \returns None.
+ */
+void task_woken(void);
+
+/**
+ * \brief Runs a function over a range, split among the processors.
+ * \param [in] begin The start of the range.
+ * \param [in] end The end of the range.
+ * \param [in] grain The largest piece given to a single call.
+ * \param [in] fn The function, called with sub-ranges of the range.
+ * \param [in] arg The argument passed to the function.
+ * \returns None.
+ */
+void parallel_for(uint32 begin, uint32 end, uint32 grain, Task_Fn fn,
+                  void *arg);
+
+/**
+ * \brief Prints the task counts of every deque.
+ * \param None.
+ * \returns None.
+ */
+void task_stats(void);
+
+/**
+ * \brief Checksums pages in parallel on a growing number of processors and
+ * prints the speedup of each.
+ * \param None.
+ * \returns None.
+ */
+void task_benchmark(void);
+
+#endif
\ No newline at end of file
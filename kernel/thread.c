@@ -0,0 +1,412 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file thread.c
+ * \brief Kernel thread and scheduler implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "thread.h"
+#include "../common/math.h"
+#include "../common/memory.h"
+#include "../common/printf.h"
+#include "../cpu/idt.h"
+#include "../cpu/timer.h"
+#include "work.h"
+
+static Thread kernel_thread;
+static Fpu_State kernel_fpu;
+static Thread *current = 0;
+static Thread *all_threads = 0;
+
+/* Run queues, one per priority, and the map of the non-empty ones */
+static Thread *run_head[THREAD_PRIORITIES];
+static Thread *run_tail[THREAD_PRIORITIES];
+static uint32 ready_map = 0;
+
+static volatile uint32 need_resched = 0;
+static uint32 next_id = 0;
+static uint32 switch_count = 0;
+static uint32 slices = 0;
+static Timer slice_timer;
+
+static const char *state_names[] = {"ready", "running", "blocked", "dead"};
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Finds the highest set bit of a non-zero word.
+ * \param [in] word The word to scan.
+ * \returns The index of the highest set bit.
+ */
+static uint32 highest_bit(uint32 word) {
+  uint32 index = 0;
+  __asm__("bsr %1, %0" : "=r"(index) : "rm"(word));
+  return index;
+}
+
+/**
+ * \brief Appends a thread to the run queue of its priority.
+ * \param [in] thread The thread.
+ * \returns None.
+ */
+static void enqueue(Thread *thread) {
+  const uint32 p = thread->priority;
+
+  thread->state = THREAD_READY;
+  thread->next = 0;
+  if (run_tail[p] != 0) {
+    run_tail[p]->next = thread;
+  } else {
+    run_head[p] = thread;
+  }
+  run_tail[p] = thread;
+  ready_map |= 1u << p;
+}
+
+/**
+ * \brief Takes the thread at the head of a non-empty run queue.
+ * \param [in] p The priority of the queue.
+ * \returns The thread.
+ */
+static Thread *dequeue(uint32 p) {
+  Thread *thread = run_head[p];
+
+  run_head[p] = thread->next;
+  if (run_head[p] == 0) {
+    run_tail[p] = 0;
+    ready_map &= ~(1u << p);
+  }
+  return thread;
+}
+
+/**
+ * \brief Timer callback ending a time slice. The timer work has already woken
+ * the kernel thread, which preempted the running thread and put it at the
+ * back of its queue, so there is nothing left to do but count it.
+ * \param [in] data Not used.
+ * \returns None.
+ */
+static void slice_expired(void *data) {
+  (void)data;
+  ++slices;
+}
+
+/**
+ * \brief Timer callback ending a thread_sleep().
+ * \param [in] data The sleeping thread.
+ * \returns None.
+ */
+static void sleep_expired(void *data) { thread_wake((Thread *)data); }
+
+/**
+ * \brief First code run by a new thread, reached through the iret of
+ * irq_common with interrupts enabled.
+ * \param None.
+ * \returns Does not return.
+ */
+static void thread_start(void) {
+  current->entry(current->arg);
+  thread_exit();
+}
+
+/**
+ * \brief Entry point of the context switch benchmark threads.
+ * \param [in] data Not used.
+ * \returns None.
+ */
+static void ping_pong(void *data) {
+  uint32 i = 0;
+
+  (void)data;
+  for (i = 0; i < SWITCH_BENCH_ROUNDS; ++i) {
+    thread_yield();
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc The kernel thread keeps the boot stack, so it has no stack of its own
+ * to free, and its stack pointer is first saved when it is switched away from.
+ * Its FPU state is static for the same reason.
+ */
+void init_threads(void) {
+  fpu_init_state(&kernel_fpu);
+  kernel_thread.fpu = &kernel_fpu;
+  kernel_thread.name = "kernel";
+  kernel_thread.id = next_id++;
+  kernel_thread.priority = THREAD_PRIORITY_KERNEL;
+  kernel_thread.state = THREAD_RUNNING;
+  all_threads = &kernel_thread;
+  current = &kernel_thread;
+}
+
+/**
+ * \desc The stack is a whole frame from kmalloc(). A Registers frame is built
+ * at its top as though the thread had been interrupted just before
+ * thread_start(), so the first switch to it is no different from any other.
+ * The esp and ss members at the very top are never popped by a same-privilege
+ * iret and are left as headroom. The FPU state is allocated here too, so
+ * that the first use of the FPU has nothing to allocate.
+ */
+Thread *thread_create(const char *name, Thread_Entry entry, void *arg,
+                      uint8 priority) {
+  Thread *thread = (Thread *)kmalloc(sizeof(Thread));
+  uint8 *stack = (uint8 *)kmalloc(THREAD_STACK_SIZE);
+  Fpu_State *fpu = fpu_alloc();
+  Registers *regs = 0;
+  uint32 flags = 0;
+
+  if (thread == 0 || stack == 0 || fpu == 0) {
+    kfree(thread);
+    kfree(stack);
+    fpu_release(fpu);
+    return 0;
+  }
+
+  memset(thread, 0, sizeof(Thread));
+  thread->entry = entry;
+  thread->arg = arg;
+  thread->stack = stack;
+  thread->fpu = fpu;
+  thread->name = name;
+  thread->priority =
+      priority < THREAD_PRIORITIES ? priority : THREAD_PRIORITIES - 1;
+
+  regs = (Registers *)(stack + THREAD_STACK_SIZE - sizeof(Registers));
+  memset(regs, 0, sizeof(Registers));
+  regs->ds = KERNEL_DS;
+  regs->eip = (uint32)thread_start;
+  regs->cs = KERNEL_CS;
+  regs->eflags = THREAD_EFLAGS;
+  thread->esp = (uint32)regs;
+
+  flags = irq_save();
+  thread->id = next_id++;
+  thread->all_next = all_threads;
+  all_threads = thread;
+  enqueue(thread);
+  if (current != 0 && thread->priority > current->priority) {
+    need_resched = 1;
+  }
+  irq_restore(flags);
+  return thread;
+}
+
+/**
+ * \desc Returns the thread last picked by schedule().
+ */
+Thread *thread_current(void) { return current; }
+
+/**
+ * \desc A thread is ready exactly when its queue's bit is set in the map.
+ */
+uint32 thread_ready(void) { return ready_map != 0; }
+
+/**
+ * \desc Requests a reschedule and takes the yield interrupt. The running
+ * thread is put at the back of its queue, so it only runs on if no other
+ * thread of its priority or higher is ready.
+ */
+void thread_yield(void) {
+  need_resched = 1;
+  __asm__ volatile("int %0" : : "i"(IRQ_YIELD) : "memory");
+}
+
+/**
+ * \desc A blocked thread is not put back on a run queue by schedule(). The
+ * flags, including the disabled interrupt flag, are saved with the thread and
+ * restored when it next runs.
+ */
+void thread_block(void) {
+  current->state = THREAD_BLOCKED;
+  thread_yield();
+}
+
+/**
+ * \desc Threads that are not blocked are left alone, so a wakeup that races
+ * with the thread still running is harmless. A woken thread of higher
+ * priority than the running one is switched to when the current interrupt
+ * returns, or at the next interrupt or yield otherwise.
+ */
+void thread_wake(Thread *thread) {
+  const uint32 flags = irq_save();
+
+  if (thread->state == THREAD_BLOCKED) {
+    enqueue(thread);
+    if (thread->priority > current->priority) {
+      need_resched = 1;
+    }
+  }
+  irq_restore(flags);
+}
+
+/**
+ * \desc The wheel is run by the kernel thread, so the kernel thread cannot
+ * block on it and sleeps with timer_sleep() instead.
+ */
+void thread_sleep(uint32 ms) {
+  uint32 flags = 0;
+
+  if (current == &kernel_thread) {
+    timer_sleep(ms);
+    return;
+  }
+
+  flags = irq_save();
+  timer_add(&current->timer, ms, sleep_expired, current);
+  thread_block();
+  irq_restore(flags);
+}
+
+/**
+ * \desc The thread cannot free the stack it is running on, so it is left dead
+ * for thread_join() to free.
+ */
+void thread_exit(void) {
+  irq_save();
+  current->state = THREAD_DEAD;
+  if (current->joiner != 0) {
+    thread_wake(current->joiner);
+  }
+  thread_yield();
+  while (1) {
+  }
+}
+
+/**
+ * \desc Every thread other than the kernel thread must be joined, as this is
+ * where its stack and structure are freed. While the kernel thread is joining,
+ * the kernel loop is held up and deferred work waits, apart from the timers:
+ * when no thread is ready the kernel thread would be run straight back, so it
+ * halts and runs the timer work itself, as timer_sleep() does, so that
+ * sleeping threads still wake.
+ */
+void thread_join(Thread *thread) {
+  Thread **link = &all_threads;
+  uint32 flags = irq_save();
+
+  while (thread->state != THREAD_DEAD) {
+    thread->joiner = current;
+    if (current != &kernel_thread || thread_ready()) {
+      thread_block();
+    } else {
+      if (!take_work(WORK_TIMER)) {
+        __asm__ volatile("sti; hlt; cli");
+      }
+      run_timers();
+    }
+  }
+
+  while (*link != thread) {
+    link = &(*link)->all_next;
+  }
+  *link = thread->all_next;
+  irq_restore(flags);
+
+  fpu_release(thread->fpu);
+  kfree(thread->stack);
+  kfree(thread);
+}
+
+/**
+ * \desc Runs with interrupts disabled at the end of every IRQ. Unless a
+ * reschedule was requested the interrupted thread simply resumes. Otherwise
+ * its stack pointer is saved, it goes to the back of its queue if still
+ * runnable, and the head of the highest non-empty queue runs. With no thread
+ * ready, the kernel thread runs, since its loop halts the CPU. A switch lets
+ * fpu_switch() make the next FPU use trap, so the FPU state follows lazily. A
+ * slice timer is armed whenever the picked thread has others of its priority
+ * waiting.
+ */
+uint32 schedule(Registers *regs) {
+  Thread *prev = current, *next = 0;
+
+  if (!need_resched || prev == 0) {
+    return (uint32)regs;
+  }
+  need_resched = 0;
+
+  prev->esp = (uint32)regs;
+  if (prev->state == THREAD_RUNNING) {
+    enqueue(prev);
+  }
+
+  next = ready_map ? dequeue(highest_bit(ready_map)) : &kernel_thread;
+  next->state = THREAD_RUNNING;
+  if (next != prev) {
+    ++next->switches;
+    ++switch_count;
+    current = next;
+    fpu_switch();
+  }
+
+  if (next != &kernel_thread && run_head[next->priority] != 0 &&
+      !slice_timer.pending) {
+    timer_add(&slice_timer, THREAD_SLICE_MS, slice_expired, 0);
+  }
+  return next->esp;
+}
+
+/**
+ * \desc Walks the list of all threads, newest first.
+ */
+void thread_stats(void) {
+  const Thread *thread = all_threads;
+
+  while (thread != 0) {
+    kprintf("   %u %s priority %u %s, switched to %u\n", thread->id,
+            thread->name, thread->priority, state_names[thread->state],
+            thread->switches);
+    thread = thread->all_next;
+  }
+  kprintf("   Switches %u, slices %u\n", switch_count, slices);
+}
+
+/**
+ * \desc Two threads of equal priority yield to each other in turn while the
+ * kernel thread waits for them, so nearly every yield is a switch through
+ * irq_common. The time-stamp counter is read across the joins and divided by
+ * the switches counted by schedule().
+ */
+void switch_benchmark(void) {
+  Thread *ping = thread_create("ping", ping_pong, 0, THREAD_PRIORITY_DEFAULT);
+  Thread *pong = thread_create("pong", ping_pong, 0, THREAD_PRIORITY_DEFAULT);
+  uint32 before = 0, count = 0;
+  uint64 start = 0, cycles = 0;
+
+  if (ping == 0 || pong == 0) {
+    kprintf("   Out of memory\n");
+  }
+
+  before = switch_count;
+  start = rdtsc();
+  if (ping != 0) {
+    thread_join(ping);
+  }
+  if (pong != 0) {
+    thread_join(pong);
+  }
+  cycles = rdtsc() - start;
+  count = switch_count - before;
+
+  if (count == 0) {
+    return;
+  }
+  kprintf("   Context switch: %u switches, %u cycles", count,
+          (uint32)udiv64(cycles, count));
+  if (tsc_frequency() != 0) {
+    kprintf(" (%u ns)", (uint32)udiv64(
+                            udiv64(cycles * 1000000, tsc_frequency()), count));
+  }
+  kprintf(" per switch\n");
+}
\ No newline at end of file
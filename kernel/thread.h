@@ -0,0 +1,177 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file thread.h
+ * \brief Kernel thread and scheduler declarations.
+ *
+ * Every kernel thread has its own stack. A thread that is not running is
+ * described entirely by the Registers frame saved on its stack by irq_common,
+ * so switching threads is a matter of irq_handler() returning a different
+ * stack pointer for irq_common to restore from. Threads are switched when an
+ * interrupt wakes a thread of higher priority, and a thread gives up the CPU
+ * by taking the IRQ_YIELD software interrupt down the same path.
+ *
+ * Ready threads wait in one FIFO queue per priority, with a bitmap of the
+ * non-empty queues, so the next thread is found with a single bit scan.
+ * Threads of equal priority are time-sliced by a timer on the wheel. The boot
+ * flow of control becomes the kernel thread, which runs the kernel loop at
+ * the highest priority and blocks while there is no deferred work; it is also
+ * the thread run when no other is ready, halting the CPU.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "../common/types.h"
+#include "../cpu/fpu.h"
+#include "../cpu/isr.h"
+#include "wheel.h"
+
+/* Scheduling priorities, higher runs first */
+#define THREAD_PRIORITIES 32
+#define THREAD_PRIORITY_KERNEL (THREAD_PRIORITIES - 1)
+#define THREAD_PRIORITY_DEFAULT 16
+
+/* Stack size of each thread, one frame */
+#define THREAD_STACK_SIZE 4096
+
+/* Time slice of threads of equal priority */
+#define THREAD_SLICE_MS 10
+
+/* Flags a new thread starts with: interrupts enabled */
+#define THREAD_EFLAGS 0x202
+
+/* Yields taken by each thread of the context switch benchmark */
+#define SWITCH_BENCH_ROUNDS 10000
+
+/* Thread states */
+#define THREAD_READY 0
+#define THREAD_RUNNING 1
+#define THREAD_BLOCKED 2
+#define THREAD_DEAD 3
+
+/* Function pointer definition for thread entry points */
+typedef void (*Thread_Entry)(void *arg);
+
+/**
+ * A kernel thread.
+ */
+typedef struct Thread {
+  uint32 esp;              /**< Saved stack pointer, at a Registers frame */
+  struct Thread *next;     /**< Next thread in the run queue */
+  struct Thread *all_next; /**< Next thread in the list of all threads */
+  struct Thread *joiner;   /**< Thread waiting in thread_join() */
+  Thread_Entry entry;      /**< Function the thread runs */
+  void *arg;               /**< Argument passed to the entry function */
+  uint8 *stack;            /**< Base of the stack, zero for the kernel thread */
+  Fpu_State *fpu;          /**< FPU and SSE state, from thread_create() */
+  const char *name;        /**< Name shown by thread_stats() */
+  uint32 id;               /**< Thread number */
+  uint32 switches;         /**< Times the thread was switched to */
+  uint8 priority;          /**< Scheduling priority */
+  uint8 state;             /**< One of the thread states */
+  Timer timer;             /**< Timer used by thread_sleep() */
+} Thread;
+
+/**
+ * \brief Turns the boot flow of control into the kernel thread.
+ * \param None.
+ * \returns None.
+ */
+void init_threads(void);
+
+/**
+ * \brief Creates a thread and makes it ready to run.
+ * \param [in] name The name of the thread.
+ * \param [in] entry The function the thread runs, exiting when it returns.
+ * \param [in] arg The argument passed to the entry function.
+ * \param [in] priority The scheduling priority.
+ * \returns The thread, or zero if memory is exhausted.
+ */
+Thread *thread_create(const char *name, Thread_Entry entry, void *arg,
+                      uint8 priority);
+
+/**
+ * \brief Gets the running thread.
+ * \param None.
+ * \returns The running thread, or zero before init_threads().
+ */
+Thread *thread_current(void);
+
+/**
+ * \brief Checks whether any thread is waiting to run.
+ * \param None.
+ * \returns Non-zero if a thread is ready.
+ */
+uint32 thread_ready(void);
+
+/**
+ * \brief Gives up the CPU to the highest priority ready thread.
+ * \param None.
+ * \returns None.
+ */
+void thread_yield(void);
+
+/**
+ * \brief Blocks the running thread until thread_wake(). Interrupts must be
+ * disabled from checking the condition waited for until the call.
+ * \param None.
+ * \returns None.
+ */
+void thread_block(void);
+
+/**
+ * \brief Makes a blocked thread ready, safe to call from interrupt context.
+ * \param [in] thread The thread.
+ * \returns None.
+ */
+void thread_wake(Thread *thread);
+
+/**
+ * \brief Blocks the running thread for a number of milliseconds.
+ * \param [in] ms Milliseconds to sleep for.
+ * \returns None.
+ */
+void thread_sleep(uint32 ms);
+
+/**
+ * \brief Ends the running thread.
+ * \param None.
+ * \returns Does not return.
+ */
+void thread_exit(void);
+
+/**
+ * \brief Waits for a thread to exit and frees it.
+ * \param [in] thread The thread.
+ * \returns None.
+ */
+void thread_join(Thread *thread);
+
+/**
+ * \brief Saves the interrupted thread and picks the thread to resume.
+ * \param [in] regs The registers saved by irq_common.
+ * \returns The stack pointer of the thread to resume.
+ */
+uint32 schedule(Registers *regs);
+
+/**
+ * \brief Prints every thread with its priority, state and switch count.
+ * \param None.
+ * \returns None.
+ */
+void thread_stats(void);
+
+/**
+ * \brief Ping-pongs two threads and prints the cycles per context switch.
+ * \param None.
+ * \returns None.
+ */
+void switch_benchmark(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file trace.c
+ * \brief Event trace buffer implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "trace.h"
+#include "../common/printf.h"
+#include "../cpu/isr.h"
+#include "../cpu/smp.h"
+#include "../cpu/timer.h"
+#include "../drivers/serial.h"
+#include "frame.h"
+
+volatile uint32 trace_mask = 0;
+
+static Trace_Ring rings[MAX_CPUS];
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Claims the next slot of a ring. The ring is only written by its own
+ * processor, so the xadd needs no lock prefix: being one instruction, no
+ * interrupt can come between its read and its write.
+ * \param [in,out] head The head of the ring.
+ * \returns The head before the claim.
+ */
+static uint32 claim_slot(volatile uint32 *head) {
+  uint32 slot = 1;
+  __asm__ volatile("xaddl %0, %1" : "+r"(slot), "+m"(*head) : : "memory", "cc");
+  return slot;
+}
+
+/**
+ * \brief Sends one record over the serial port, its bytes in memory order.
+ * \param [in] cpu The processor the record belongs to.
+ * \param [in] record The record.
+ * \returns None.
+ */
+static void dump_record(uint32 cpu, const Trace_Record *record) {
+  const uint8 *bytes = (const uint8 *)record;
+  char line[48];
+  uint32 len = 0, i = 0;
+
+  len = ksnprintf(line, sizeof(line), "@trace %u ", cpu);
+  for (i = 0; i < sizeof(Trace_Record); ++i) {
+    len += ksnprintf(line + len, sizeof(line) - len, "%02x", bytes[i]);
+  }
+  ksnprintf(line + len, sizeof(line) - len, "\n");
+  serial_print(line);
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc The records of the text are made with interrupts disabled, so that
+ * no text printed by an interrupt lands between them. The characters are
+ * read up to the null terminator, which ends the last record; a text filling
+ * its last record exactly is followed by one of nulls.
+ */
+void trace_sink(const char *str, uint32 len) {
+  uint32 flags = 0, i = 0, j = 0;
+
+  if (!TRACE || !(trace_mask & (1u << TRACE_TEXT))) {
+    return;
+  }
+
+  flags = irq_save();
+  for (i = 0; i <= len; i += 6) {
+    uint8 chars[6] = {0};
+    for (j = 0; j < 6 && i + j < len; ++j) {
+      chars[j] = (uint8)str[i + j];
+    }
+    trace_record(TRACE_TEXT, chars[0] | chars[1] << 8,
+                 chars[2] | chars[3] << 8 | chars[4] << 16 |
+                     (uint32)chars[5] << 24);
+  }
+  irq_restore(flags);
+}
+
+/**
+ * \desc The slot is claimed before the time is read, so a record made by an
+ * interrupt in between may come first in the ring with a later time; the
+ * decoder orders the records by time.
+ */
+void trace_record(uint32 event, uint32 arg16, uint32 arg) {
+  Trace_Ring *ring = &rings[cpu_current()->index];
+  const uint32 slot = claim_slot(&ring->head) % TRACE_RING_SIZE;
+  Trace_Record *record =
+      &ring->pages[slot / TRACE_PAGE_RECORDS][slot % TRACE_PAGE_RECORDS];
+
+  record->tsc = rdtsc();
+  record->event = (uint16)event;
+  record->arg16 = (uint16)arg16;
+  record->arg = arg;
+}
+
+/**
+ * \desc The pages of a ring are allocated for each processor online the
+ * first time, and kept for later traces. Nothing is recorded in a build with
+ * TRACE=0.
+ */
+uint32 trace_start(void) {
+  uint32 i = 0, page = 0;
+
+  if (!TRACE) {
+    return 0;
+  }
+
+  trace_mask = 0;
+  for (i = 0; i < smp_cpu_count(); ++i) {
+    for (page = 0; page < TRACE_RING_PAGES; ++page) {
+      if (rings[i].pages[page] == 0) {
+        rings[i].pages[page] = (Trace_Record *)frame_alloc();
+        if (rings[i].pages[page] == 0) {
+          return 0;
+        }
+      }
+    }
+    rings[i].head = 0;
+  }
+
+  trace_mask = (1u << TRACE_EVENTS) - 1;
+  return 1;
+}
+
+/**
+ * \desc Tracepoints already past the mask test still finish their record.
+ */
+void trace_stop(void) { trace_mask = 0; }
+
+/**
+ * \desc Recording is stopped first. Each ring is sent oldest record first,
+ * waiting for the serial port after every line so that none is dropped. The
+ * header gives the TSC frequency in kHz and the processor count.
+ */
+uint32 trace_dump(void) {
+  char line[48];
+  uint32 cpu = 0, i = 0, sent = 0;
+
+  trace_stop();
+
+  ksnprintf(line, sizeof(line), "@trace begin %u %u\n", tsc_frequency(),
+            smp_cpu_count());
+  serial_print(line);
+
+  for (cpu = 0; cpu < smp_cpu_count(); ++cpu) {
+    const Trace_Ring *ring = &rings[cpu];
+    const uint32 head = ring->head;
+    const uint32 count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+
+    if (ring->pages[0] == 0) {
+      continue;
+    }
+    for (i = head - count; i != head; ++i) {
+      const uint32 slot = i % TRACE_RING_SIZE;
+      dump_record(cpu,
+                  &ring->pages[slot / TRACE_PAGE_RECORDS]
+                              [slot % TRACE_PAGE_RECORDS]);
+      serial_flush();
+      ++sent;
+    }
+  }
+
+  serial_print("@trace end\n");
+  serial_flush();
+  return sent;
+}
\ No newline at end of file
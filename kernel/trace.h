@@ -0,0 +1,134 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file trace.h
+ * \brief Event trace buffer declarations.
+ *
+ * Tracepoints placed in the kernel record fixed-size binary events: the
+ * time-stamp counter, an event number and two arguments. Each processor has a
+ * ring of its own, written only by that processor, so recording takes no lock
+ * and no locked instruction. An interrupt can still record in the middle of
+ * another record on the same processor, so a slot is claimed with a single
+ * xadd, which no interrupt can split. The rings keep the latest events,
+ * overwriting the oldest.
+ *
+ * A tracepoint is the TRACE_EVENT() macro. Unless built with TRACE=0 it tests
+ * the bit of its event in trace_mask, one load and a branch when the event is
+ * off, and only calls trace_record() when it is on. With TRACE=0 it compiles
+ * to nothing. The mask is zero until trace_start(), which is only allowed
+ * once the per-CPU data is set up, as recording reads the processor number.
+ *
+ * trace_dump() sends the rings over the serial port as text lines, each with
+ * the processor number and the 16 bytes of a record in hex, between a header
+ * giving the TSC frequency and a trailer. tools/trace2json.py turns the dump
+ * into Chrome trace JSON, with the begin and end events as durations.
+ *
+ * trace_sink() lets kprintf() write into the trace: the text is split across
+ * TRACE_TEXT records, two characters in the small argument and four in the
+ * other, and ends with the first record holding a null.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "../common/types.h"
+
+/* Tracepoints, on unless the Makefile passes -DTRACE=0 */
+#ifndef TRACE
+#define TRACE 1
+#endif
+
+/* Events, each a bit of trace_mask */
+#define TRACE_IRQ_ENTER 0   /**< irq_handler() entered, the vector */
+#define TRACE_IRQ_EXIT 1    /**< irq_handler() returning, the vector */
+#define TRACE_TIMER 2       /**< Timer interrupt, the interrupted EIP */
+#define TRACE_KEYBOARD 3    /**< Keyboard interrupt, depth and scancode */
+#define TRACE_PRINT_BEGIN 4 /**< print_at() entered */
+#define TRACE_PRINT_END 5   /**< print_at() returning, the characters */
+#define TRACE_TEXT 6        /**< kprintf() text, six characters a record */
+#define TRACE_EVENTS 7
+
+/* Records in each page of a ring, and pages in a ring */
+#define TRACE_PAGE_RECORDS 256
+#define TRACE_RING_PAGES 16
+#define TRACE_RING_SIZE (TRACE_PAGE_RECORDS * TRACE_RING_PAGES)
+
+/**
+ * An event recorded by a tracepoint, 16 bytes so that a page holds a power of
+ * two of them.
+ */
+typedef struct {
+  uint64 tsc;   /**< Time-stamp counter when recorded */
+  uint16 event; /**< Event number */
+  uint16 arg16; /**< Small argument */
+  uint32 arg;   /**< Argument */
+} Trace_Record;
+
+/**
+ * The events recorded by one processor.
+ */
+typedef struct {
+  volatile uint32 head;                  /**< Records ever claimed */
+  Trace_Record *pages[TRACE_RING_PAGES]; /**< Frames holding the records */
+} Trace_Ring;
+
+/* Events being recorded, a bit for each */
+extern volatile uint32 trace_mask;
+
+#if TRACE
+#define TRACE_EVENT(event, arg16, arg)                                         \
+  do {                                                                         \
+    if (trace_mask & (1u << (event))) {                                        \
+      trace_record((event), (arg16), (arg));                                   \
+    }                                                                          \
+  } while (0)
+#else
+#define TRACE_EVENT(event, arg16, arg)                                         \
+  do {                                                                         \
+  } while (0)
+#endif
+
+/**
+ * \brief Records an event on the ring of the running processor.
+ * \param [in] event The event number.
+ * \param [in] arg16 The small argument.
+ * \param [in] arg The argument.
+ * \returns None.
+ */
+void trace_record(uint32 event, uint32 arg16, uint32 arg);
+
+/**
+ * \brief Records the output of kprintf(), a sink for it.
+ * \param [in] str The null-terminated text.
+ * \param [in] len The length of the text.
+ * \returns None.
+ */
+void trace_sink(const char *str, uint32 len);
+
+/**
+ * \brief Empties the rings and starts recording every event.
+ * \param None.
+ * \returns Non-zero if tracing started.
+ */
+uint32 trace_start(void);
+
+/**
+ * \brief Stops recording.
+ * \param None.
+ * \returns None.
+ */
+void trace_stop(void);
+
+/**
+ * \brief Sends the recorded events over the serial port.
+ * \param None.
+ * \returns The number of records sent.
+ */
+uint32 trace_dump(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,400 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file wheel.c
+ * \brief Timer wheel implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "wheel.h"
+#include "../common/math.h"
+#include "../common/printf.h"
+#include "../cpu/isr.h"
+#include "../cpu/timer.h"
+#include "work.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+/* Furthest ahead of the wheel a timer can be placed, in ticks */
+#define WHEEL_SPAN ((1u << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/* Slot lists, and a 64-bit map of the non-empty slots of each level */
+static Timer *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32 wheel_map[WHEEL_LEVELS][2];
+
+/* The next tick to be processed */
+static uint32 wheel_now = 0;
+
+/* The deadline the event source is armed for, zero when stopped */
+static uint64 armed_ns = 0;
+
+static uint32 timers_pending = 0;
+static uint32 timers_fired = 0;
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Finds the lowest set bit of a non-zero word.
+ * \param [in] word The word to scan.
+ * \returns The index of the lowest set bit.
+ */
+static uint32 lowest_bit(uint32 word) {
+  uint32 index = 0;
+  __asm__("bsf %1, %0" : "=r"(index) : "rm"(word));
+  return index;
+}
+
+/**
+ * \brief Gets the length of a tick.
+ * \param None.
+ * \returns The tick length in nanoseconds, or zero before init_timer().
+ */
+static uint32 tick_length(void) {
+  const uint32 hz = clock_tick_hz();
+  return hz ? 1000000000 / hz : 0;
+}
+
+/**
+ * \brief Finds the first non-empty slot of a level, counting on from a slot
+ * and wrapping around. The slot map is rotated so that the starting slot is
+ * bit zero, after which a bit scan gives the distance.
+ * \param [in] level The wheel level.
+ * \param [in] from The slot to start from.
+ * \returns The distance in slots, or WHEEL_SLOTS if the level is empty.
+ */
+static uint32 next_slot(uint32 level, uint32 from) {
+  uint32 lo = wheel_map[level][from / 32 % 2];
+  uint32 hi = wheel_map[level][(from / 32 + 1) % 2];
+  const uint32 shift = from % 32;
+
+  if (shift != 0) {
+    const uint32 rotated = (lo >> shift) | (hi << (32 - shift));
+    hi = (hi >> shift) | (lo << (32 - shift));
+    lo = rotated;
+  }
+
+  if (lo != 0) {
+    return lowest_bit(lo);
+  } else if (hi != 0) {
+    return 32 + lowest_bit(hi);
+  }
+  return WHEEL_SLOTS;
+}
+
+/**
+ * \brief Finds the next tick at which the wheel has work: either a timer in
+ * the first level expiring, or a slot of a higher level being cascaded down.
+ * A slot of level n is cascaded at the start of its 64^n-tick span.
+ * \param [out] tick The tick found.
+ * \returns Non-zero if any timer is pending.
+ */
+static uint32 next_event(uint32 *tick) {
+  uint32 level = 0, found = 0;
+
+  for (level = 0; level < WHEEL_LEVELS; ++level) {
+    const uint32 shift = WHEEL_BITS * level;
+    const uint32 span = 1u << shift;
+    const uint32 start = (wheel_now + span - 1) & ~(span - 1);
+    const uint32 dist = next_slot(level, (start >> shift) & WHEEL_MASK);
+    const uint32 when = start + (dist << shift);
+
+    if (dist != WHEEL_SLOTS &&
+        (!found || when - wheel_now < *tick - wheel_now)) {
+      *tick = when;
+      found = 1;
+    }
+  }
+  return found;
+}
+
+/**
+ * \brief Links a timer into the slot for its expiry tick. The level is chosen
+ * by how far ahead of the wheel the timer is, and the slot by the bits of the
+ * expiry tick for that level. A timer beyond the reach of the wheel goes in
+ * the slot for the furthest tick it reaches, its expiry left as it is, so
+ * that the cascade of that slot links it again.
+ * \param [in] timer The timer, with its expiry tick set.
+ * \returns None.
+ */
+static void wheel_link(Timer *timer) {
+  uint32 delta = timer->expires - wheel_now;
+  uint32 level = 0, slot = 0;
+
+  if ((int32)delta < 0) {
+    timer->expires = wheel_now;
+    delta = 0;
+  } else if (delta > WHEEL_SPAN) {
+    delta = WHEEL_SPAN;
+  }
+
+  while (level < WHEEL_LEVELS - 1 &&
+         delta >= 1u << (WHEEL_BITS * (level + 1))) {
+    ++level;
+  }
+  slot = ((wheel_now + delta) >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+  timer->level = level;
+  timer->slot = slot;
+  timer->prev = 0;
+  timer->next = wheel[level][slot];
+  if (timer->next != 0) {
+    timer->next->prev = timer;
+  }
+  wheel[level][slot] = timer;
+  wheel_map[level][slot / 32] |= 1u << (slot % 32);
+  timer->pending = 1;
+  ++timers_pending;
+}
+
+/**
+ * \brief Unlinks a timer from its slot, clearing the slot in the map if it
+ * is left empty.
+ * \param [in] timer The pending timer.
+ * \returns None.
+ */
+static void wheel_unlink(Timer *timer) {
+  const uint32 level = timer->level;
+  const uint32 slot = timer->slot;
+
+  if (timer->prev != 0) {
+    timer->prev->next = timer->next;
+  } else {
+    wheel[level][slot] = timer->next;
+  }
+  if (timer->next != 0) {
+    timer->next->prev = timer->prev;
+  }
+  if (wheel[level][slot] == 0) {
+    wheel_map[level][slot / 32] &= ~(1u << (slot % 32));
+  }
+  timer->pending = 0;
+  --timers_pending;
+}
+
+/**
+ * \brief Moves every timer in a slot of a higher level down the wheel. The
+ * slot is emptied first, so that a timer still out of reach may be parked in
+ * it again without being visited twice.
+ * \param [in] level The wheel level.
+ * \param [in] slot The slot within the level.
+ * \returns None.
+ */
+static void cascade(uint32 level, uint32 slot) {
+  Timer *timer = wheel[level][slot];
+
+  wheel[level][slot] = 0;
+  wheel_map[level][slot / 32] &= ~(1u << (slot % 32));
+  while (timer != 0) {
+    Timer *next = timer->next;
+    --timers_pending;
+    wheel_link(timer);
+    timer = next;
+  }
+}
+
+/**
+ * \brief Processes the tick the wheel is at: cascades any higher level slot
+ * whose span starts at this tick, then runs the timers of the first level
+ * slot with interrupts restored. Timers are taken one at a time, so a
+ * callback may add or cancel any timer, and the wheel only moves on once the
+ * slot is empty.
+ * \param [in] flags The flags register from irq_save().
+ * \returns None.
+ */
+static void wheel_step(uint32 flags) {
+  const uint32 slot = wheel_now & WHEEL_MASK;
+  uint32 level = 0;
+
+  for (level = 1; level < WHEEL_LEVELS; ++level) {
+    const uint32 shift = WHEEL_BITS * level;
+    if ((wheel_now & ((1u << shift) - 1)) != 0) {
+      break;
+    }
+    cascade(level, (wheel_now >> shift) & WHEEL_MASK);
+  }
+
+  while (wheel[0][slot] != 0) {
+    Timer *timer = wheel[0][slot];
+    const Timer_Callback callback = timer->callback;
+    void *data = timer->data;
+
+    wheel_unlink(timer);
+    ++timers_fired;
+    irq_restore(flags);
+    callback(data);
+    irq_save();
+  }
+  ++wheel_now;
+}
+
+/**
+ * \brief Arms the clock event source for the next event of the wheel, or
+ * stops it if no timer is pending.
+ * \param None.
+ * \returns None.
+ */
+static void wheel_arm(void) {
+  uint32 next = 0;
+
+  if (next_event(&next)) {
+    armed_ns = (uint64)next * tick_length();
+    timer_arm(armed_ns);
+  } else {
+    armed_ns = 0;
+    timer_stop();
+  }
+}
+
+/**
+ * \brief Timer callback used by timer_sleep().
+ * \param [in] data The flag to set.
+ * \returns None.
+ */
+static void wake(void *data) { *(volatile uint8 *)data = 1; }
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc The expiry is the first tick boundary at or after the requested time,
+ * so a timer never fires early, unless its timeout was clamped to
+ * TIMER_MAX_TICKS. An empty wheel is first moved up to the current tick. The
+ * event source is only re-armed when the new timer makes the next event earlier
+ * than the armed deadline; otherwise it fires first and run_timers() arms it
+ * again.
+ */
+void timer_add(Timer *timer, uint32 ms, Timer_Callback callback, void *data) {
+  const uint32 tick_ns = tick_length();
+  uint32 flags = 0, next = 0;
+  uint64 delay = (uint64)ms * 1000000, target = 0;
+
+  if (tick_ns == 0) {
+    return;
+  }
+  if (delay > (uint64)TIMER_MAX_TICKS * tick_ns) {
+    delay = (uint64)TIMER_MAX_TICKS * tick_ns;
+  }
+
+  flags = irq_save();
+  if (timer->pending) {
+    wheel_unlink(timer);
+  }
+  if (timers_pending == 0) {
+    wheel_now = clock_ticks();
+  }
+
+  target = clock_ns() + delay;
+  timer->expires = (uint32)udiv64(target + tick_ns - 1, tick_ns);
+  timer->callback = callback;
+  timer->data = data;
+  wheel_link(timer);
+
+  if (next_event(&next) &&
+      (armed_ns == 0 || (uint64)next * tick_ns < armed_ns)) {
+    wheel_arm();
+  }
+  irq_restore(flags);
+}
+
+/**
+ * \desc The event source is left armed, as a spurious wakeup costs less than
+ * finding the next event again.
+ */
+uint32 timer_cancel(Timer *timer) {
+  const uint32 flags = irq_save();
+  const uint32 pending = timer->pending;
+
+  if (pending) {
+    wheel_unlink(timer);
+  }
+  irq_restore(flags);
+  return pending;
+}
+
+/**
+ * \desc Steps the wheel up to the current tick. Rather than visiting every
+ * tick, the wheel jumps straight to the next event found from the slot maps,
+ * and once that lies in the future the wheel is moved past the current tick,
+ * as every slot in between is empty. The event source is then armed afresh,
+ * since a deadline beyond the reach of its counter makes it fire early.
+ */
+void run_timers(void) {
+  const uint32 flags = irq_save();
+  uint32 now = clock_ticks(), next = 0;
+
+  while ((int32)(now - wheel_now) >= 0) {
+    if (!next_event(&next) || (int32)(next - now) > 0) {
+      wheel_now = now + 1;
+      break;
+    }
+    wheel_now = next;
+    wheel_step(flags);
+    now = clock_ticks();
+  }
+
+  wheel_arm();
+  irq_restore(flags);
+}
+
+/**
+ * \desc The kernel loop cannot run while its caller sleeps, so the sleep runs
+ * the timer work itself: the timer work bit is taken with interrupts disabled
+ * and, if the event source has not fired, the CPU halts until the next
+ * interrupt.
+ */
+void timer_sleep(uint32 ms) {
+  Timer timer = {0};
+  volatile uint8 done = 0;
+
+  timer_add(&timer, ms, wake, (void *)&done);
+  while (!done) {
+    __asm__ volatile("cli");
+    if (!done && !take_work(WORK_TIMER)) {
+      __asm__ volatile("sti; hlt");
+    } else {
+      __asm__ volatile("sti");
+    }
+    run_timers();
+  }
+}
+
+/**
+ * \desc The next event may be a cascade rather than a timer expiring, and is
+ * shown as the ticks from now.
+ */
+void timer_stats(void) {
+  uint32 next = 0;
+  const uint32 flags = irq_save();
+  const uint32 found = next_event(&next);
+  irq_restore(flags);
+
+  kprintf("   Timers pending %u, fired %u", timers_pending, timers_fired);
+  if (found) {
+    const uint32 now = clock_ticks();
+    kprintf(", next event in %u ticks",
+            (int32)(next - now) > 0 ? next - now : 0);
+  }
+  kprintf(", timer interrupts %u\n", timer_interrupts());
+}
+
+/**
+ * \desc Measures a one second timer_sleep() against the clock, counting the
+ * timer interrupts taken to reach the deadline.
+ */
+void sleep_test(void) {
+  const uint32 before = timer_interrupts();
+  const uint64 start = clock_ns();
+
+  timer_sleep(1000);
+
+  kprintf("   Slept 1000 ms in %u us, %u timer interrupts\n",
+          (uint32)udiv64(clock_ns() - start, 1000),
+          timer_interrupts() - before);
+}
\ No newline at end of file
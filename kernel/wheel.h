@@ -0,0 +1,108 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file wheel.h
+ * \brief Timer wheel declarations.
+ *
+ * Timers are kept in a hierarchical timer wheel of WHEEL_LEVELS levels with
+ * WHEEL_SLOTS slots each, counted in clock ticks. A timer due within 64 ticks
+ * sits in the first level in the slot for its exact tick, one due within 4096
+ * ticks in the second level in the slot for its 64-tick span, and so on. When
+ * the wheel reaches the start of a span, the timers in that slot of the level
+ * above are cascaded down, so each timer is moved at most once per level.
+ * A timer further ahead than the wheel spans is parked in the top level, in
+ * the slot as far ahead as the wheel reaches, keeping its true expiry, and is
+ * parked again each time that slot is cascaded until it comes within reach.
+ * Adding and cancelling are O(1): a timer is linked into or out of a slot's
+ * list, and a bitmap of non-empty slots per level is kept alongside.
+ *
+ * The same bitmaps give the next tick at which the wheel has something to do,
+ * which is where the clock event source is armed to interrupt. Expired timers
+ * are run from the kernel loop as deferred work, with interrupts enabled.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include "../common/types.h"
+
+/* Shape of the wheel: 4 levels of 64 slots span 2^24 ticks */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+/* Longest timeout in ticks, about 12 days at 1000 Hz. Expiry ticks are
+ * compared as signed 32-bit distances from the wheel, which may lag the clock
+ * by up to a wheel span, so timer_add() clamps longer timeouts to this */
+#define TIMER_MAX_TICKS (1u << 30)
+
+/* Function pointer definition for timer callbacks */
+typedef void (*Timer_Callback)(void *data);
+
+/**
+ * A timer, owned by the caller and linked into the wheel while pending.
+ */
+typedef struct Timer {
+  struct Timer *prev;      /**< Previous timer in the slot */
+  struct Timer *next;      /**< Next timer in the slot */
+  uint32 expires;          /**< Tick at which the timer fires */
+  uint8 pending;           /**< Non-zero while linked into the wheel */
+  uint8 level;             /**< Wheel level holding the timer */
+  uint8 slot;              /**< Slot within the level */
+  Timer_Callback callback; /**< Function run when the timer fires */
+  void *data;              /**< Argument passed to the callback */
+} Timer;
+
+/**
+ * \brief Adds a timer to the wheel, replacing it if already pending.
+ * \param [in] timer The timer, which must stay valid until it fires or is
+ * cancelled.
+ * \param [in] ms Milliseconds from now until the timer fires, clamped to
+ * TIMER_MAX_TICKS ticks.
+ * \param [in] callback The function to run when the timer fires.
+ * \param [in] data The argument passed to the callback.
+ * \returns None.
+ */
+void timer_add(Timer *timer, uint32 ms, Timer_Callback callback, void *data);
+
+/**
+ * \brief Removes a timer from the wheel if it is pending.
+ * \param [in] timer The timer.
+ * \returns Non-zero if the timer was pending.
+ */
+uint32 timer_cancel(Timer *timer);
+
+/**
+ * \brief Runs expired timers and arms the event source for the next deadline.
+ * \param None.
+ * \returns None.
+ */
+void run_timers(void);
+
+/**
+ * \brief Sleeps for a number of milliseconds, running due timers meanwhile.
+ * \param [in] ms Milliseconds to sleep for.
+ * \returns None.
+ */
+void timer_sleep(uint32 ms);
+
+/**
+ * \brief Prints the pending timers, the next deadline and the wakeups.
+ * \param None.
+ * \returns None.
+ */
+void timer_stats(void);
+
+/**
+ * \brief Sleeps for one second and prints how long the sleep actually took.
+ * \param None.
+ * \returns None.
+ */
+void sleep_test(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file work.c
+ * \brief Deferred work implementation.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#include "work.h"
+#include "../common/atomic.h"
+#include "../common/printf.h"
+#include "../common/string.h"
+#include "../cpu/timer.h"
+#include "../drivers/screen.h"
+#include "thread.h"
+
+static Work_Handler work_handlers[WORK_MAX];
+static volatile uint32 work_pending = 0;
+
+/* The thread running the kernel loop, woken when work is raised */
+static Thread *work_thread = 0;
+
+/* Idle accounting, in time-stamp counter cycles */
+static uint64 loop_start = 0;
+static uint64 idle_cycles = 0;
+static uint32 idle_wakeups = 0;
+
+/**
+ * \desc Installs a function to an index in the work_handlers array, in the same
+ * manner as reg_interrupt_handler().
+ */
+void reg_work_handler(uint32 n, const Work_Handler handler) {
+  work_handlers[n] = handler;
+}
+
+/**
+ * \desc Sets the bit with a single locked instruction, so that it cannot be
+ * lost against the kernel loop taking the pending bits, then wakes the kernel
+ * loop in case it is blocked.
+ */
+void raise_work(uint32 n) {
+  atomic_or(&work_pending, 1u << n);
+  if (work_thread != 0) {
+    thread_wake(work_thread);
+  }
+}
+
+/**
+ * \desc Clears the bit with a single locked instruction, in the same manner as
+ * raise_work(), and returns its previous value.
+ */
+uint32 take_work(uint32 n) {
+  return atomic_test_and_clear(&work_pending, n);
+}
+
+/**
+ * \desc Interrupts are disabled while checking for work, and re-enabled by the
+ * sti immediately before hlt. An interrupt cannot be taken between the two
+ * instructions, so any work raised after the check wakes the CPU from the hlt
+ * rather than waiting for the interrupt after it. Pending bits are taken all
+ * at once with xchg and their handlers run in bit order with interrupts on.
+ * When other threads are ready, the kernel loop blocks instead of halting and
+ * is woken by raise_work(), so they run while there is no work.
+ */
+void kernel_loop(void) {
+  uint32 pending = 0, n = 0;
+  uint64 start = 0;
+
+  loop_start = rdtsc();
+  work_thread = thread_current();
+
+  while (1) {
+    __asm__ volatile("cli");
+    if (work_pending == 0 && thread_ready()) {
+      thread_block();
+      continue;
+    }
+    if (work_pending == 0) {
+      start = rdtsc();
+      __asm__ volatile("sti; hlt");
+      idle_cycles += rdtsc() - start;
+      ++idle_wakeups;
+      continue;
+    }
+    __asm__ volatile("sti");
+
+    pending = atomic_xchg(&work_pending, 0);
+
+    for (n = 0; n < WORK_MAX && pending != 0; ++n, pending >>= 1) {
+      if ((pending & 1) && work_handlers[n] != 0) {
+        work_handlers[n]();
+      }
+    }
+  }
+}
+
+/**
+ * \desc Both counts are shifted down together until the total fits in 25 bits,
+ * so the percentage can be found with 32-bit arithmetic.
+ */
+void idle_stats(void) {
+  uint64 total = rdtsc() - loop_start;
+  uint64 idle = idle_cycles;
+
+  while (total >> 25) {
+    total >>= 1;
+    idle >>= 1;
+  }
+
+  kprintf("   Idle %u%%, wakeups %u\n",
+          total ? (uint32)idle * 100 / (uint32)total : 0, idle_wakeups);
+}
\ No newline at end of file
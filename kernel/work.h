@@ -0,0 +1,69 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file work.h
+ * \brief Deferred work declarations.
+ *
+ * Interrupt handlers should do as little as possible with interrupts disabled.
+ * Anything that can wait is handed to the kernel loop instead: the handler
+ * raises a work bit, and the kernel loop runs the handler installed for every
+ * raised bit with interrupts enabled. When no work is pending, the kernel loop
+ * halts the CPU until the next interrupt and counts the cycles spent halted,
+ * or blocks to let any other ready thread run.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#ifndef WORK_H
+#define WORK_H
+
+#include "../common/types.h"
+
+/* Deferred work identifiers, one bit each */
+#define WORK_KEYBOARD 0
+#define WORK_TIMER 1
+#define WORK_MAX 32
+
+/* Function pointer definition for deferred work handlers */
+typedef void (*Work_Handler)(void);
+
+/**
+ * \brief Installs a handler for a deferred work identifier.
+ * \param [in] n The work identifier.
+ * \param [in] handler The function to run when the work is raised.
+ * \returns None.
+ */
+void reg_work_handler(uint32 n, const Work_Handler handler);
+
+/**
+ * \brief Marks work as pending, safe to call from interrupt context.
+ * \param [in] n The work identifier.
+ * \returns None.
+ */
+void raise_work(uint32 n);
+
+/**
+ * \brief Clears a work bit, for code that runs the work itself.
+ * \param [in] n The work identifier.
+ * \returns Non-zero if the work was pending.
+ */
+uint32 take_work(uint32 n);
+
+/**
+ * \brief Runs deferred work forever, halting the CPU whenever there is none.
+ * \param None.
+ * \returns Does not return.
+ */
+void kernel_loop(void);
+
+/**
+ * \brief Prints the share of time the CPU has spent halted.
+ * \param None.
+ * \returns None.
+ */
+void idle_stats(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,544 @@
+/* =============================================================================
+ *   PikOS
+ * ========================================================================== */
+
+/**
+ * \file host_test.c
+ * \brief Host build test and benchmark of the common string and memory
+ * routines.
+ *
+ * Built by make host-test as an ordinary 32-bit Linux program together with
+ * common/string.c, common/memory.c, common/printf.c and common/math.c. Those
+ * are compiled with their libc clashing names prefixed with pikos_, so that
+ * each routine can be checked against its libc counterpart over randomized
+ * inputs and then both timed on the same inputs. The few kernel functions
+ * memory.c calls are stubbed below. The kernel is built with -O0, and so is
+ * this program, so the times compare the kernel code as it runs in the kernel
+ * with an optimised libc.
+ *
+ * Every check failure is printed, and the exit status is non-zero if there
+ * were any. An optional argument sets the seed of the inputs.
+ *
+ * \author Anthony Mercer
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define strlen pikos_strlen
+#define strcmp pikos_strcmp
+#define strcat pikos_strcat
+#define memcpy pikos_memcpy
+#define memmove pikos_memmove
+#define memset pikos_memset
+#include "../common/memory.h"
+#include "../common/printf.h"
+#include "../common/string.h"
+#include "../kernel/frame.h"
+#include "../kernel/lock.h"
+#undef strlen
+#undef strcmp
+#undef strcat
+#undef memcpy
+#undef memmove
+#undef memset
+
+/* Randomized cases checked for each routine */
+#define HOST_CASES 20000
+
+/* Longest random string, and the pool of inputs the benchmarks cycle over */
+#define HOST_MAX_LEN 256
+#define HOST_POOL 1024
+
+/* Calls timed for each benchmark */
+#define HOST_CALLS 200000
+
+/* Bytes of the buffers the memory routines are checked on */
+#define HOST_BUFFER 4096
+
+static uint32 random_state = 2463534242u;
+static uint32 failures = 0;
+
+/* Inputs shared by the benchmarks */
+static char *pool[HOST_POOL];
+static int32 numbers[HOST_POOL];
+
+/*------------------------------------------------------------------------------
+ * KERNEL STUBS
+ * ---------------------------------------------------------------------------*/
+
+uint32 frame_alloc(void) {
+  return (uint32)aligned_alloc(FRAME_SIZE, FRAME_SIZE);
+}
+
+void frame_free(uint32 addr) { free((void *)addr); }
+
+uint32 frame_free_count(void) { return 0; }
+
+void print(const char *str) { fputs(str, stdout); }
+
+uint32 irq_save(void) { return 0; }
+
+void irq_restore(uint32 flags) { (void)flags; }
+
+uint32 spin_lock_irqsave(Spinlock *lock) {
+  (void)lock;
+  return 0;
+}
+
+void spin_unlock_irqrestore(Spinlock *lock, uint32 flags) {
+  (void)lock;
+  (void)flags;
+}
+
+uint32 cpu_has(uint32 features) { return features == 0; }
+
+uint64 rdtsc(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64)now.tv_sec * 1000000000u + (uint64)now.tv_nsec;
+}
+
+/*------------------------------------------------------------------------------
+ * PRIVATE STATIC FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \brief Returns the next number of a xorshift generator.
+ * \param None.
+ * \returns A pseudo-random number.
+ */
+static uint32 next_random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+/**
+ * \brief Fills a string with printable characters, the only ones the kernel
+ * handles.
+ * \param [out] str The string, with room for len characters and the null.
+ * \param [in] len The characters.
+ * \returns None.
+ */
+static void random_string(char *str, uint32 len) {
+  uint32 i = 0;
+
+  for (i = 0; i < len; ++i) {
+    str[i] = (char)(' ' + next_random() % 95);
+  }
+  str[len] = '\0';
+}
+
+/**
+ * \brief Returns a random number, often a small one or an extreme, as those
+ * are where conversions go wrong.
+ * \param None.
+ * \returns The number.
+ */
+static int32 random_number(void) {
+  switch (next_random() % 8) {
+  case 0:
+    return (int32)(next_random() % 32) - 16;
+  case 1:
+    return next_random() % 2 ? 0x7FFFFFFF : (int32)0x80000000;
+  default:
+    return (int32)next_random();
+  }
+}
+
+/**
+ * \brief Records a failed check.
+ * \param [in] name The routine checked.
+ * \param [in] input The input that failed, as text.
+ * \param [in] got The result of the routine.
+ * \param [in] want The result of libc.
+ * \returns None.
+ */
+static void fail(const char *name, const char *input, const char *got,
+                 const char *want) {
+  if (++failures <= 10) {
+    printf("FAIL %s(%.40s): got \"%.40s\", want \"%.40s\"\n", name, input, got,
+           want);
+  }
+}
+
+/**
+ * \brief Returns the sign of a comparison.
+ * \param [in] n The comparison.
+ * \returns -1, 0 or 1.
+ */
+static int sign(int n) { return (n > 0) - (n < 0); }
+
+/**
+ * \brief Returns the time in nanoseconds.
+ * \param None.
+ * \returns The time.
+ */
+static double now_ns(void) { return (double)rdtsc(); }
+
+/**
+ * \brief Checks strlen, strcmp and strcat on random strings. The strings
+ * compared share a random prefix, so that the comparison reads into them.
+ * \param None.
+ * \returns None.
+ */
+static void check_strings(void) {
+  char a[2 * HOST_MAX_LEN + 1], want[2 * HOST_MAX_LEN + 1];
+  char b[HOST_MAX_LEN + 1];
+  uint32 i = 0, len = 0, prefix = 0;
+
+  for (i = 0; i < HOST_CASES; ++i) {
+    len = next_random() % (HOST_MAX_LEN + 1);
+    random_string(a, len);
+    if (pikos_strlen(a) != strlen(a)) {
+      fail("strlen", a, "wrong length", "libc length");
+    }
+
+    prefix = next_random() % (len + 1);
+    random_string(b, next_random() % (HOST_MAX_LEN + 1));
+    memcpy(b, a, prefix < strlen(b) ? prefix : strlen(b));
+    if (next_random() % 4 == 0) {
+      strcpy(b, a);
+    }
+    if (sign(pikos_strcmp(a, b)) != sign(strcmp(a, b))) {
+      fail("strcmp", a, b, "libc sign");
+    }
+
+    strcpy(want, a);
+    strcat(want, b);
+    pikos_strcat(a, b);
+    if (strcmp(a, want) != 0) {
+      fail("strcat", b, a, want);
+    }
+  }
+}
+
+/**
+ * \brief Checks itostr and xtostr against printf. xtostr gives at least two
+ * digits and appends to its string, so the string is cleared first.
+ * \param None.
+ * \returns None.
+ */
+static void check_numbers(void) {
+  char got[16], want[16], input[16];
+  uint32 i = 0;
+
+  for (i = 0; i < HOST_CASES; ++i) {
+    const int32 n = random_number();
+    snprintf(input, sizeof(input), "%d", n);
+
+    itostr(n, got);
+    if (strcmp(got, input) != 0) {
+      fail("itostr", input, got, input);
+    }
+
+    got[0] = '\0';
+    xtostr(n, got);
+    snprintf(want, sizeof(want), (uint32)n < 0x10 ? "0x0%x" : "0x%x",
+             (uint32)n);
+    if (strcmp(got, want) != 0) {
+      fail("xtostr", input, got, want);
+    }
+  }
+}
+
+/**
+ * \brief Checks ksnprintf against snprintf with random conversions, flags,
+ * widths and buffer sizes, so that truncation is checked too. %p is checked
+ * against %08x with a 0x prefix, the form the kernel gives pointers.
+ * \param None.
+ * \returns None.
+ */
+static void check_format(void) {
+  static const char conversions[] = "duxsc";
+  static const char *const flags[] = {"", "-", "0", "-0"};
+  char fmt[32], got[48], want[48], word[16];
+  uint32 i = 0;
+
+  for (i = 0; i < HOST_CASES; ++i) {
+    const char conversion = conversions[next_random() % 5];
+    const uint32 size = next_random() % sizeof(got);
+    const int32 n = random_number();
+    const uint32 flag = next_random() % (conversion == 's' ||
+                                         conversion == 'c' ? 2 : 4);
+    uint32 got_len = 0, want_len = 0;
+
+    snprintf(fmt, sizeof(fmt), "<%%%s%u%c>", flags[flag], next_random() % 16,
+             conversion);
+    random_string(word, next_random() % sizeof(word));
+    memset(got, '#', sizeof(got));
+    memset(want, '#', sizeof(want));
+    if (conversion == 's') {
+      got_len = ksnprintf(got, size, fmt, word);
+      want_len = (uint32)snprintf(want, size, fmt, word);
+    } else if (conversion == 'c') {
+      got_len = ksnprintf(got, size, fmt, word[0] ? word[0] : 'k');
+      want_len = (uint32)snprintf(want, size, fmt, word[0] ? word[0] : 'k');
+    } else {
+      got_len = ksnprintf(got, size, fmt, n);
+      want_len = (uint32)snprintf(want, size, fmt, n);
+    }
+    if (got_len != want_len || memcmp(got, want, sizeof(got)) != 0) {
+      fail("ksnprintf", fmt, size ? got : "", size ? want : "");
+    }
+
+    ksnprintf(got, sizeof(got), "%p", (void *)(uint32)n);
+    snprintf(want, sizeof(want), "0x%08x", (uint32)n);
+    if (strcmp(got, want) != 0) {
+      fail("ksnprintf", "%p", got, want);
+    }
+  }
+}
+
+/**
+ * \brief Checks the string buffer over random appends, concatenations,
+ * backspaces and clears against libc on a plain string, a small buffer being
+ * used so that it is often full.
+ * \param None.
+ * \returns None.
+ */
+static void check_buffer(void) {
+  char data[64], want[64], word[8];
+  String_Buffer sb;
+  uint32 i = 0, room = 0, ok = 0;
+
+  strbuf_init(&sb, data, sizeof(data));
+  want[0] = '\0';
+  for (i = 0; i < HOST_CASES; ++i) {
+    room = sizeof(data) - 1 - strlen(want);
+    switch (next_random() % 4) {
+    case 0:
+      ok = strbuf_app(&sb, 'k') == (room > 0);
+      strncat(want, "k", room);
+      break;
+    case 1:
+      random_string(word, next_random() % sizeof(word));
+      ok = strbuf_cat(&sb, word) ==
+           (strlen(word) < room ? strlen(word) : room);
+      strncat(want, word, room);
+      break;
+    case 2:
+      ok = strbuf_bs(&sb) == (want[0] != '\0');
+      if (want[0] != '\0') {
+        want[strlen(want) - 1] = '\0';
+      }
+      break;
+    default:
+      if (next_random() % 16 == 0) {
+        strbuf_clr(&sb);
+        want[0] = '\0';
+      }
+      ok = 1;
+    }
+    if (!ok || sb.len != strlen(want) || strcmp(data, want) != 0) {
+      fail("strbuf", want, data, want);
+    }
+  }
+}
+
+/**
+ * \brief Checks memcpy, memmove and memset over random offsets and lengths,
+ * with the moves overlapping in either direction, against the libc results
+ * on a copy of the buffer.
+ * \param None.
+ * \returns None.
+ */
+static void check_memory(void) {
+  static char buffer[HOST_BUFFER], want[HOST_BUFFER], src[HOST_BUFFER];
+  char input[48];
+  uint32 i = 0;
+
+  random_string(src, HOST_BUFFER - 1);
+  for (i = 0; i < HOST_CASES; ++i) {
+    const uint32 len = next_random() % (HOST_BUFFER / 2);
+    const uint32 to = next_random() % (HOST_BUFFER - len);
+    const uint32 from = next_random() % (HOST_BUFFER - len);
+    const int32 c = (int32)(next_random() % 256);
+
+    snprintf(input, sizeof(input), "%u, %u, %u", to, from, len);
+    random_string(buffer, HOST_BUFFER - 1);
+    memcpy(want, buffer, HOST_BUFFER);
+
+    pikos_memcpy(buffer + to, src + from, len);
+    memcpy(want + to, src + from, len);
+    if (memcmp(buffer, want, HOST_BUFFER) != 0) {
+      fail("memcpy", input, "different bytes", "libc bytes");
+    }
+
+    pikos_memmove(buffer + to, buffer + from, len);
+    memmove(want + to, want + from, len);
+    if (memcmp(buffer, want, HOST_BUFFER) != 0) {
+      fail("memmove", input, "different bytes", "libc bytes");
+    }
+
+    pikos_memset(buffer + from, c, len);
+    memset(want + from, c, len);
+    if (memcmp(buffer, want, HOST_BUFFER) != 0) {
+      fail("memset", input, "different bytes", "libc bytes");
+    }
+  }
+}
+
+/**
+ * \brief Runs check_memory() with memcpy() and memset() bound to each of
+ * their implementations in turn, those of a round sharing an index. A round
+ * including an implementation using SSE is skipped, as it writes CR0, which
+ * user mode cannot; rep movsb and rep stosb run without ERMS, only slower.
+ * \param None.
+ * \returns The rounds run.
+ */
+static uint32 check_variants(void) {
+  Cpu_Dispatch *const dispatches[] = {&memcpy_dispatch, &memset_dispatch};
+  const uint32 count = sizeof(dispatches) / sizeof(dispatches[0]);
+  uint32 round = 0, runs = 0, i = 0, more = 1;
+
+  for (round = 0; more; ++round) {
+    uint32 skip = 0;
+    more = 0;
+    for (i = 0; i < count; ++i) {
+      Cpu_Dispatch *d = dispatches[i];
+      d->bound = &d->variants[round < d->count ? round : d->count - 1];
+      *d->slot = d->bound->fn;
+      skip |= d->bound->features & CPU_SSE;
+      more |= round + 1 < d->count;
+    }
+    if (!skip) {
+      printf("memcpy %s, memset %s\n", dispatches[0]->bound->name,
+             dispatches[1]->bound->name);
+      check_memory();
+      ++runs;
+    }
+  }
+  return runs;
+}
+
+/**
+ * \brief Prints the times of a routine and its libc counterpart.
+ * \param [in] name The routine.
+ * \param [in] pikos The nanoseconds taken by the routine.
+ * \param [in] libc The nanoseconds taken by libc.
+ * \returns None.
+ */
+static void report(const char *name, double pikos, double libc) {
+  printf("%-8s %10.1f %10.1f %8.2fx\n", name, pikos / HOST_CALLS,
+         libc / HOST_CALLS, libc > 0 ? pikos / libc : 0.0);
+}
+
+/**
+ * \brief Times the string routines and libc over the pool of random inputs.
+ * strcat appends a pool string to a fresh copy of another each call, the copy
+ * being made for both so that it cancels out.
+ * \param None.
+ * \returns None.
+ */
+static void bench(void) {
+  char dest[2 * HOST_MAX_LEN + 1], num[16];
+  volatile uint32 sink = 0;
+  double start = 0, pikos = 0;
+  uint32 i = 0;
+
+  printf("%-8s %10s %10s %9s\n", "ns/call", "pikos", "libc", "ratio");
+
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    sink += pikos_strlen(pool[i % HOST_POOL]);
+  }
+  pikos = now_ns() - start;
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    sink += strlen(pool[i % HOST_POOL]);
+  }
+  report("strlen", pikos, now_ns() - start);
+
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    sink += pikos_strcmp(pool[i % HOST_POOL], pool[(i + 1) % HOST_POOL]);
+  }
+  pikos = now_ns() - start;
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    sink += strcmp(pool[i % HOST_POOL], pool[(i + 1) % HOST_POOL]);
+  }
+  report("strcmp", pikos, now_ns() - start);
+
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    strcpy(dest, pool[i % HOST_POOL]);
+    pikos_strcat(dest, pool[(i + 1) % HOST_POOL]);
+  }
+  pikos = now_ns() - start;
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    strcpy(dest, pool[i % HOST_POOL]);
+    strcat(dest, pool[(i + 1) % HOST_POOL]);
+  }
+  report("strcat", pikos, now_ns() - start);
+
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    itostr(numbers[i % HOST_POOL], num);
+  }
+  pikos = now_ns() - start;
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    snprintf(num, sizeof(num), "%d", numbers[i % HOST_POOL]);
+  }
+  report("itostr", pikos, now_ns() - start);
+
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    num[0] = '\0';
+    xtostr(numbers[i % HOST_POOL], num);
+  }
+  pikos = now_ns() - start;
+  start = now_ns();
+  for (i = 0; i < HOST_CALLS; ++i) {
+    snprintf(num, sizeof(num), "0x%x", (uint32)numbers[i % HOST_POOL]);
+  }
+  report("xtostr", pikos, now_ns() - start);
+}
+
+/*------------------------------------------------------------------------------
+ * PUBLIC API FUNCTIONS
+ * ---------------------------------------------------------------------------*/
+
+/**
+ * \desc Checks every routine, then fills the pool with random strings and
+ * numbers and times them. The seed is printed so that a failure can be
+ * repeated.
+ */
+int main(int argc, char **argv) {
+  uint32 i = 0, runs = 0;
+
+  if (argc > 1) {
+    random_state = (uint32)strtoul(argv[1], 0, 0);
+    random_state = random_state ? random_state : 1;
+  }
+  printf("seed %u\n", random_state);
+
+  check_strings();
+  check_numbers();
+  check_buffer();
+  check_format();
+  runs = check_variants();
+  printf("%u checks, %u failed\n", (8 + 3 * runs) * HOST_CASES, failures);
+
+  for (i = 0; i < HOST_POOL; ++i) {
+    pool[i] = malloc(HOST_MAX_LEN + 1);
+    random_string(pool[i], next_random() % (HOST_MAX_LEN + 1));
+    numbers[i] = random_number();
+  }
+  bench();
+  for (i = 0; i < HOST_POOL; ++i) {
+    free(pool[i]);
+  }
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
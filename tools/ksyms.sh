@@ -0,0 +1,29 @@
+#!/bin/sh
+# ==============================================================================
+# ksyms.sh
+# ==============================================================================
+# Generates the kernel symbol table used by the profiler. Reads the output of
+# "nm -n --defined-only kernel.elf" on standard input and writes C source with
+# every function, in address order, to standard output. Empty input gives an
+# empty table, for the first link of the kernel.
+# ==============================================================================
+
+awk '
+BEGIN {
+  print "/* Generated by tools/ksyms.sh, do not edit */"
+  print ""
+  print "#include \"kernel/profile.h\""
+  print ""
+  print "const Kernel_Symbol kernel_symbols[] = {"
+  count = 0
+}
+$2 ~ /^[tT]$/ && $3 !~ /^_*etext$/ {
+  printf "  {0x%s, \"%s\"},\n", $1, $3
+  ++count
+}
+END {
+  print "  {0xFFFFFFFF, 0},"
+  print "};"
+  print ""
+  printf "const uint32 kernel_symbol_count = %d;\n", count
+}'
\ No newline at end of file
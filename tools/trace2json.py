@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+# ==============================================================================
+# trace2json.py
+# ==============================================================================
+# Decodes a PikOS trace dump into Chrome trace JSON, for chrome://tracing or
+# Perfetto. Reads the serial output of the TRACE command from a file or
+# standard input, ignoring every line not starting with "@trace", and writes
+# the JSON to standard output. Each processor is shown as a thread, with the
+# interrupt handlers and prints as durations and the other events as instants.
+# The text kprintf() writes into the trace becomes a log instant for each call.
+#
+#   make run-headless | tee serial.log
+#   tools/trace2json.py serial.log > trace.json
+# ==============================================================================
+
+import json
+import struct
+import sys
+
+# Event numbers, as in kernel/trace.h, with their name and Chrome phase
+EVENTS = {
+    0: ("irq", "B"),
+    1: ("irq", "E"),
+    2: ("timer", "i"),
+    3: ("keyboard", "i"),
+    4: ("print", "B"),
+    5: ("print", "E"),
+    6: ("log", "i"),
+}
+
+# Layout of a Trace_Record: tsc, event, arg16, arg
+RECORD = struct.Struct("<QHHI")
+
+
+def decode(lines):
+    """Returns the TSC frequency in kHz and the (cpu, record) pairs."""
+    tsc_khz = 0
+    records = []
+    for line in lines:
+        fields = line.strip().split()
+        if len(fields) < 2 or fields[0] != "@trace":
+            continue
+        if fields[1] == "begin":
+            tsc_khz = int(fields[2])
+            records = []
+        elif fields[1] != "end" and len(fields) == 3:
+            data = bytes.fromhex(fields[2])
+            if len(data) == RECORD.size:
+                records.append((int(fields[1]), RECORD.unpack(data)))
+    return tsc_khz, records
+
+
+def to_chrome(tsc_khz, records):
+    """Converts the records to Chrome trace events, times in microseconds."""
+    if not records:
+        return []
+    records.sort(key=lambda r: (r[1][0], r[0]))
+    base = records[0][1][0]
+    scale = 1000.0 / tsc_khz if tsc_khz else 1.0
+    events = []
+    text = {}
+    for cpu, (tsc, event, arg16, arg) in records:
+        if event == 6:
+            chars = text.get(cpu, b"") + struct.pack("<HI", arg16, arg)
+            if b"\0" not in chars:
+                text[cpu] = chars
+                continue
+            text[cpu] = b""
+        name, phase = EVENTS.get(event, ("event %d" % event, "i"))
+        entry = {"name": name, "ph": phase, "pid": 0, "tid": cpu,
+                 "ts": (tsc - base) * scale}
+        if event in (0, 1):
+            entry["args"] = {"vector": arg}
+        elif event == 2:
+            entry["args"] = {"eip": "0x%08x" % arg}
+        elif event == 3:
+            entry["args"] = {"scancode": arg, "depth": arg16}
+        elif event == 5:
+            entry["args"] = {"chars": arg}
+        elif event == 6:
+            message = chars.split(b"\0")[0]
+            entry["args"] = {"text": message.decode("ascii", "replace")}
+        if phase == "i":
+            entry["s"] = "t"
+        events.append(entry)
+    for cpu in sorted({r[0] for r in records}):
+        events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": cpu,
+                       "args": {"name": "CPU %d" % cpu}})
+    return events
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    with source:
+        tsc_khz, records = decode(source)
+    json.dump({"traceEvents": to_chrome(tsc_khz, records),
+               "displayTimeUnit": "ns"}, sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
\ No newline at end of file